@@ -0,0 +1,188 @@
+#include "tictactoe.h"
+
+
+/*
+ * Perfect-play engine for SERVER_MARK: negamax with alpha-beta over the
+ * bitboard, sharing one transposition table between all games. Entries are
+ * keyed by the canonical encoding of a position under the 8 symmetries of
+ * the board, and initAi warms the table for every reachable position, so a
+ * server move is a table hit rather than a search.
+ */
+
+
+#define SYMMETRIES 8
+
+// transposition table bound types
+#define TT_EMPTY 0
+#define TT_EXACT 1
+#define TT_LOWER 2
+#define TT_UPPER 3
+
+struct tt_entry {
+    int8_t score;  // for the side to move
+    uint8_t move;  // best square (1-9) in the canonical orientation, 0 if none
+    uint8_t bound;
+};
+
+// square i of a board lands on square SYMMETRY[s][i] of its s-th symmetric image
+static const uint8_t SYMMETRY[SYMMETRIES][ROWS * COLUMNS] = {
+        {0, 1, 2, 3, 4, 5, 6, 7, 8},  // identity
+        {2, 5, 8, 1, 4, 7, 0, 3, 6},  // rotate 90
+        {8, 7, 6, 5, 4, 3, 2, 1, 0},  // rotate 180
+        {6, 3, 0, 7, 4, 1, 8, 5, 2},  // rotate 270
+        {2, 1, 0, 5, 4, 3, 8, 7, 6},  // mirror columns
+        {6, 7, 8, 3, 4, 5, 0, 1, 2},  // mirror rows
+        {0, 3, 6, 1, 4, 7, 2, 5, 8},  // main diagonal
+        {8, 5, 2, 7, 4, 1, 6, 3, 0}};  // anti diagonal
+
+// search the center, then corners, then edges first for earlier cutoffs
+static const uint8_t MOVE_ORDER[ROWS * COLUMNS] = {4, 0, 2, 6, 8, 1, 3, 5, 7};
+
+static uint16_t symmetricMask[SYMMETRIES][FULL_BOARD + 1];
+static struct tt_entry table[POSITIONS];
+static __thread uint32_t randomState = 2463534242u;
+
+
+/*
+ * return the canonical index of a board and the symmetry that produces it
+ */
+int canonicalIndex(const struct bitboard *board, int *symmetryPtr) {
+    int best = POSITIONS, bestSymmetry = 0;
+    for (int s = 0; s < SYMMETRIES; s++) {
+        int idx = ternaryTable[symmetricMask[s][board->x]]
+                  + 2 * ternaryTable[symmetricMask[s][board->o]];
+        if (idx < best) {
+            best = idx;
+            bestSymmetry = s;
+        }
+    }
+    if (symmetryPtr != NULL) *symmetryPtr = bestSymmetry;
+    return best;
+}
+
+
+/*
+ * Function: negamax
+ * ----------------------------
+ *   Score a position for the side to move: positive wins, negative loses,
+ *   faster wins and slower losses score higher
+ *
+ *   mine / theirs: squares of the side to move and of its opponent
+ */
+int negamax(uint16_t mine, uint16_t theirs, int alpha, int beta) {
+    const uint16_t empty = ~(mine | theirs) & FULL_BOARD;
+
+    // the opponent has just moved, so only it can have won
+    struct bitboard board = {mine, theirs};
+    int outcome = outcomeTable[boardIndex(&board)] & OUTCOME_MASK;
+    if (outcome == OUTCOME_O_WINS) return -(1 + __builtin_popcount(empty));
+    if (outcome == OUTCOME_DRAW) return 0;
+
+    int symmetry;
+    int key = canonicalIndex(&board, &symmetry);
+    struct tt_entry *entry = &table[key];
+    if (entry->bound == TT_EXACT
+        || (entry->bound == TT_LOWER && entry->score >= beta)
+        || (entry->bound == TT_UPPER && entry->score <= alpha))
+        return entry->score;
+
+    const int alphaOrig = alpha;
+    int bestScore = -100, bestSquare = -1;
+    for (int k = 0; k < ROWS * COLUMNS; k++) {
+        int square = MOVE_ORDER[k];
+        if (((empty >> square) & 1) == 0) continue;
+
+        int score = -negamax(theirs, mine | (uint16_t) (1 << square), -beta, -alpha);
+        if (score > bestScore) {
+            bestScore = score;
+            bestSquare = square;
+        }
+        if (score > alpha) alpha = score;
+        if (alpha >= beta) break;
+    }
+
+    entry->score = (int8_t) bestScore;
+    entry->move = (uint8_t) (SYMMETRY[symmetry][bestSquare] + 1);
+    if (bestScore <= alphaOrig) entry->bound = TT_UPPER;
+    else if (bestScore >= beta) entry->bound = TT_LOWER;
+    else entry->bound = TT_EXACT;
+    return bestScore;
+}
+
+
+/*
+ * Function: initAi
+ * ----------------------------
+ *   Build the symmetry tables and search every legal unfinished position
+ *   with a full window, leaving an exact entry for each of them.
+ *   Must run once before any game thread starts.
+ */
+void initAi() {
+    for (int s = 0; s < SYMMETRIES; s++) {
+        for (uint16_t m = 0; m <= FULL_BOARD; m++) {
+            uint16_t image = 0;
+            for (int i = 0; i < ROWS * COLUMNS; i++)
+                if ((m >> i) & 1) image |= (uint16_t) (1 << SYMMETRY[s][i]);
+            symmetricMask[s][m] = image;
+        }
+    }
+
+    int positions = 0;
+    for (uint16_t x = 0; x <= FULL_BOARD; x++) {
+        for (uint16_t o = 0; o <= FULL_BOARD; o++) {
+            struct bitboard board = {x, o};
+            if (isPositionLegal(&board) == 0) continue;
+            uint8_t entry = outcomeTable[boardIndex(&board)];
+            if ((entry & OUTCOME_MASK) != OUTCOME_ON) continue;
+
+            // table keys are (side to move, opponent), not (x, o)
+            struct bitboard view = (entry & O_TO_MOVE) ? (struct bitboard) {o, x} : board;
+            if (table[canonicalIndex(&view, NULL)].bound == TT_EXACT) continue;
+            negamax(view.x, view.o, -100, 100);
+            positions++;
+        }
+    }
+    LOG(LOG_INFO, "AI ready, %d canonical positions searched.\n", positions);
+}
+
+
+uint8_t randomMove(const struct bitboard *board) {
+    uint16_t empty = ~(board->x | board->o) & FULL_BOARD;
+    if (empty == 0) return ROWS * COLUMNS;
+
+    // xorshift32, one state per thread
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+
+    int skip = (int) (randomState % (uint32_t) __builtin_popcount(empty));
+    while (skip-- > 0) empty &= (uint16_t) (empty - 1);
+    return (uint8_t) (__builtin_ctz(empty) + 1);
+}
+
+
+/*
+ * Function: aiChooseMove
+ * ----------------------------
+ *   Pick the next square (1-9) for SERVER_MARK
+ *
+ *   board: the board, with SERVER_MARK to move
+ *
+ *   level: AI_EASY plays randomly, AI_MEDIUM plays perfectly every other
+ *   move on average, AI_HARD always plays perfectly
+ */
+uint8_t aiChooseMove(const struct bitboard *board, int level) {
+    if (level == AI_EASY) return randomMove(board);
+    if (level == AI_MEDIUM && (randomMove(board) & 1)) return randomMove(board);
+
+    // table keys are (side to move, opponent), not (x, o)
+    const struct bitboard view = {board->o, board->x};
+    int symmetry;
+    const struct tt_entry *entry = &table[canonicalIndex(&view, &symmetry)];
+    if (entry->bound == TT_EMPTY || entry->move == 0) return randomMove(board);
+
+    // map the canonical square back onto the orientation of this board
+    for (int i = 0; i < ROWS * COLUMNS; i++)
+        if (SYMMETRY[symmetry][i] + 1 == entry->move) return (uint8_t) (i + 1);
+    return randomMove(board);
+}
@@ -0,0 +1,183 @@
+#include "tictactoe.h"
+
+
+/*
+ * ns/op of the game kernel over every reachable position, one
+ * "bench=<name> ..." line per function so results can be diffed and graphed
+ */
+
+
+#define DEFAULT_ROUNDS 100
+
+
+static struct bitboard corpus[POSITIONS];  // every legal position
+static int corpusSize;
+static struct bitboard serverTurns[POSITIONS];  // unfinished positions with O to move
+static int serverTurnsSize;
+
+
+double nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+void report(const char *name, const char *variant, int positions, long ops, double ns) {
+    printf("bench=%s variant=%s positions=%d ops=%ld ns_per_op=%.2f\n",
+           name, variant, positions, ops, ns / (double) ops);
+}
+
+
+void buildCorpus() {
+    for (uint16_t x = 0; x <= FULL_BOARD; x++) {
+        for (uint16_t o = 0; o <= FULL_BOARD; o++) {
+            struct bitboard board = {x, o};
+            if (isPositionLegal(&board) == 0) continue;
+            corpus[corpusSize++] = board;
+            if (__builtin_popcount(x) == __builtin_popcount(o) + 1
+                && checkWin(&board, CLIENT_MARK) == GAME_ON)
+                serverTurns[serverTurnsSize++] = board;
+        }
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    long rounds = (argc > 1) ? strtol(argv[1], NULL, 10) : DEFAULT_ROUNDS;
+    if (rounds <= 0) {
+        printf("usage: ./benchKernel [rounds]\n");
+        exit(1);
+    }
+    logLevel = LOG_ERROR;
+    buildCorpus();
+
+    volatile int sink = 0;
+    double start;
+
+    start = nowNs();
+    for (long r = 0; r < rounds; r++)
+        for (int i = 0; i < corpusSize; i++)
+            sink += checkWin(&corpus[i], (i & 1) ? SERVER_MARK : CLIENT_MARK);
+    report("checkWin", "table", corpusSize, rounds * corpusSize, nowNs() - start);
+
+    start = nowNs();
+    for (long r = 0; r < rounds; r++)
+        for (int i = 0; i < corpusSize; i++)
+            for (int choice = 0; choice <= ROWS * COLUMNS + 1; choice++)
+                sink += isMoveValid(&corpus[i], choice);
+    report("isMoveValid", "0-10", corpusSize, rounds * corpusSize * (ROWS * COLUMNS + 2), nowNs() - start);
+
+    struct bitboard board;
+    start = nowNs();
+    for (long r = 0; r < rounds * corpusSize; r++) {
+        initBoard(&board);
+        sink += board.x;
+    }
+    report("initBoard", "-", 0, rounds * corpusSize, nowNs() - start);
+
+    // serverMakeChoice is aiChooseMove at the server's level
+    const char *levels[3] = {"easy", "medium", "hard"};
+    initAi();
+    for (int level = AI_EASY; level <= AI_HARD; level++) {
+        start = nowNs();
+        for (long r = 0; r < rounds; r++)
+            for (int i = 0; i < serverTurnsSize; i++)
+                sink += aiChooseMove(&serverTurns[i], level);
+        report("serverMakeChoice", levels[level], serverTurnsSize, rounds * serverTurnsSize, nowNs() - start);
+    }
+
+    // a move without the socket, then the whole send into /dev/null
+    uint8_t sb[BUFFER_SIZE] = {0};
+    start = nowNs();
+    for (long r = 0; r < rounds; r++) {
+        for (int i = 0; i < serverTurnsSize; i++) {
+            board = serverTurns[i];
+            buildMoveFrame(sb, VERSION_COMPACT, (uint8_t) (__builtin_ctz(~(board.x | board.o)) + 1),
+                           1, (uint8_t) i, &board, SERVER_MARK);
+            sink += sb[2];
+        }
+    }
+    report("buildMoveFrame", "compact", serverTurnsSize, rounds * serverTurnsSize, nowNs() - start);
+
+    // a server reply up to its output queue: built in a zeroed frame on the
+    // stack and copied into the session, as before, or patched in place in
+    // the session's frame template
+    static struct {
+        uint8_t bufferSend[BUFFER_SIZE];
+        struct out_queue outQueue;
+    } session;
+    const uint8_t replyVersions[2] = {VERSION_COMPACT, VERSION};
+    const char *replyNames[2][2] = {{"compact/zeroed", "compact/template"}, {"legacy/zeroed", "legacy/template"}};
+    for (int v = 0; v < 2; v++) {
+        const uint32_t len = (uint32_t) frameLength(replyVersions[v]);
+        initOutQueue(&session.outQueue);
+        start = nowNs();
+        for (long r = 0; r < rounds; r++) {
+            for (int i = 0; i < serverTurnsSize; i++) {
+                board = serverTurns[i];
+                uint8_t zeroed[BUFFER_SIZE] = {0};
+                buildMoveFrame(zeroed, replyVersions[v], (uint8_t) (__builtin_ctz(~(board.x | board.o)) + 1),
+                               1, (uint8_t) i, &board, SERVER_MARK);
+                memcpy(session.bufferSend, zeroed, len);
+                sink += queueBytes(&session.outQueue, session.bufferSend, len);
+                session.outQueue.head = session.outQueue.tail;
+            }
+        }
+        report("replyFrame", replyNames[v][0], serverTurnsSize, rounds * serverTurnsSize, nowNs() - start);
+
+        start = nowNs();
+        for (long r = 0; r < rounds; r++) {
+            for (int i = 0; i < serverTurnsSize; i++) {
+                board = serverTurns[i];
+                buildMoveFrame(session.bufferSend, replyVersions[v],
+                               (uint8_t) (__builtin_ctz(~(board.x | board.o)) + 1), 1, (uint8_t) i, &board, SERVER_MARK);
+                sink += queueBytes(&session.outQueue, session.bufferSend, len);
+                session.outQueue.head = session.outQueue.tail;
+            }
+        }
+        report("replyFrame", replyNames[v][1], serverTurnsSize, rounds * serverTurnsSize, nowNs() - start);
+    }
+
+    int nullSink = open("/dev/null", O_WRONLY);
+    if (nullSink < 0) {
+        perror("open /dev/null");
+        exit(1);
+    }
+    const uint8_t versions[2] = {VERSION_COMPACT, VERSION};
+    const char *versionNames[2] = {"compact", "legacy"};
+    for (int v = 0; v < 2; v++) {
+        start = nowNs();
+        for (long r = 0; r < rounds; r++) {
+            for (int i = 0; i < serverTurnsSize; i++) {
+                board = serverTurns[i];
+                sink += sendMoveWithChoice(
+                        nullSink, versions[v], (uint8_t) (__builtin_ctz(~(board.x | board.o)) + 1),
+                        1, (uint8_t) i, &board, SERVER_MARK);
+            }
+        }
+        report("sendMoveWithChoice", versionNames[v], serverTurnsSize, rounds * serverTurnsSize, nowNs() - start);
+    }
+    close(nullSink);
+
+    // what readBoard does per frame before processBuffer's checks: bytes
+    // into the receive ring, the frame out, then the header fields
+    // processBuffer validates
+    static struct recv_ring ring;
+    initRecvRing(&ring);
+    for (int v = 0; v < 2; v++) {
+        uint8_t frame[BUFFER_SIZE] = {versions[v], 5, GAME_ON, 0, MOVE, 1, 0};
+        uint8_t buffer[BUFFER_SIZE];
+        const int len = frameLength(versions[v]);
+        start = nowNs();
+        for (long r = 0; r < rounds * corpusSize; r++) {
+            frame[6] = (uint8_t) r;
+            pushRecvRing(&ring, frame, (uint32_t) len);
+            if (nextFrame(&ring, buffer) == 0) return 1;
+            sink += isVersionValid(buffer[0]) + (buffer[4] <= END_GAME) + (buffer[2] <= GAME_ERROR)
+                    + buffer[6] + isMoveValid(&corpus[r % corpusSize], buffer[1]);
+        }
+        report("frameDecode", versionNames[v], 0, rounds * corpusSize, nowNs() - start);
+    }
+    return sink == -1;
+}
@@ -0,0 +1,184 @@
+#include "tictactoe.h"
+
+
+/*
+ * Micro-benchmark of checkWin (one outcomeTable load) against the
+ * 8-line mask scan it replaced, over every legal position, and of the
+ * larger variants' incremental outcome against a scan of the whole board
+ * after every move, over random games.
+ */
+
+
+#define DEFAULT_ROUNDS 2000
+#define WIDE_GAMES 2000
+
+
+static const uint16_t WIN_LINES[8] = {
+        0x007, 0x038, 0x1c0,  // rows
+        0x049, 0x092, 0x124,  // columns
+        0x111, 0x054};  // diagonals
+
+
+// the mask scan checkWin did before outcomeTable
+int checkWinLines(const struct bitboard *board, char mark) {
+    const uint16_t mine = (mark == CLIENT_MARK) ? board->x : board->o;
+    const uint16_t theirs = (mark == CLIENT_MARK) ? board->o : board->x;
+
+    for (int i = 0; i < 8; i++) {
+        if ((mine & WIN_LINES[i]) == WIN_LINES[i]) return WIN;
+        if ((theirs & WIN_LINES[i]) == WIN_LINES[i]) return LOSE;
+    }
+    if (__builtin_popcount(board->x | board->o) == ROWS * COLUMNS) return DRAW;
+    return GAME_ON;
+}
+
+
+// the scan of every row, column and diagonal the larger variants did after each move
+int checkWideWinScan(const struct wideboard *board, char mark, int n, int k) {
+    static const int dRow[4] = {0, 1, 1, 1};
+    static const int dColumn[4] = {1, 0, 1, -1};
+    const uint64_t *players[2] = {board->x, board->o};
+    for (int p = 0; p < 2; p++) {
+        for (int square = 0; square < n * n; square++) {
+            for (int d = 0; d < 4; d++) {
+                const int row = square / n, column = square % n;
+                const int lastRow = row + dRow[d] * (k - 1), lastColumn = column + dColumn[d] * (k - 1);
+                if (lastRow >= n || lastColumn < 0 || lastColumn >= n) continue;
+                int i = 0;
+                while (i < k) {
+                    int s = (row + dRow[d] * i) * n + column + dColumn[d] * i;
+                    if (((players[p][s >> 6] >> (s & 63)) & 1) == 0) break;
+                    i++;
+                }
+                if (i == k) return ((p == 0) == (mark == CLIENT_MARK)) ? WIN : LOSE;
+            }
+        }
+    }
+    int taken = 0;
+    for (int w = 0; w < WIDE_WORDS; w++) taken += __builtin_popcountll(board->x[w] | board->o[w]);
+    return (taken == n * n) ? DRAW : GAME_ON;
+}
+
+
+/*
+ * WIDE_GAMES random orders of the squares of a variant, one after the other
+ */
+uint8_t *randomGames(const struct variant *variant) {
+    uint8_t *games = malloc((size_t) WIDE_GAMES * variant->squares);
+    uint32_t x = 2463534242u;
+    for (int g = 0; g < WIDE_GAMES; g++) {
+        uint8_t *squares = games + (size_t) g * variant->squares;
+        for (int i = 0; i < variant->squares; i++) squares[i] = (uint8_t) (i + 1);
+        for (int i = variant->squares - 1; i > 0; i--) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            int j = (int) (x % (uint32_t) (i + 1));
+            uint8_t t = squares[i];
+            squares[i] = squares[j];
+            squares[j] = t;
+        }
+    }
+    return games;
+}
+
+
+double nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+int main(int argc, char *argv[]) {
+    long rounds = (argc > 1) ? strtol(argv[1], NULL, 10) : DEFAULT_ROUNDS;
+    if (rounds <= 0) {
+        printf("usage: ./benchOutcome [rounds]\n");
+        exit(1);
+    }
+
+    static struct bitboard corpus[POSITIONS];
+    int n = 0;
+    for (uint16_t x = 0; x <= FULL_BOARD; x++) {
+        for (uint16_t o = 0; o <= FULL_BOARD; o++) {
+            struct bitboard board = {x, o};
+            if (isPositionLegal(&board)) corpus[n++] = board;
+        }
+    }
+
+    // both implementations must agree before timing them
+    for (int i = 0; i < n; i++) {
+        if (checkWin(&corpus[i], CLIENT_MARK) != checkWinLines(&corpus[i], CLIENT_MARK)) {
+            printf("checkWin mismatch at x=%#x o=%#x\n", corpus[i].x, corpus[i].o);
+            return 1;
+        }
+    }
+
+    volatile int sink = 0;
+    double start = nowNs();
+    for (long r = 0; r < rounds; r++)
+        for (int i = 0; i < n; i++) sink += checkWinLines(&corpus[i], (i & 1) ? SERVER_MARK : CLIENT_MARK);
+    double lines = (nowNs() - start) / ((double) rounds * n);
+
+    start = nowNs();
+    for (long r = 0; r < rounds; r++)
+        for (int i = 0; i < n; i++) sink += checkWin(&corpus[i], (i & 1) ? SERVER_MARK : CLIENT_MARK);
+    double table = (nowNs() - start) / ((double) rounds * n);
+
+    printf("bench=checkWin impl=lines positions=%d ns_per_op=%.2f\n", n, lines);
+    printf("bench=checkWin impl=table positions=%d ns_per_op=%.2f\n", n, table);
+
+    // a move and its outcome, by placing the mark then scanning the whole
+    // board, or by the variant's placeMark and checkWideWin. Each random
+    // order of the squares is played until the scan says the game is over.
+    static int lengths[WIDE_GAMES], results[WIDE_GAMES];
+    for (int v = VARIANT_CLASSIC + 1; v < VARIANT_COUNT; v++) {
+        const struct variant *variant = &variants[v];
+        uint8_t *games = randomGames(variant);
+        struct wideboard board;
+        long played = 0;
+
+        start = nowNs();
+        for (int g = 0; g < WIDE_GAMES; g++) {
+            const uint8_t *squares = games + (size_t) g * variant->squares;
+            initWideBoard(&board);
+            int i = 0, result = GAME_ON;
+            while (result == GAME_ON) {
+                char mark = (i & 1) ? SERVER_MARK : CLIENT_MARK;
+                int square = squares[i++] - 1;
+                uint64_t *bits = (mark == CLIENT_MARK) ? board.x : board.o;
+                bits[square >> 6] |= (uint64_t) 1 << (square & 63);
+                result = checkWideWinScan(&board, mark, variant->size, variant->lineLength);
+            }
+            lengths[g] = i;
+            results[g] = result;
+            played += i;
+        }
+        double scan = nowNs() - start;
+
+        start = nowNs();
+        for (int g = 0; g < WIDE_GAMES; g++) {
+            const uint8_t *squares = games + (size_t) g * variant->squares;
+            initWideBoard(&board);
+            int result = GAME_ON;
+            for (int i = 0; i < lengths[g]; i++) {
+                char mark = (i & 1) ? SERVER_MARK : CLIENT_MARK;
+                variant->placeMark(&board, squares[i], mark);
+                result = checkWideWin(&board, mark);
+            }
+            // both must decide the game the same way
+            if (result != results[g]) {
+                printf("checkWideWin mismatch in %s game %d\n", variant->name, g);
+                return 1;
+            }
+        }
+        double incremental = nowNs() - start;
+
+        printf("bench=wideMove variant=%s impl=scan moves=%ld ns_per_op=%.2f\n",
+               variant->name, played, scan / played);
+        printf("bench=wideMove variant=%s impl=incremental moves=%ld ns_per_op=%.2f\n",
+               variant->name, played, incremental / played);
+        free(games);
+    }
+    return sink == -1;
+}
@@ -0,0 +1,127 @@
+#include <netinet/tcp.h>
+#include <sys/wait.h>
+
+#include "tictactoe.h"
+
+
+// a full game: NEW_GAME, four moves each and END_GAME, every frame answered
+#define ROUND_TRIPS_PER_GAME 5
+#define DEFAULT_GAMES 20000
+
+
+/*
+ * read exactly len bytes, return 1 if succeed, else 0
+ */
+int readFull(int sd, uint8_t *buffer, int len) {
+    int got = 0;
+    while (got < len) {
+        int rc = (int) read(sd, buffer + got, len - got);
+        if (rc <= 0) return 0;
+        got += rc;
+    }
+    return 1;
+}
+
+
+/*
+ * the peer answers every frame with a frame of the same version
+ */
+void runPeer(int sd) {
+    uint8_t buffer[BUFFER_SIZE] = {0};
+    for (;;) {
+        if (readFull(sd, buffer, COMPACT_FRAME_SIZE) == 0) return;
+        int len = frameLength(buffer[0]);
+        if (len > COMPACT_FRAME_SIZE
+            && readFull(sd, buffer + COMPACT_FRAME_SIZE, len - COMPACT_FRAME_SIZE) == 0) return;
+        if (write(sd, buffer, len) != len) return;
+    }
+}
+
+
+/*
+ * play games over a loopback connection in the given version,
+ * return the elapsed seconds
+ */
+double playGames(int sd, uint8_t version, long games) {
+    uint8_t sb[BUFFER_SIZE] = {version, 0, GAME_ON, 0, MOVE, 0, 0};
+    uint8_t rb[BUFFER_SIZE];
+    int len = frameLength(version);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long g = 0; g < games; g++) {
+        for (int k = 0; k < ROUND_TRIPS_PER_GAME; k++) {
+            sb[6] = (uint8_t) (2 * k);
+            if (write(sd, sb, len) != len || readFull(sd, rb, len) == 0) {
+                perror("Loopback exchange failed");
+                exit(1);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double) (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+
+int main(int argc, char *argv[]) {
+    long games = (argc > 1) ? strtol(argv[1], NULL, 10) : DEFAULT_GAMES;
+    if (games <= 0) {
+        printf("usage: ./benchWire [games]\n");
+        exit(1);
+    }
+
+    int sd_listen = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    socklen_t addressLength = sizeof(address);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    if (sd_listen < 0
+        || bind(sd_listen, (struct sockaddr *) &address, sizeof(address)) < 0
+        || listen(sd_listen, 1) < 0
+        || getsockname(sd_listen, (struct sockaddr *) &address, &addressLength) < 0) {
+        perror("Failed to open loopback listener");
+        exit(1);
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        int sd = accept(sd_listen, NULL, NULL);
+        close(sd_listen);
+        runPeer(sd);
+        close(sd);
+        exit(0);
+    }
+
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sd < 0 || connect(sd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        perror("connect error");
+        exit(1);
+    }
+    close(sd_listen);
+    int one = 1;
+    setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    const uint8_t versions[2] = {VERSION, VERSION_COMPACT};
+    double bytesPerGame[2], framesPerSec[2];
+    for (int v = 0; v < 2; v++) {
+        double seconds = playGames(sd, versions[v], games);
+        long frames = games * ROUND_TRIPS_PER_GAME * 2;
+        bytesPerGame[v] = (double) frameLength(versions[v]) * ROUND_TRIPS_PER_GAME * 2;
+        framesPerSec[v] = frames / seconds;
+        printf("bench=wire version=%d frame_bytes=%d games=%ld bytes_per_game=%.0f "
+               "frames_per_sec=%.0f\n",
+               versions[v], frameLength(versions[v]), games, bytesPerGame[v], framesPerSec[v]);
+    }
+    printf("bench=wire bytes_per_game_ratio=%.1f frames_per_sec_ratio=%.2f\n",
+           bytesPerGame[0] / bytesPerGame[1], framesPerSec[1] / framesPerSec[0]);
+
+    close(sd);
+    waitpid(pid, NULL, 0);
+    return 0;
+}
@@ -1,563 +1,762 @@
-#include "tictactoe.h"
-
-
-#define LOOP_CONTINUE 1
-#define LOOP_BREAK 0
-
-#define FILE_ROWS 10
-#define FILE_LINE_LENGTH 100
-
-
-static uint8_t bufferRecv[BUFFER_SIZE];
-// static uint8_t bufferSend[BUFFER_SIZE];
-
-char ipAddresses[FILE_ROWS][FILE_LINE_LENGTH];
-uint16_t portNumbers[FILE_ROWS];
-
-
-int buildGameForClient(int connected_sd, char board[ROWS][COLUMNS]);
-
-
-/*
- * use scanf to get a move from client
- */
-uint8_t clientMakeChoice(char board[ROWS][COLUMNS]) {
-    uint8_t choice = 1;
-    int valid = 0;
-
-    while (valid == 0) {
-        printf("Enter a number:  ");
-
-        char tmp;
-        scanf("%s", &tmp);
-        choice = (uint8_t) strtol(&tmp, NULL, 10);
-
-        int row = (choice-1) / ROWS;
-        int column = (choice-1) % COLUMNS;
-        valid = isMoveValid(board, row, column, choice);
-    }
-    return choice;
-}
-
-/*
- * return 1 if receive successfully; return 0 otherwise
- */
-int recvBuffer(int sd) {
-    memset(bufferRecv, 0, BUFFER_SIZE);
-    int rc = read(sd, bufferRecv, BUFFER_SIZE);
-    if (rc == 0) {
-        printf("Server is disconnected.\n");
-        return 0;
-    } else if (rc < 0) {
-        perror("Fail to read");
-        return 0;
-    } else if (rc < BUFFER_SIZE) {
-        printf("Received only %d bytes. (should have received %d bytes)\n", rc, BUFFER_SIZE);
-        return 0;
-    }
-    return 1;
-}
-
-
-/*
- *  return LOOP_CONTINUE or LOOP_BREAK
- */
-int receiveMoveClient(int connected_sd, int sendSequenceNum, char board[ROWS][COLUMNS]) {
-    const uint8_t recvStatus = bufferRecv[2];
-    const uint8_t statusModifier = bufferRecv[3];
-    const uint8_t gameId = bufferRecv[5];
-    if (recvStatus < 0 || recvStatus > 2) {
-        printf("Received invalid game status: %d.\n", recvStatus);
-        respondToInvalidRequest(connected_sd, sendSequenceNum, gameId);
-        return LOOP_BREAK;
-    }
-    if (recvStatus == GAME_ERROR) {
-        parseGeneralError(statusModifier);
-        return LOOP_BREAK;
-    }
-
-    // when recvStatus == GAME_ON or GAME_COMPLETE
-
-    // check if move is valid
-    uint8_t choice = bufferRecv[1];
-
-    int row = (choice-1) / ROWS;
-    int column = (choice-1) % COLUMNS;
-
-    if (isMoveValid(board, row, column, choice) == 0) {
-        printf("The opponent made an invalid move: %d.\n", choice);
-        respondToInvalidRequest(connected_sd, sendSequenceNum, gameId);
-        return LOOP_BREAK;
-    }
-
-    // move is valid, update board
-    board[row][column] = SERVER_MARK;
-    printBoard(board, CLIENT_MARK);
-
-    // check local game finished
-    int result = checkWin(board, SERVER_MARK);
-
-    if (recvStatus == GAME_ON) {
-        if (result == GAME_ON) {
-            uint8_t newChoice = clientMakeChoice(board);
-            sendMoveWithChoice(
-                    connected_sd, newChoice, gameId,
-                    (uint8_t) sendSequenceNum, board, CLIENT_MARK);
-            return LOOP_CONTINUE;
-        }
-        printf("Received invalid game status: %d, expected: %d.\n", recvStatus, GAME_ON);
-        respondToInvalidRequest(connected_sd, sendSequenceNum, gameId);
-        return LOOP_BREAK;
-    }
-    // when recvStatus == GAME_COMPLETE
-    // check if local game and remote game has the same result
-    if (result != statusModifier) {
-        printf("Received invalid status modifier: %d. Expected: %d\n", statusModifier, result);
-        respondToInvalidRequest(connected_sd, sendSequenceNum, gameId);
-        return LOOP_BREAK;
-    }
-    uint8_t sm;
-    if (result == WIN) {
-        printf("You lose.\n");
-        sm = LOSE;
-    } else {
-        printf("Draw.\n");
-        sm = DRAW;
-    }
-    uint8_t sb[BUFFER_SIZE] = {
-            VERSION, 0, GAME_COMPLETE, sm, END_GAME, gameId,
-            (uint8_t) sendSequenceNum};
-    sendBuffer(connected_sd, sb);
-    return LOOP_BREAK;
-}
-
-
-/*
- * Function: processBufferClient
- * -----------------------------
- *   Receive a move from the other node
- *
- *   connected_sd: socket file descriptor
- *
- *   resendCountPtr:
- *
- *   gameId:
- *
- *   sequenceNumPtr: points to the address
- *   of the last sent sequence number
- *
- *   board[ROWS][COLUMNS]: the board for the game
- *
- *   return LOOP_CONTINUE or LOOP_BREAK
- */
-int processBufferClient(
-        int connected_sd,
-        // int *resendCountPtr,
-        uint8_t gameId,
-        uint8_t *sequenceNumPtr,
-        char board[ROWS][COLUMNS]) {
-
-    printf("RECEIVE choice: %d status: %d statusModifier: %d "
-           "gameType: %d gameId: %d sequenceNum: %d\n",
-           bufferRecv[1], bufferRecv[2], bufferRecv[3],
-           bufferRecv[4], bufferRecv[5], bufferRecv[6]);
-
-    const int recvSequenceNum = bufferRecv[6];
-    const int expectedRecvSeqNum = (*sequenceNumPtr + 1) % 256;
-    const int sendSequenceNum = (expectedRecvSeqNum + 1) % 256;
-
-    uint8_t version = bufferRecv[0];
-    if (version != VERSION) {
-        printf("Received invalid version number: %d.\n", version);
-        respondToInvalidRequest(connected_sd, sendSequenceNum, gameId);
-        return LOOP_BREAK;
-    }
-
-    // #receivedBytes and #version are correct and no timeout
-    const uint8_t gameType = bufferRecv[4];
-    if (gameType < 1 || gameType > 2) {
-        printf("Received invalid game type: %d.\n", gameType);
-        respondToInvalidRequest(connected_sd, sendSequenceNum, gameId);
-        return LOOP_BREAK;
-    }
-
-    // Below are the cases when gameType == END_GAME, MOVE
-    // need to check gameId and seqNum
-    if (gameId != bufferRecv[5]) {
-        printf("Received invalid game id: %d expected: %d.\n", bufferRecv[5], gameId);
-        respondToInvalidRequest(connected_sd, sendSequenceNum, gameId);
-        return LOOP_BREAK;
-    }
-    // gameId is correct, check sequenceNum
-    if (recvSequenceNum < expectedRecvSeqNum) {
-        // receiving a duplicate packet means that the other
-        // side might not have received my last msg, so do a resend
-        // and skip the next move input
-//        if (*resendCountPtr < MAX_TRY) {
-//            printf("Received a duplicate packet, resend last msg.\n");
-//            *resendCountPtr += 1;
-//            sendBuffer(connected_sd, bufferSend);
-//            return LOOP_CONTINUE;
-//        }
-        printf("Received a duplicate packet, run out of resend chances, exit game.\n");
-        return LOOP_BREAK;
-    }
-    if (recvSequenceNum > expectedRecvSeqNum) {
-        printf("Packets arrived out of order. Received sequence number: %d, expected: %d.\n",
-               recvSequenceNum, expectedRecvSeqNum);
-        respondToInvalidRequest(connected_sd, sendSequenceNum, gameId);
-        return LOOP_BREAK;
-    }
-    // when gameId, seqNum are all correct,
-    // gameType can be END_GAME or MOVE
-    // update sequenceNumPtr
-    *sequenceNumPtr = (uint8_t) sendSequenceNum;
-
-    if (gameType == END_GAME) {
-        int result = checkWin(board, SERVER_MARK);
-        if (result == GAME_ON || result == WIN) {
-            printf("Invalid END GAME command.\n");
-            respondToInvalidRequest(connected_sd, sendSequenceNum, gameId);
-            return LOOP_BREAK;
-        }
-        if (result == DRAW) printf("Draw.\n");
-        else printf("You win!\n");
-        return LOOP_BREAK;
-    }
-    // when gameType == MOVE
-    return receiveMoveClient(connected_sd, sendSequenceNum, board);
-}
-
-
-/*
- * return -1 if there's an error, otherwise return gameId (should be a non-negative integer)
- */
-int buildGameForClient(int connected_sd, char board[ROWS][COLUMNS]) {
-    // send new game request
-    uint8_t sb[BUFFER_SIZE] = {VERSION, 0, GAME_ON, 0, NEW_GAME, 0, 0};
-    sendBuffer(connected_sd, sb);
-
-    // receive response
-    int recvResult = recvBuffer(connected_sd);
-
-    printf("RECEIVE choice: %d status: %d statusModifier: %d "
-           "gameType: %d gameId: %d sequenceNum: %d\n",
-           bufferRecv[1], bufferRecv[2], bufferRecv[3],
-           bufferRecv[4], bufferRecv[5], bufferRecv[6]);
-
-    if (recvResult == 1) {
-        uint8_t recvSequenceNum = bufferRecv[6];
-
-        // check sequence number
-        if (recvSequenceNum < 1) {
-            // receiving a duplicate packet
-            printf("Received a duplicate packet.\n");
-            return -1;
-        }
-        if (recvSequenceNum > 1) {
-            printf("Packets arrived out of order. Received sequence number: %d"
-                   ", expected: %d.\n", recvSequenceNum, 1);
-            return -1;
-        }
-        uint8_t recvStatus = bufferRecv[2];
-        uint8_t statusModifier = bufferRecv[3];
-        if (recvStatus == GAME_ERROR) {
-            parseGeneralError(statusModifier);
-        } else {
-            // client send 1st move
-            printBoard(board, CLIENT_MARK);
-            uint8_t choice = clientMakeChoice(board);
-            int sendMoveResult = sendMoveWithChoice(
-                    connected_sd,
-                    choice,
-                    bufferRecv[5],
-                    2,
-                    board,
-                    CLIENT_MARK);
-            if (sendMoveResult == GAME_ON) return bufferRecv[5];
-        }
-    }
-    printf("Cannot build Game with server.\n");
-    return -1;
-}
-
-
-/*
- * sd_dgram:
- *
- * multicast_address: address of the multicast group
- *
- * return -1 if failed, otherwise return the sd_stream of a newly connected stream socket (should be non-negative)
- */
-int multicast(int sd_dgram, struct sockaddr_in multicast_address) {
-    printf("MULTICASTING\n");
-    // send
-    uint8_t bufferSend[BUFFER_SIZE];
-    memset(bufferSend, 0, sizeof(bufferSend));
-    bufferSend[0] = VERSION;
-    bufferSend[1] = 1;
-
-    int cnt = sendto(sd_dgram, bufferSend, sizeof(bufferSend), 0,
-            (struct sockaddr *) &multicast_address, sizeof(multicast_address));
-    if (cnt < 0) {
-        perror("sendto");
-        close(sd_dgram);
-        return -1;
-    }
-
-    printf("SEND multicast: %d status: %d statusModifier: %d "
-           "gameType: %d gameId: %d sequenceNum: %d\n",
-           bufferSend[1], bufferSend[2], bufferSend[3],
-           bufferSend[4], bufferSend[5], bufferSend[6]);
-
-    // receive
-    fd_set socketFDS;
-    int maxSD = sd_dgram;
-    struct timeval timeout;
-
-    FD_ZERO(&socketFDS);
-    FD_SET(sd_dgram, &socketFDS);
-
-    timeout.tv_sec = TIME_LIMIT_SERVER;
-    timeout.tv_usec = 0;
-
-    // block until something arrives
-    int selectResult = select(maxSD+1, &socketFDS, NULL, NULL, &timeout);
-
-    if (selectResult < 0) {
-        perror("Failed to select");
-        return -1;
-    }
-    if (selectResult == 0) {
-        printf("No message in the past %d seconds.\n", TIME_LIMIT_SERVER);
-        return -1;
-    }
-
-    if (FD_ISSET(sd_dgram, &socketFDS)) {
-        struct sockaddr_in addr;
-        socklen_t addrLen = sizeof(addr);
-        cnt = recvfrom(sd_dgram, bufferRecv, sizeof(bufferRecv), 0, (struct sockaddr *) &addr, &addrLen);
-        if (cnt < 0) {
-            perror("Fail to read");
-            return -1;
-        } else if (cnt < BUFFER_SIZE) {
-            printf("Received only %d bytes. (should have received %d bytes)\n", cnt, BUFFER_SIZE);
-            return -1;
-        }
-
-        printf("RECEIVE multicast: %d status: %d statusModifier: %d "
-               "gameType: %d gameId: %d sequenceNum: %d\n",
-               bufferRecv[1], bufferRecv[2], bufferRecv[3],
-               bufferRecv[4], bufferRecv[5], bufferRecv[6]);
-
-        // check version
-        if (bufferRecv[0] != VERSION) {
-            printf("Received invalid multicast version number: %d, expected: %d.\n", bufferRecv[0], VERSION);
-            return -1;
-        }
-
-        // check command
-        if (bufferRecv[1] != 2) {
-            printf("Received invalid multicast command: %d, expected: %d.\n", bufferRecv[1], 2);
-            return -1;
-        }
-
-        // get port number
-        uint8_t port_array[2] = {bufferRecv[2], bufferRecv[3]};
-        uint16_t serverPortNumber = u8_to_u16(port_array);
-
-        // connect
-        // start stream socket
-        int sd_stream = socket(AF_INET, SOCK_STREAM, 0);
-        if(sd_stream < 0) {
-            perror("Opening stream socket error");
-            return -1;
-        }
-
-        struct sockaddr_in server_address;
-        server_address.sin_family = AF_INET;
-        server_address.sin_port = serverPortNumber;
-        server_address.sin_addr = addr.sin_addr;
-
-        if (connect(sd_stream, (struct sockaddr *) &server_address, sizeof(struct sockaddr_in)) < 0) {
-            close(sd_stream);
-            perror("connect error");
-            return -1;
-        }
-        return sd_stream;
-    }
-    return -1;
-}
-
-
-/*
- * return gameId if success, otherwise return -1
- */
-int reconnect(int connected_sd, char board[ROWS][COLUMNS]) {
-    printf("RECONNECTING\n");
-
-    // send
-    uint8_t bufferSend[BUFFER_SIZE];
-    memset(bufferSend, 0, sizeof(bufferSend));
-    bufferSend[0] = VERSION;
-    bufferSend[4] = RECONNECT;
-
-    int boardIdx = 7;
-
-    for (int i=0; i<ROWS; i++) {
-        for (int j=0; j<COLUMNS; j++) {
-            if (board[i][j] == SERVER_MARK)
-                bufferSend[boardIdx] = 2;
-            else if (board[i][j] == CLIENT_MARK)
-                bufferSend[boardIdx] = 1;
-            else
-                bufferSend[boardIdx] = 0;
-            boardIdx++;
-        }
-    }
-
-    sendBuffer(connected_sd, bufferSend);
-
-    // receive
-    int recvResult = recvBuffer(connected_sd);
-    if (recvResult == 0) {
-        return -1;
-    }
-
-    printf("RECEIVE reconnect: %d status: %d statusModifier: %d "
-               "gameType: %d gameId: %d sequenceNum: %d\n",
-               bufferRecv[1], bufferRecv[2], bufferRecv[3],
-               bufferRecv[4], bufferRecv[5], bufferRecv[6]);
-
-    // Server responds with the game number in addition to their move,
-    // or with a reconnect error if they became full.
-    int recvMoveResult = receiveMoveClient(connected_sd, 0, board);
-    if (recvMoveResult == LOOP_BREAK) {
-        close(connected_sd);
-        return -1;
-    }
-    return bufferRecv[5];
-}
-
-
-/*
- * return sd_stream if succeed, otherwise return -1
- */
-int connectToServer() {
-    printf("Accessing config file.\n");
-    for (int i=0; i<FILE_ROWS; i++) {
-        int sd_stream = socket(AF_INET, SOCK_STREAM, 0);
-        struct sockaddr_in server_address;
-
-        if(sd_stream < 0) {
-            perror("Opening stream socket error");
-            continue;
-        }
-
-        server_address.sin_family = AF_INET;
-        server_address.sin_port = portNumbers[i];
-        server_address.sin_addr.s_addr = inet_addr(ipAddresses[i]);
-
-        if (connect(sd_stream, (struct sockaddr *) &server_address, sizeof(struct sockaddr_in)) < 0) {
-            close(sd_stream);
-            perror("connect error");
-            continue;
-        }
-        return sd_stream;
-    }
-    return -1;
-}
-
-
-void playClient(
-        int connected_sd,
-        int sd_dgram,
-        struct sockaddr_in multicast_address) {
-
-    FILE * fp;
-    char *line = NULL;
-    size_t len = 0;
-
-    fp = fopen("ip_addresses", "r");
-    if (fp == NULL)
-        exit(EXIT_FAILURE);
-
-    int i = 0;
-    while (getline(&line, &len, fp) != -1) {
-        if (i >= FILE_ROWS) {
-            printf("WARNING: Input file too long.\n");
-            break;
-        }
-
-        strcpy(ipAddresses[i], line);
-
-        char portStr[FILE_LINE_LENGTH];
-        int k = 0;
-
-        int ipLength = FILE_LINE_LENGTH;
-        for (int j=0; j<FILE_LINE_LENGTH; j++) {
-            if (ipAddresses[i][j] == ' ') {
-                ipLength = j;
-                continue;
-            }
-
-            if (j > ipLength) {  // port number
-                portStr[k] = ipAddresses[i][j];
-                k++;
-            }
-        }
-
-        portNumbers[i] = htons(strtol(portStr, NULL, 10));
-
-        ipAddresses[i][ipLength] = 0;
-
-        i++;
-    }
-
-    fclose(fp);
-
-    char board[ROWS][COLUMNS];
-    initBoard(board);
-
-    uint8_t gameId, sequenceNum;
-
-    gameId = buildGameForClient(connected_sd, board);
-    if (gameId < 0) {
-        connected_sd = multicast(sd_dgram, multicast_address);
-        if (connected_sd < 0) {
-            connected_sd = connectToServer();
-            if (connected_sd < 0) {
-                return;
-            }
-        }
-        gameId = reconnect(connected_sd, board);
-        if (gameId < 0) {
-            return;
-        }
-        sequenceNum = 0;
-    } else {
-        sequenceNum = 2;
-    }
-
-    for (;;) {
-        int recvResult = recvBuffer(connected_sd);
-        if (recvResult == 0) {
-            close(connected_sd);
-            connected_sd = multicast(sd_dgram, multicast_address);
-            if (connected_sd < 0) {
-                connected_sd = connectToServer();
-                if (connected_sd < 0) {
-                    return;
-                }
-            }
-            gameId = reconnect(connected_sd, board);
-            if (gameId < 0) {
-                return;
-            }
-            sequenceNum = 0;
-            continue;
-        }
-        int processResult = processBufferClient(connected_sd, gameId, &sequenceNum, board);
-        if (processResult == LOOP_BREAK) return;
-    }
-}
+#include <poll.h>
+
+#include "tictactoe.h"
+
+
+#define LOOP_CONTINUE 1
+#define LOOP_BREAK 0
+
+#define FILE_ROWS 10
+#define FILE_LINE_LENGTH 100
+// how long to keep collecting multicast answers after the first one
+#define MULTICAST_WINDOW_MS 300
+#define MAX_DISCOVERED 16
+// head start of each ip_addresses entry over the next one
+#define CONNECT_STAGGER_MS 250
+
+
+static uint8_t bufferRecv[BUFFER_SIZE];
+static uint8_t protocolVersion = VERSION_COMPACT;
+static struct recv_ring recvRing;
+// static uint8_t bufferSend[BUFFER_SIZE];
+static uint8_t lastMove[BUFFER_SIZE];  // the last move sent, RESUME repeats it
+static uint8_t sessionToken[TOKEN_SIZE];  // from the latest server frame that had one
+static int hasToken;
+
+char ipAddresses[FILE_ROWS][FILE_LINE_LENGTH];
+uint16_t portNumbers[FILE_ROWS];
+int addressCount;  // entries parsed from ip_addresses
+
+
+int buildGameForClient(int connected_sd, struct bitboard *board);
+
+
+/*
+ * use scanf to get a move from client
+ */
+uint8_t clientMakeChoice(struct bitboard *board) {
+    uint8_t choice = 1;
+    int valid = 0;
+
+    while (valid == 0) {
+        printf("Enter a number:  ");
+
+        char tmp[16];
+        if (scanf("%15s", tmp) != 1) exit(EXIT_FAILURE);
+        choice = (uint8_t) strtol(tmp, NULL, 10);
+
+        valid = isMoveValid(board, choice);
+    }
+    return choice;
+}
+
+/*
+ * take the next frame into bufferRecv, reading from sd only
+ * when the receive ring holds no complete frame
+ *
+ * return 1 if receive successfully; return 0 otherwise
+ */
+int recvBuffer(int sd) {
+    memset(bufferRecv, 0, BUFFER_SIZE);
+    while (nextFrame(&recvRing, bufferRecv) == 0) {
+        int rc = fillRecvRing(sd, &recvRing);
+        if (rc == 0) {
+            printf("Server is disconnected.\n");
+            return 0;
+        } else if (rc < 0) {
+            perror("Fail to read");
+            return 0;
+        }
+    }
+    // a token has a non-zero secret
+    if (bufferRecv[TOKEN_OFFSET + 4] | bufferRecv[TOKEN_OFFSET + 5]
+        | bufferRecv[TOKEN_OFFSET + 6] | bufferRecv[TOKEN_OFFSET + 7]) {
+        memcpy(sessionToken, bufferRecv + TOKEN_OFFSET, TOKEN_SIZE);
+        hasToken = 1;
+    }
+    return 1;
+}
+
+
+/*
+ * take the answer to the first frame of a connection into bufferRecv,
+ * after the GAME_QUEUED a full server may send before it
+ *
+ * return 1 if receive successfully; return 0 otherwise
+ */
+int recvAnswer(int sd) {
+    int recvResult = recvBuffer(sd);
+    while (recvResult == 1 && bufferRecv[2] == GAME_QUEUED) {
+        printf("Waiting for a board, position %d in the queue.\n", ntohs(u8_to_u16(bufferRecv + 5)));
+        recvResult = recvBuffer(sd);
+    }
+    return recvResult;
+}
+
+
+/*
+ * send a move and keep its frame for RESUME
+ *
+ * return GAME_ON, or GAME_ERROR if it could not be sent
+ */
+int sendClientMove(int connected_sd, uint8_t choice, uint8_t gameId, uint8_t sequenceNum, struct bitboard *board) {
+    buildMoveFrame(lastMove, protocolVersion, choice, gameId, sequenceNum, board, CLIENT_MARK);
+    if (sendBuffer(connected_sd, lastMove) == 0) return GAME_ERROR;
+    return GAME_ON;
+}
+
+
+/*
+ *  return LOOP_CONTINUE or LOOP_BREAK
+ */
+int receiveMoveClient(int connected_sd, int sendSequenceNum, struct bitboard *board) {
+    const uint8_t recvStatus = bufferRecv[2];
+    const uint8_t statusModifier = bufferRecv[3];
+    const uint8_t gameId = bufferRecv[5];
+    if (recvStatus < 0 || recvStatus > 2) {
+        printf("Received invalid game status: %d.\n", recvStatus);
+        respondToInvalidRequest(connected_sd, protocolVersion, sendSequenceNum, gameId);
+        return LOOP_BREAK;
+    }
+    if (recvStatus == GAME_ERROR) {
+        parseGeneralError(statusModifier);
+        return LOOP_BREAK;
+    }
+
+    // when recvStatus == GAME_ON or GAME_COMPLETE
+
+    // check if move is valid
+    uint8_t choice = bufferRecv[1];
+
+    if (isMoveValid(board, choice) == 0) {
+        printf("The opponent made an invalid move: %d.\n", choice);
+        respondToInvalidRequest(connected_sd, protocolVersion, sendSequenceNum, gameId);
+        return LOOP_BREAK;
+    }
+
+    // move is valid, update board
+    placeMark(board, choice, SERVER_MARK);
+    printBoard(board, CLIENT_MARK);
+
+    // check local game finished
+    int result = checkWin(board, SERVER_MARK);
+
+    if (recvStatus == GAME_ON) {
+        if (result == GAME_ON) {
+            uint8_t newChoice = clientMakeChoice(board);
+            sendClientMove(connected_sd, newChoice, gameId, (uint8_t) sendSequenceNum, board);
+            return LOOP_CONTINUE;
+        }
+        printf("Received invalid game status: %d, expected: %d.\n", recvStatus, GAME_ON);
+        respondToInvalidRequest(connected_sd, protocolVersion, sendSequenceNum, gameId);
+        return LOOP_BREAK;
+    }
+    // when recvStatus == GAME_COMPLETE
+    // check if local game and remote game has the same result
+    if (result != statusModifier) {
+        printf("Received invalid status modifier: %d. Expected: %d\n", statusModifier, result);
+        respondToInvalidRequest(connected_sd, protocolVersion, sendSequenceNum, gameId);
+        return LOOP_BREAK;
+    }
+    uint8_t sm;
+    if (result == WIN) {
+        printf("You lose.\n");
+        sm = LOSE;
+    } else {
+        printf("Draw.\n");
+        sm = DRAW;
+    }
+    uint8_t sb[BUFFER_SIZE] = {
+            protocolVersion, 0, GAME_COMPLETE, sm, END_GAME, gameId,
+            (uint8_t) sendSequenceNum};
+    sendBuffer(connected_sd, sb);
+    return LOOP_BREAK;
+}
+
+
+/*
+ * Function: processBufferClient
+ * -----------------------------
+ *   Receive a move from the other node
+ *
+ *   connected_sd: socket file descriptor
+ *
+ *   resendCountPtr:
+ *
+ *   gameId:
+ *
+ *   sequenceNumPtr: points to the address
+ *   of the last sent sequence number
+ *
+ *   board: the board for the game
+ *
+ *   return LOOP_CONTINUE or LOOP_BREAK
+ */
+int processBufferClient(
+        int connected_sd,
+        // int *resendCountPtr,
+        uint8_t gameId,
+        uint8_t *sequenceNumPtr,
+        struct bitboard *board) {
+
+    printf("RECEIVE choice: %d status: %d statusModifier: %d "
+           "gameType: %d gameId: %d sequenceNum: %d\n",
+           bufferRecv[1], bufferRecv[2], bufferRecv[3],
+           bufferRecv[4], bufferRecv[5], bufferRecv[6]);
+
+    const int recvSequenceNum = bufferRecv[6];
+    const int expectedRecvSeqNum = (*sequenceNumPtr + 1) % 256;
+    const int sendSequenceNum = (expectedRecvSeqNum + 1) % 256;
+
+    uint8_t version = bufferRecv[0];
+    if (version != protocolVersion) {
+        printf("Received invalid version number: %d.\n", version);
+        respondToInvalidRequest(connected_sd, protocolVersion, sendSequenceNum, gameId);
+        return LOOP_BREAK;
+    }
+
+    // #receivedBytes and #version are correct and no timeout
+    const uint8_t gameType = bufferRecv[4];
+    if (gameType < 1 || gameType > 2) {
+        printf("Received invalid game type: %d.\n", gameType);
+        respondToInvalidRequest(connected_sd, protocolVersion, sendSequenceNum, gameId);
+        return LOOP_BREAK;
+    }
+
+    // Below are the cases when gameType == END_GAME, MOVE
+    // need to check gameId and seqNum
+    if (gameId != bufferRecv[5]) {
+        printf("Received invalid game id: %d expected: %d.\n", bufferRecv[5], gameId);
+        respondToInvalidRequest(connected_sd, protocolVersion, sendSequenceNum, gameId);
+        return LOOP_BREAK;
+    }
+    // gameId is correct, check sequenceNum, which may have wrapped around
+    const int order = compareSequence(protocolVersion, (uint32_t) recvSequenceNum, (uint32_t) expectedRecvSeqNum);
+    if (order < 0) {
+        // receiving a duplicate packet means that the other
+        // side might not have received my last msg, so do a resend
+        // and skip the next move input
+//        if (*resendCountPtr < MAX_TRY) {
+//            printf("Received a duplicate packet, resend last msg.\n");
+//            *resendCountPtr += 1;
+//            sendBuffer(connected_sd, bufferSend);
+//            return LOOP_CONTINUE;
+//        }
+        printf("Received a duplicate packet, run out of resend chances, exit game.\n");
+        return LOOP_BREAK;
+    }
+    if (order > 0) {
+        printf("Packets arrived out of order. Received sequence number: %d, expected: %d.\n",
+               recvSequenceNum, expectedRecvSeqNum);
+        respondToInvalidRequest(connected_sd, protocolVersion, sendSequenceNum, gameId);
+        return LOOP_BREAK;
+    }
+    // when gameId, seqNum are all correct,
+    // gameType can be END_GAME or MOVE
+    // update sequenceNumPtr
+    *sequenceNumPtr = (uint8_t) sendSequenceNum;
+
+    if (gameType == END_GAME) {
+        int result = checkWin(board, SERVER_MARK);
+        if (result == GAME_ON || result == WIN) {
+            printf("Invalid END GAME command.\n");
+            respondToInvalidRequest(connected_sd, protocolVersion, sendSequenceNum, gameId);
+            return LOOP_BREAK;
+        }
+        if (result == DRAW) printf("Draw.\n");
+        else printf("You win!\n");
+        return LOOP_BREAK;
+    }
+    // when gameType == MOVE
+    return receiveMoveClient(connected_sd, sendSequenceNum, board);
+}
+
+
+/*
+ * return -1 if there's an error, otherwise return gameId (should be a non-negative integer)
+ */
+int buildGameForClient(int connected_sd, struct bitboard *board) {
+    // send new game request
+    uint8_t sb[BUFFER_SIZE] = {protocolVersion, 0, GAME_ON, 0, NEW_GAME, 0, 0};
+    sendBuffer(connected_sd, sb);
+
+    // receive response, a full server may first have us wait for a board
+    int recvResult = recvAnswer(connected_sd);
+
+    printf("RECEIVE choice: %d status: %d statusModifier: %d "
+           "gameType: %d gameId: %d sequenceNum: %d\n",
+           bufferRecv[1], bufferRecv[2], bufferRecv[3],
+           bufferRecv[4], bufferRecv[5], bufferRecv[6]);
+
+    if (recvResult == 1) {
+        uint8_t recvSequenceNum = bufferRecv[6];
+
+        // check sequence number
+        if (recvSequenceNum < 1) {
+            // receiving a duplicate packet
+            printf("Received a duplicate packet.\n");
+            return -1;
+        }
+        if (recvSequenceNum > 1) {
+            printf("Packets arrived out of order. Received sequence number: %d"
+                   ", expected: %d.\n", recvSequenceNum, 1);
+            return -1;
+        }
+        uint8_t recvStatus = bufferRecv[2];
+        uint8_t statusModifier = bufferRecv[3];
+        if (recvStatus == GAME_ERROR) {
+            parseGeneralError(statusModifier);
+        } else {
+            // client send 1st move
+            printBoard(board, CLIENT_MARK);
+            uint8_t choice = clientMakeChoice(board);
+            int sendMoveResult = sendClientMove(connected_sd, choice, bufferRecv[5], 2, board);
+            if (sendMoveResult == GAME_ON) return bufferRecv[5];
+        }
+    }
+    printf("Cannot build Game with server.\n");
+    return -1;
+}
+
+
+/*
+ * a server that answered a multicast query
+ */
+struct discovered_server {
+    struct sockaddr_in address;
+    uint16_t load;  // permille of its boards in use
+    uint16_t tieBreak;
+};
+
+
+/*
+ * order servers by load, randomly among equal loads so that clients
+ * hearing the same answers don't all pick the same server
+ */
+int compareServers(const void *a, const void *b) {
+    const struct discovered_server *x = a, *y = b;
+    if (x->load != y->load) return (x->load < y->load) ? -1 : 1;
+    return (int) x->tieBreak - (int) y->tieBreak;
+}
+
+
+/*
+ * check a multicast answer and add its server to the list
+ *
+ * return 1 if it was added, else 0
+ */
+int parseDiscovery(
+        int cnt,
+        const struct sockaddr_in *from,
+        struct discovered_server servers[MAX_DISCOVERED],
+        int count) {
+
+    printf("RECEIVE multicast: %d status: %d statusModifier: %d "
+           "gameType: %d gameId: %d sequenceNum: %d\n",
+           bufferRecv[1], bufferRecv[2], bufferRecv[3],
+           bufferRecv[4], bufferRecv[5], bufferRecv[6]);
+
+    if (cnt < frameLength(protocolVersion)) {
+        printf("Received only %d bytes. (should have received %d bytes)\n", cnt, frameLength(protocolVersion));
+        return 0;
+    }
+
+    // check version
+    if (bufferRecv[0] != protocolVersion) {
+        printf("Received invalid multicast version number: %d, expected: %d.\n", bufferRecv[0], protocolVersion);
+        return 0;
+    }
+
+    // check command
+    if (bufferRecv[1] != 2) {
+        printf("Received invalid multicast command: %d, expected: %d.\n", bufferRecv[1], 2);
+        return 0;
+    }
+    if (count == MAX_DISCOVERED) return 0;
+
+    // port number, then load
+    uint8_t port_array[2] = {bufferRecv[2], bufferRecv[3]};
+    uint8_t load_array[2] = {bufferRecv[4], bufferRecv[5]};
+
+    struct discovered_server *server = &servers[count];
+    server->address.sin_family = AF_INET;
+    server->address.sin_port = u8_to_u16(port_array);
+    server->address.sin_addr = from->sin_addr;
+    server->load = ntohs(u8_to_u16(load_array));
+    server->tieBreak = (uint16_t) rand();
+    printf("Server %s:%d is %d.%d%% busy.\n", inet_ntoa(from->sin_addr),
+           ntohs(server->address.sin_port), server->load / 10, server->load % 10);
+    return 1;
+}
+
+
+/*
+ * Function: multicast
+ * ----------------------------
+ *   Ask the multicast group for servers, listen for answers until
+ *   MULTICAST_WINDOW_MS after the first one, and connect to the least
+ *   busy server that accepts the connection
+ *
+ *   sd_dgram:
+ *
+ *   multicast_address: address of the multicast group
+ *
+ *   return: -1 if failed, otherwise the sd_stream of a newly connected
+ *   stream socket (should be non-negative)
+ */
+int multicast(int sd_dgram, struct sockaddr_in multicast_address) {
+    printf("MULTICASTING\n");
+
+    // send
+    uint8_t bufferSend[BUFFER_SIZE];
+    memset(bufferSend, 0, sizeof(bufferSend));
+    bufferSend[0] = protocolVersion;
+    bufferSend[1] = 1;
+
+    int cnt = sendto(sd_dgram, bufferSend, frameLength(protocolVersion), 0,
+            (struct sockaddr *) &multicast_address, sizeof(multicast_address));
+    if (cnt < 0) {
+        perror("sendto");
+        close(sd_dgram);
+        return -1;
+    }
+
+    printf("SEND multicast: %d status: %d statusModifier: %d "
+           "gameType: %d gameId: %d sequenceNum: %d\n",
+           bufferSend[1], bufferSend[2], bufferSend[3],
+           bufferSend[4], bufferSend[5], bufferSend[6]);
+
+    // receive, at most TIME_LIMIT_SERVER seconds for the first answer
+    struct discovered_server servers[MAX_DISCOVERED];
+    int count = 0;
+    srand((unsigned) (time(NULL) ^ getpid()));
+    struct timeval timeout = {TIME_LIMIT_SERVER, 0};
+    for (;;) {
+        fd_set socketFDS;
+        FD_ZERO(&socketFDS);
+        FD_SET(sd_dgram, &socketFDS);
+
+        // block until something arrives, select updates timeout with the time left
+        int selectResult = select(sd_dgram + 1, &socketFDS, NULL, NULL, &timeout);
+        if (selectResult < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to select");
+            return -1;
+        }
+        if (selectResult == 0) break;
+
+        struct sockaddr_in addr;
+        socklen_t addrLen = sizeof(addr);
+        cnt = recvfrom(sd_dgram, bufferRecv, sizeof(bufferRecv), 0, (struct sockaddr *) &addr, &addrLen);
+        if (cnt < 0) {
+            perror("Fail to read");
+            return -1;
+        }
+        if (parseDiscovery(cnt, &addr, servers, count) == 0) continue;
+
+        // the first answer starts the collection window
+        if (count++ == 0) {
+            timeout.tv_sec = MULTICAST_WINDOW_MS / 1000;
+            timeout.tv_usec = (MULTICAST_WINDOW_MS % 1000) * 1000;
+        }
+    }
+    if (count == 0) {
+        printf("No message in the past %d seconds.\n", TIME_LIMIT_SERVER);
+        return -1;
+    }
+
+    qsort(servers, (size_t) count, sizeof(struct discovered_server), compareServers);
+    for (int i = 0; i < count; i++) {
+        // start stream socket
+        int sd_stream = socket(AF_INET, SOCK_STREAM, 0);
+        if (sd_stream < 0) {
+            perror("Opening stream socket error");
+            return -1;
+        }
+
+        if (connect(sd_stream, (struct sockaddr *) &servers[i].address, sizeof(struct sockaddr_in)) < 0) {
+            close(sd_stream);
+            perror("connect error");
+            continue;
+        }
+        return sd_stream;
+    }
+    return -1;
+}
+
+
+/*
+ * gameId: the game being continued, 0 if the server never gave one;
+ * a server that recovered the game from a snapshot matches it on this
+ *
+ * return gameId if success, otherwise return -1
+ */
+int reconnect(int connected_sd, uint8_t gameId, struct bitboard *board) {
+    printf("RECONNECTING\n");
+
+    // send
+    uint8_t bufferSend[BUFFER_SIZE];
+    memset(bufferSend, 0, sizeof(bufferSend));
+    bufferSend[0] = protocolVersion;
+    bufferSend[4] = RECONNECT;
+    bufferSend[5] = gameId;
+
+    for (int i=0; i<ROWS*COLUMNS; i++) {
+        if ((board->o >> i) & 1)
+            bufferSend[7+i] = 2;
+        else if ((board->x >> i) & 1)
+            bufferSend[7+i] = 1;
+        else
+            bufferSend[7+i] = 0;
+    }
+
+    sendBuffer(connected_sd, bufferSend);
+
+    // receive, a full server may first tell us our place in its waitlist
+    int recvResult = recvAnswer(connected_sd);
+    if (recvResult == 0) {
+        return -1;
+    }
+
+    printf("RECEIVE reconnect: %d status: %d statusModifier: %d "
+               "gameType: %d gameId: %d sequenceNum: %d\n",
+               bufferRecv[1], bufferRecv[2], bufferRecv[3],
+               bufferRecv[4], bufferRecv[5], bufferRecv[6]);
+
+    // Server responds with the game number in addition to their move,
+    // or with a reconnect error if they became full.
+    int recvMoveResult = receiveMoveClient(connected_sd, 0, board);
+    if (recvMoveResult == LOOP_BREAK) {
+        close(connected_sd);
+        return -1;
+    }
+    return bufferRecv[5];
+}
+
+
+/*
+ * Function: resume
+ * ----------------------------
+ *   Continue the game on a new connection with its session token. The
+ *   last move is sent again as a RESUME and the server answers it the way
+ *   it would have on the old connection, under the same gameId.
+ *
+ *   return: LOOP_CONTINUE or LOOP_BREAK once the answer is processed,
+ *   -1 if the server does not know the token
+ */
+int resume(int connected_sd, uint8_t *gameIdPtr, uint8_t *sequenceNumPtr, struct bitboard *board) {
+    printf("RESUMING\n");
+
+    uint8_t bufferSend[BUFFER_SIZE];
+    memcpy(bufferSend, lastMove, sizeof(bufferSend));
+    bufferSend[4] = RESUME;
+    memcpy(bufferSend + TOKEN_OFFSET, sessionToken, TOKEN_SIZE);
+    sendBuffer(connected_sd, bufferSend);
+
+    if (recvAnswer(connected_sd) == 0) return LOOP_BREAK;
+    if (bufferRecv[2] == GAME_ERROR && bufferRecv[3] == UNKNOWN_SESSION) {
+        printf("The server does not know this game.\n");
+        return -1;
+    }
+    *gameIdPtr = bufferRecv[5];
+    return processBufferClient(connected_sd, *gameIdPtr, sequenceNumPtr, board);
+}
+
+
+/*
+ * Function: connectToServer
+ * ----------------------------
+ *   Race non-blocking connects to the ip_addresses entries, starting one
+ *   every CONNECT_STAGGER_MS in file order (sooner when one fails), keep
+ *   the first that succeeds and close the others
+ *
+ *   deadlineMs: give up after this long
+ *
+ *   return: sd_stream if succeed, otherwise -1
+ */
+int connectToServer(int deadlineMs) {
+    printf("Accessing config file.\n");
+
+    // the next attempt starts CONNECT_STAGGER_MS after the previous one,
+    // or right away when an attempt fails
+    struct pollfd attempts[FILE_ROWS];
+    int started = 0;
+    int pending = 0;
+    int nextStartMs = 0;
+    const uint64_t start = monotonicMs();
+
+    for (;;) {
+        int elapsed = (int) (monotonicMs() - start);
+        if (elapsed >= deadlineMs) break;
+
+        while (started < addressCount && (pending == 0 || elapsed >= nextStartMs)) {
+            struct pollfd *attempt = &attempts[started++];
+            nextStartMs = elapsed + CONNECT_STAGGER_MS;
+            attempt->fd = socket(AF_INET, SOCK_STREAM, 0);
+            attempt->events = POLLOUT;
+            if (attempt->fd < 0) {
+                perror("Opening stream socket error");
+                continue;
+            }
+
+            struct sockaddr_in server_address;
+            server_address.sin_family = AF_INET;
+            server_address.sin_port = portNumbers[started - 1];
+            server_address.sin_addr.s_addr = inet_addr(ipAddresses[started - 1]);
+
+            if (setNonBlocking(attempt->fd) == 0
+                || (connect(attempt->fd, (struct sockaddr *) &server_address, sizeof(struct sockaddr_in)) < 0
+                    && errno != EINPROGRESS)) {
+                perror("connect error");
+                close(attempt->fd);
+                attempt->fd = -1;
+                continue;
+            }
+            pending++;
+        }
+        if (pending == 0) break;
+
+        int waitMs = deadlineMs - elapsed;
+        if (started < addressCount && nextStartMs - elapsed < waitMs)
+            waitMs = nextStartMs - elapsed;
+        if (poll(attempts, (nfds_t) started, waitMs) < 0 && errno != EINTR) {
+            perror("Failed to poll");
+            break;
+        }
+
+        for (int i = 0; i < started; i++) {
+            if (attempts[i].fd < 0 || attempts[i].revents == 0) continue;
+
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err != 0) {
+                printf("connect error: %s:%d: %s\n", ipAddresses[i], ntohs(portNumbers[i]), strerror(err));
+                close(attempts[i].fd);
+                attempts[i].fd = -1;
+                pending--;
+                nextStartMs = elapsed;
+                continue;
+            }
+
+            // the first connection wins, the others are cancelled
+            int sd_stream = attempts[i].fd;
+            for (int j = 0; j < started; j++)
+                if (j != i && attempts[j].fd >= 0) close(attempts[j].fd);
+            fcntl(sd_stream, F_SETFL, fcntl(sd_stream, F_GETFL) & ~O_NONBLOCK);
+            printf("Connected to %s:%d.\n", ipAddresses[i], ntohs(portNumbers[i]));
+            return sd_stream;
+        }
+    }
+
+    for (int i = 0; i < started; i++)
+        if (attempts[i].fd >= 0) close(attempts[i].fd);
+    printf("No server in the config file answered within %d ms.\n", deadlineMs);
+    return -1;
+}
+
+
+void playClient(
+        int connected_sd,
+        int sd_dgram,
+        struct sockaddr_in multicast_address,
+        int connectDeadlineMs) {
+
+    FILE * fp;
+    char *line = NULL;
+    size_t len = 0;
+
+    fp = fopen("ip_addresses", "r");
+    if (fp == NULL)
+        exit(EXIT_FAILURE);
+
+    int i = 0;
+    while (getline(&line, &len, fp) != -1) {
+        if (i >= FILE_ROWS) {
+            printf("WARNING: Input file too long.\n");
+            break;
+        }
+
+        strcpy(ipAddresses[i], line);
+
+        char portStr[FILE_LINE_LENGTH];
+        int k = 0;
+
+        int ipLength = FILE_LINE_LENGTH;
+        for (int j=0; j<FILE_LINE_LENGTH; j++) {
+            if (ipAddresses[i][j] == ' ') {
+                ipLength = j;
+                continue;
+            }
+
+            if (j > ipLength) {  // port number
+                portStr[k] = ipAddresses[i][j];
+                k++;
+            }
+        }
+
+        portNumbers[i] = htons(strtol(portStr, NULL, 10));
+
+        ipAddresses[i][ipLength] = 0;
+
+        i++;
+    }
+
+    fclose(fp);
+    addressCount = i;
+
+    struct bitboard board;
+    initBoard(&board);
+    initRecvRing(&recvRing);
+
+    uint8_t gameId, sequenceNum;
+
+    gameId = buildGameForClient(connected_sd, &board);
+    if (gameId < 0) {
+        connected_sd = multicast(sd_dgram, multicast_address);
+        if (connected_sd < 0) {
+            connected_sd = connectToServer(connectDeadlineMs);
+            if (connected_sd < 0) {
+                return;
+            }
+        }
+        initRecvRing(&recvRing);
+        gameId = reconnect(connected_sd, 0, &board);
+        if (gameId < 0) {
+            return;
+        }
+        sequenceNum = 0;
+    } else {
+        sequenceNum = 2;
+    }
+
+    for (;;) {
+        int recvResult = recvBuffer(connected_sd);
+        if (recvResult == 0) {
+            close(connected_sd);
+            connected_sd = multicast(sd_dgram, multicast_address);
+            if (connected_sd < 0) {
+                connected_sd = connectToServer(connectDeadlineMs);
+                if (connected_sd < 0) {
+                    return;
+                }
+            }
+            initRecvRing(&recvRing);
+            // a server that knows the token resumes the game, any other
+            // one gets the board
+            if (hasToken) {
+                int resumeResult = resume(connected_sd, &gameId, &sequenceNum, &board);
+                if (resumeResult == LOOP_BREAK) return;
+                if (resumeResult == LOOP_CONTINUE) continue;
+            }
+            gameId = reconnect(connected_sd, gameId, &board);
+            if (gameId < 0) {
+                return;
+            }
+            sequenceNum = 0;
+            continue;
+        }
+        int processResult = processBufferClient(connected_sd, gameId, &sequenceNum, &board);
+        if (processResult == LOOP_BREAK) return;
+    }
+}
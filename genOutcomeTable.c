@@ -0,0 +1,79 @@
+#include "tictactoe.h"
+
+
+/*
+ * Build-time generator of outcomeTable.c: prints the outcome, side to move
+ * and legality of every ternary board encoding, plus the table converting
+ * a 9-bit mask into its ternary digits.
+ */
+
+
+static const uint16_t LINES[8] = {
+        0x007, 0x038, 0x1c0,  // rows
+        0x049, 0x092, 0x124,  // columns
+        0x111, 0x054};  // diagonals
+
+
+uint16_t ternaryOf(uint16_t mask) {
+    uint16_t value = 0, power = 1;
+    for (int i = 0; i < ROWS * COLUMNS; i++) {
+        if ((mask >> i) & 1) value += power;
+        power *= 3;
+    }
+    return value;
+}
+
+
+int hasLine(uint16_t mask) {
+    for (int i = 0; i < 8; i++)
+        if ((mask & LINES[i]) == LINES[i]) return 1;
+    return 0;
+}
+
+
+uint8_t classify(uint16_t x, uint16_t o) {
+    uint8_t entry;
+    int xWins = hasLine(x), oWins = hasLine(o);
+    int nx = __builtin_popcount(x), no = __builtin_popcount(o);
+
+    // the first completed line decides, as the line scan in checkWin did
+    entry = OUTCOME_ON;
+    for (int i = 0; i < 8; i++) {
+        if ((x & LINES[i]) == LINES[i]) { entry = OUTCOME_X_WINS; break; }
+        if ((o & LINES[i]) == LINES[i]) { entry = OUTCOME_O_WINS; break; }
+    }
+    if (entry == OUTCOME_ON && nx + no == ROWS * COLUMNS) entry = OUTCOME_DRAW;
+
+    // CLIENT_MARK always moves first
+    if (nx > no) entry |= O_TO_MOVE;
+
+    int legal = (nx == no || nx == no + 1)
+                && !(xWins && oWins)
+                && !(xWins && nx != no + 1)
+                && !(oWins && nx != no);
+    if (legal) entry |= LEGAL_POSITION;
+    return entry;
+}
+
+
+int main() {
+    static uint8_t table[POSITIONS];
+    for (uint16_t x = 0; x <= FULL_BOARD; x++) {
+        for (uint16_t o = 0; o <= FULL_BOARD; o++) {
+            if (x & o) continue;
+            table[ternaryOf(x) + 2 * ternaryOf(o)] = classify(x, o);
+        }
+    }
+
+    printf("/* generated by genOutcomeTable, do not edit */\n\n");
+    printf("#include \"tictactoe.h\"\n\n\n");
+    printf("const uint16_t ternaryTable[FULL_BOARD + 1] = {");
+    for (uint16_t m = 0; m <= FULL_BOARD; m++)
+        printf("%s%u,", (m % 16) ? " " : "\n        ", ternaryOf(m));
+    printf("\n};\n\n\n");
+    printf("const uint8_t outcomeTable[POSITIONS] = {");
+    for (int i = 0; i < POSITIONS; i++)
+        printf("%s%u,", (i % 24) ? " " : "\n        ", table[i]);
+    printf("\n};\n");
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "tictactoe.h"
+
+
+/*
+ * Log-linear histogram of non-negative values such as latencies in
+ * microseconds. Recording is a couple of shifts and an increment, and
+ * histograms of different threads can be merged before reading them.
+ * Only one thread records into a histogram, but others may merge it
+ * while it does: fields are stored and loaded as relaxed atomics.
+ */
+
+
+#define BUMP(field, by) __atomic_store_n(&(field), (field) + (by), __ATOMIC_RELAXED)
+#define READ(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+
+#define SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+
+static int bucketOf(uint64_t value) {
+    if (value < SUB_BUCKETS) return (int) value;
+    int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + (int) ((value >> shift) - SUB_BUCKETS);
+}
+
+
+/*
+ * the middle of the range of values counted in a bucket
+ */
+static uint64_t valueOf(int bucket) {
+    if (bucket < SUB_BUCKETS) return (uint64_t) bucket;
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t low = (uint64_t) ((bucket & (SUB_BUCKETS - 1)) + SUB_BUCKETS) << shift;
+    return low + (((uint64_t) 1 << shift) >> 1);
+}
+
+
+void initHistogram(struct histogram *histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+
+void recordValue(struct histogram *histogram, uint64_t value) {
+    BUMP(histogram->counts[bucketOf(value)], 1);
+    BUMP(histogram->total, 1);
+    BUMP(histogram->sum, value);
+    if (value > histogram->max) __atomic_store_n(&histogram->max, value, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * add from to into, into must not be recorded to concurrently
+ */
+void mergeHistogram(struct histogram *into, const struct histogram *from) {
+    uint64_t total = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        uint64_t count = READ(from->counts[i]);
+        into->counts[i] += count;
+        total += count;
+    }
+    // a live histogram may have moved on since, keep the buckets consistent
+    into->total += total;
+    into->sum += READ(from->sum);
+    uint64_t max = READ(from->max);
+    if (max > into->max) into->max = max;
+}
+
+
+/*
+ * Function: histogramPercentile
+ * ----------------------------
+ *   percentile: between 0 and 100, e.g. 99.9
+ *
+ *   return: the value below which that share of the recorded values
+ *   falls, 0 if nothing was recorded
+ */
+uint64_t histogramPercentile(const struct histogram *histogram, double percentile) {
+    if (histogram->total == 0) return 0;
+    uint64_t rank = (uint64_t) (percentile / 100.0 * (double) histogram->total + 0.5);
+    if (rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t value = valueOf(i);
+            return (value > histogram->max) ? histogram->max : value;
+        }
+    }
+    return histogram->max;
+}
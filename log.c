@@ -0,0 +1,259 @@
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+
+#include "tictactoe.h"
+
+
+/*
+ * Asynchronous logging. Each thread appends fixed-size binary records (a
+ * format literal and up to LOG_MAX_ARGS ints) to its own single-producer
+ * ring, and a background thread formats and prints them. A full ring drops
+ * the record and counts it instead of blocking the game loop. The thread
+ * sleeps on an eventfd while every ring is empty; a ring that goes from
+ * empty to non-empty wakes it, so a quiet server costs it no wakeups and a
+ * busy one no more than one write per batch. Until startLogThread is
+ * called, records are printed synchronously, which is how the client uses
+ * it.
+ */
+
+
+#define LOG_RING_SIZE 4096  // records per thread, a power of two
+
+#define LOG_KIND_TEXT 0
+#define LOG_KIND_ERRNO 1
+#define LOG_KIND_BOARD 2
+
+struct log_record {
+    const char *fmt;
+    int32_t args[LOG_MAX_ARGS];
+    int32_t err;
+    uint8_t level;
+    uint8_t kind;
+};
+
+struct log_ring {
+    struct log_record records[LOG_RING_SIZE];
+    uint32_t head;  // next record to print, written by the log thread
+    uint32_t tail;  // next free record, written by the owning thread
+    uint64_t dropped;
+    struct log_ring *next;
+};
+
+volatile sig_atomic_t logLevel = LOG_BOARD;
+
+static struct log_ring *rings;  // every registered ring, newest first
+static pthread_mutex_t ringsLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct log_ring *ownRing;
+static pthread_t logThread;
+static int logThreadRunning;
+static volatile int logThreadStop;
+static int logWakeFd = -1;  // eventfd the log thread sleeps on
+
+
+/*
+ * wake the log thread, the eventfd counts wakeups that come while it is busy
+ */
+void wakeLogThread() {
+    const uint64_t one = 1;
+    if (write(logWakeFd, &one, sizeof(one)) < 0) return;
+}
+
+
+void printRecord(const struct log_record *record) {
+    const int32_t *a = record->args;
+    if (record->kind == LOG_KIND_BOARD) {
+        struct bitboard board = {(uint16_t) a[0], (uint16_t) a[1]};
+        printBoard(&board, (char) a[2]);
+    } else if (record->kind == LOG_KIND_ERRNO) {
+        fprintf(stderr, "%s: %s\n", record->fmt, strerror(record->err));
+    } else {
+        // surplus arguments are ignored by printf
+        printf(record->fmt, a[0], a[1], a[2], a[3], a[4], a[5]);
+    }
+}
+
+
+/*
+ * return the ring of the calling thread, registering it on first use
+ */
+struct log_ring *getOwnRing() {
+    if (ownRing != NULL) return ownRing;
+    ownRing = calloc(1, sizeof(struct log_ring));
+    if (ownRing == NULL) return NULL;
+    pthread_mutex_lock(&ringsLock);
+    ownRing->next = rings;
+    __atomic_store_n(&rings, ownRing, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&ringsLock);
+    return ownRing;
+}
+
+
+void submitRecord(const struct log_record *record) {
+    if (!__atomic_load_n(&logThreadRunning, __ATOMIC_ACQUIRE)) {
+        printRecord(record);
+        return;
+    }
+    struct log_ring *ring = getOwnRing();
+    if (ring == NULL) return;
+
+    if (ring->tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == LOG_RING_SIZE) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    const uint32_t tail = ring->tail;
+    ring->records[tail & (LOG_RING_SIZE - 1)] = *record;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    // the ring went from empty to non-empty, the log thread may be asleep;
+    // otherwise it has yet to print the record before, see drainRings
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->head, __ATOMIC_RELAXED) == tail) wakeLogThread();
+}
+
+
+/*
+ * Function: logWrite
+ * ----------------------------
+ *   Record a log line, called through the LOG macro which checks the level
+ *   and counts the arguments
+ *
+ *   fmt: a string literal, it is formatted later by the log thread
+ *
+ *   nargs: number of int arguments that follow, at most LOG_MAX_ARGS
+ */
+void logWrite(int level, int nargs, const char *fmt, ...) {
+    struct log_record record;
+    record.fmt = fmt;
+    record.err = 0;
+    record.level = (uint8_t) level;
+    record.kind = LOG_KIND_TEXT;
+
+    va_list ap;
+    va_start(ap, fmt);
+    for (int i = 0; i < LOG_MAX_ARGS; i++)
+        record.args[i] = (i < nargs) ? va_arg(ap, int32_t) : 0;
+    va_end(ap);
+    submitRecord(&record);
+}
+
+
+/*
+ * log msg with the description of the current errno, like perror
+ */
+void logErrno(int level, const char *msg) {
+    if (level > logLevel) return;
+    struct log_record record = {msg, {0}, errno, (uint8_t) level, LOG_KIND_ERRNO};
+    submitRecord(&record);
+}
+
+
+/*
+ * log a board, it is only rendered by the log thread
+ */
+void logBoard(const struct bitboard *board, char mark) {
+    if (LOG_BOARD > logLevel) return;
+    struct log_record record = {NULL, {board->x, board->o, mark}, 0, LOG_BOARD, LOG_KIND_BOARD};
+    submitRecord(&record);
+}
+
+
+/*
+ * return the number of records dropped so far because a ring was full
+ */
+uint64_t logDropped() {
+    uint64_t dropped = 0;
+    for (struct log_ring *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+        dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    return dropped;
+}
+
+
+/*
+ * print every pending record, return how many were printed. The fence
+ * pairs with the one of submitRecord: a record pushed as this pass reads
+ * the tails is either seen here or finds its ring empty and wakes the
+ * thread up again.
+ */
+int drainRings() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int printed = 0;
+    for (struct log_ring *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+        uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        while (ring->head != tail) {
+            printRecord(&ring->records[ring->head & (LOG_RING_SIZE - 1)]);
+            __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+            printed++;
+        }
+    }
+    return printed;
+}
+
+
+void *runLogThread(void *arg) {
+    uint64_t reportedDrops = 0;
+    (void) arg;
+
+    while (!logThreadStop) {
+        if (drainRings() > 0) continue;
+
+        fflush(stdout);
+        uint64_t dropped = logDropped();
+        if (dropped != reportedDrops) {
+            fprintf(stderr, "%llu log lines dropped so far.\n", (unsigned long long) dropped);
+            reportedDrops = dropped;
+        }
+        // a record pushed since the last drain has written the eventfd already
+        uint64_t wakeups;
+        if (read(logWakeFd, &wakeups, sizeof(wakeups)) < 0 && errno != EINTR) break;
+    }
+    drainRings();
+    fflush(stdout);
+    return NULL;
+}
+
+
+/*
+ * SIGUSR1 makes the log more verbose, SIGUSR2 quieter
+ */
+void onLogSignal(int sig) {
+    if (sig == SIGUSR1 && logLevel < LOG_BOARD) logLevel++;
+    else if (sig == SIGUSR2 && logLevel > LOG_ERROR) logLevel--;
+}
+
+
+/*
+ * Function: startLogThread
+ * ----------------------------
+ *   Switch logging to the background thread
+ *
+ *   return: 1 if succeed, else 0 and logging stays synchronous
+ */
+int startLogThread() {
+    signal(SIGUSR1, onLogSignal);
+    signal(SIGUSR2, onLogSignal);
+
+    logThreadStop = 0;
+    // kept open once created, a late record never writes to a closed descriptor
+    if (logWakeFd < 0 && (logWakeFd = eventfd(0, 0)) < 0) {
+        perror("Failed to create the log eventfd");
+        return 0;
+    }
+    if (pthread_create(&logThread, NULL, runLogThread, NULL) != 0) {
+        perror("Failed to start log thread");
+        return 0;
+    }
+    __atomic_store_n(&logThreadRunning, 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+
+/*
+ * flush the pending records and go back to synchronous logging
+ */
+void stopLogThread() {
+    if (!logThreadRunning) return;
+    logThreadStop = 1;
+    wakeLogThread();
+    pthread_join(logThread, NULL);
+    __atomic_store_n(&logThreadRunning, 0, __ATOMIC_RELEASE);
+}
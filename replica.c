@@ -0,0 +1,304 @@
+#include <poll.h>
+#include <pthread.h>
+
+#include "tictactoe.h"
+
+
+/*
+ * Hot-standby replication. Every event loop of a primary streams the
+ * snapshot records of its games to a standby over UDP: one record each
+ * time a game sends a frame, one with RECORD_FREE when it ends, and all
+ * live games again every REPLICA_SWEEP_MS so a lost datagram is made up
+ * for. The standby's replication thread hands every record to one of its
+ * event loops, chosen by the record's session token, and that loop keeps
+ * the latest record of the game in a table of its own until the game ends
+ * or stops being refreshed. When the client fails over with a RESUME, its
+ * token leads to the same loop, which continues the game.
+ *
+ * Records are sent in host byte order, both servers run the same build.
+ */
+
+
+#define REPLICA_MAGIC 0x32525454  // "TTR2"
+
+struct replica_header {
+    uint32_t magic;
+    uint16_t count;
+    uint16_t recordSize;
+};
+
+static int sd_replica = -1;
+static pthread_t replicaThread;
+static volatile int replicaRunning;
+static void (*deliverRecords)(const struct game_record *records, int count);
+
+
+/*
+ * Function: openReplicaStream
+ * ----------------------------
+ *   Open the socket a loop sends its records to the standby on
+ *
+ *   return: 1 if succeed, else 0
+ */
+int openReplicaStream(struct replica_stream *stream, const struct sockaddr_in *standby) {
+    stream->count = 0;
+    stream->sd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (stream->sd < 0) {
+        logErrno(LOG_ERROR, "Opening replication socket error");
+        return 0;
+    }
+    if (connect(stream->sd, (const struct sockaddr *) standby, sizeof(*standby)) < 0
+        || setNonBlocking(stream->sd) == 0) {
+        logErrno(LOG_ERROR, "Failed to reach standby");
+        close(stream->sd);
+        stream->sd = -1;
+        return 0;
+    }
+    return 1;
+}
+
+
+void closeReplicaStream(struct replica_stream *stream) {
+    if (stream->sd < 0) return;
+    close(stream->sd);
+    stream->sd = -1;
+}
+
+
+/*
+ * Function: flushReplicaStream
+ * ----------------------------
+ *   Send the records gathered so far in one datagram. A standby that is
+ *   down or a full socket buffer loses them; the next sweep sends them again.
+ */
+void flushReplicaStream(struct replica_stream *stream) {
+    if (stream->count == 0) return;
+    struct replica_header header = {REPLICA_MAGIC, (uint16_t) stream->count, sizeof(struct game_record)};
+    struct iovec iov[2] = {
+            {&header, sizeof(header)},
+            {stream->records, stream->count * sizeof(struct game_record)}};
+    if (writev(stream->sd, iov, 2) < 0)
+        LOG(LOG_DEBUG, "Dropped %d replicated records, errno %d.\n", (int) stream->count, errno);
+    stream->count = 0;
+}
+
+
+void replicateRecord(struct replica_stream *stream, const struct game_record *record) {
+    stream->records[stream->count++] = *record;
+    if (stream->count == REPLICA_RECORDS) flushReplicaStream(stream);
+}
+
+
+/*
+ * Function: initReplicaTable
+ * ----------------------------
+ *   Make room for capacity replicated games in a standby loop
+ *
+ *   ttlMs: how long a game is kept without being refreshed
+ *
+ *   return: 1 if succeed, else 0
+ */
+int initReplicaTable(struct replica_table *table, uint32_t capacity, uint32_t ttlMs) {
+    table->bits = 4;
+    while ((1u << table->bits) / 4 * 3 < capacity) table->bits++;
+    table->replicas = calloc(1u << table->bits, sizeof(struct replica));
+    if (table->replicas == NULL) {
+        logErrno(LOG_ERROR, "Failed to allocate replica table");
+        return 0;
+    }
+    table->count = 0;
+    table->ttlMs = ttlMs;
+    return 1;
+}
+
+
+void freeReplicaTable(struct replica_table *table) {
+    free(table->replicas);
+    table->replicas = NULL;
+}
+
+
+/*
+ * the loop id and slot of a session token, which name one game of the
+ * primary at a time
+ */
+uint32_t replicaKey(const uint8_t token[TOKEN_SIZE]) {
+    return (uint32_t) token[0] << 24 | (uint32_t) token[1] << 16 | (uint32_t) token[2] << 8 | token[3];
+}
+
+
+uint32_t replicaHash(const struct replica_table *table, uint32_t key) {
+    return (key * 2654435761u) >> (32 - table->bits);
+}
+
+
+/*
+ * the index of key, or of the empty slot it would go to
+ */
+uint32_t findReplica(const struct replica_table *table, uint32_t key) {
+    const uint32_t mask = (1u << table->bits) - 1;
+    uint32_t i = replicaHash(table, key);
+    while (table->replicas[i].used && replicaKey(table->replicas[i].record.token) != key) i = (i + 1) & mask;
+    return i;
+}
+
+
+/*
+ * empty slot i, shifting back the entries of its run that probed past it
+ */
+void removeReplica(struct replica_table *table, uint32_t i) {
+    const uint32_t mask = (1u << table->bits) - 1;
+    struct replica *replicas = table->replicas;
+    for (uint32_t j = (i + 1) & mask; replicas[j].used; j = (j + 1) & mask) {
+        uint32_t home = replicaHash(table, replicaKey(replicas[j].record.token));
+        // j may move to i only if its home is not in (i, j]
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            replicas[i] = replicas[j];
+            i = j;
+        }
+    }
+    replicas[i].used = 0;
+    table->count--;
+}
+
+
+/*
+ * keep the latest record of a game, forget a game that has ended
+ */
+void applyRecord(struct replica_table *table, const struct game_record *record, uint64_t now) {
+    uint32_t i = findReplica(table, replicaKey(record->token));
+    if (record->state != RECORD_LIVE) {
+        if (table->replicas[i].used) removeReplica(table, i);
+        return;
+    }
+    if (table->replicas[i].used == 0) {
+        if (table->count + 1 > (3u << table->bits) / 4) {
+            LOG(LOG_WARN, "Replica table full, game %u is not replicated.\n", record->gameId);
+            return;
+        }
+        table->replicas[i].used = 1;
+        table->count++;
+    }
+    table->replicas[i].record = *record;
+    table->replicas[i].refreshedMs = now;
+}
+
+
+/*
+ * forget the games the primary stopped refreshing
+ */
+void expireReplicas(struct replica_table *table, uint64_t now) {
+    const uint32_t size = 1u << table->bits;
+    for (uint32_t i = 0; i < size;) {
+        // removing shifts the next entry into i, look at i again
+        if (table->replicas[i].used && now - table->replicas[i].refreshedMs > table->ttlMs) removeReplica(table, i);
+        else i++;
+    }
+}
+
+
+/*
+ * Function: takeReplica
+ * ----------------------------
+ *   Find the replicated game a session token names and take it out of the
+ *   table, in O(1): the token's loop id and slot are the key, its secret
+ *   proves the game is the one the token was issued for
+ *
+ *   record: gets the game's latest record
+ *
+ *   return: 1 if the game was found, else 0
+ */
+int takeReplica(struct replica_table *table, const uint8_t token[TOKEN_SIZE], uint64_t now,
+                struct game_record *record) {
+    uint32_t i = findReplica(table, replicaKey(token));
+    const struct replica *replica = &table->replicas[i];
+    if (replica->used == 0 || now - replica->refreshedMs > table->ttlMs
+        || memcmp(replica->record.token, token, TOKEN_SIZE) != 0)
+        return 0;
+    *record = replica->record;
+    removeReplica(table, i);
+    return 1;
+}
+
+
+void *runReplicaThread(void *arg) {
+    struct {
+        struct replica_header header;
+        struct game_record records[REPLICA_RECORDS];
+    } datagram;
+
+    while (replicaRunning) {
+        struct pollfd pfd = {sd_replica, POLLIN, 0};
+        if (poll(&pfd, 1, REPLICA_SWEEP_MS) != 1) continue;
+
+        for (;;) {
+            ssize_t cnt = recv(sd_replica, &datagram, sizeof(datagram), MSG_DONTWAIT);
+            if (cnt < 0) break;
+            if (cnt < (ssize_t) sizeof(datagram.header) || datagram.header.magic != REPLICA_MAGIC
+                || datagram.header.recordSize != sizeof(struct game_record)
+                || cnt != (ssize_t) (sizeof(datagram.header) + datagram.header.count * sizeof(struct game_record)))
+                continue;
+            // only a game with a token can be continued on the standby
+            int valid = 0;
+            for (int i = 0; i < datagram.header.count; i++) {
+                const struct game_record *record = &datagram.records[i];
+                const uint8_t *secret = record->token + 4;
+                if (isRecordValid(record) && (secret[0] | secret[1] | secret[2] | secret[3]) != 0)
+                    datagram.records[valid++] = *record;
+            }
+            if (valid > 0) deliverRecords(datagram.records, valid);
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Function: startStandby
+ * ----------------------------
+ *   Receive the games of a primary on UDP port from a thread of their own
+ *
+ *   deliver: called on that thread with the valid records of each datagram,
+ *   to pass them on to the loops that keep them
+ *
+ *   return: 1 on success, else 0
+ */
+int startStandby(long port, void (*deliver)(const struct game_record *records, int count)) {
+    deliverRecords = deliver;
+    sd_replica = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sd_replica < 0) {
+        logErrno(LOG_ERROR, "Opening replication socket error");
+        return 0;
+    }
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sd_replica, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        logErrno(LOG_ERROR, "Failed to open replication port");
+        close(sd_replica);
+        sd_replica = -1;
+        return 0;
+    }
+
+    replicaRunning = 1;
+    if (pthread_create(&replicaThread, NULL, runReplicaThread, NULL) != 0) {
+        logErrno(LOG_ERROR, "Failed to start replication thread");
+        replicaRunning = 0;
+        close(sd_replica);
+        sd_replica = -1;
+        return 0;
+    }
+    LOG(LOG_INFO, "Standing by for replicated games on port %d.\n", (int) port);
+    return 1;
+}
+
+
+void stopStandby() {
+    if (sd_replica < 0) return;
+    replicaRunning = 0;
+    pthread_join(replicaThread, NULL);
+    close(sd_replica);
+    sd_replica = -1;
+}
@@ -1,529 +1,2388 @@
-#include "tictactoe.h"
-
-
-struct board_info {
-	int resendCount;
-	int sd;
-	time_t latest_time;
-	uint8_t sequenceNum;  // store the expected sequence number sent by the client
-	uint8_t bufferSend[BUFFER_SIZE];
-} boardInfo[MAX_BOARD+1];
-
-
-void initBoardInfo(struct board_info *boardInfoPtr) {
-    boardInfoPtr->resendCount = 0;
-    boardInfoPtr->sd = 0;
-    time(&boardInfoPtr->latest_time);
-    boardInfoPtr->sequenceNum = 0;
-    memset(boardInfoPtr->bufferSend, 0, BUFFER_SIZE);
-}
-
-
-uint8_t serverMakeChoice(char board[ROWS][COLUMNS]) {
-    int choice = 0;
-    for (int i=0; i<ROWS; i++) {
-        for (int j=0; j<COLUMNS; j++) {
-            choice = i*3+j+1;
-            if (board[i][j] == (char) (choice + '0'))
-                return (uint8_t) choice;
-        }
-    }
-    return (uint8_t) choice;
-}
-
-
-void receiveNewGame(
-        int recvSequenceNum,
-        int sendSequenceNum,
-        int nextRecvSequenceNum,
-        uint8_t gameId) {
-
-    // check sequence number
-    if (recvSequenceNum < boardInfo[gameId].sequenceNum) {
-        // receiving a duplicate packet means that the other
-        // side might not have received my last msg, so do a resend
-        // and skip the next move input
-        if (boardInfo[gameId].resendCount < MAX_TRY) {
-            printf("Received a duplicate packet, resend last msg.\n");
-            boardInfo[gameId].resendCount++;
-            sendBuffer(boardInfo[gameId].sd, boardInfo[gameId].bufferSend);
-            time(&boardInfo[gameId].latest_time);
-        } else
-            printf("Received a duplicate packet, run out of resend chances, exit game.\n");
-        return;
-    }
-    if (recvSequenceNum > boardInfo[gameId].sequenceNum) {
-        printf("Packets arrived out of order. "
-               "Received sequence number: %d, expected: %d.\n",
-               recvSequenceNum, boardInfo[gameId].sequenceNum);
-
-        respondToInvalidRequest(boardInfo[gameId].sd, sendSequenceNum, gameId);
-        time(&boardInfo[gameId].latest_time);
-        return;
-    }
-    // update boardInfo
-    boardInfo[gameId].sequenceNum = (uint8_t) nextRecvSequenceNum;
-    time(&boardInfo[gameId].latest_time);
-
-    // send game id to client
-    uint8_t sb[BUFFER_SIZE] = {
-            VERSION, 0, GAME_ON, 0, MOVE, gameId,(uint8_t) sendSequenceNum};
-    sendBuffer(boardInfo[gameId].sd, sb);
-}
-
-void receiveReconnect(
-        int gameId,
-        int sendSequenceNum,
-        const uint8_t buffer[BUFFER_SIZE],
-        char boards[MAX_BOARD][ROWS][COLUMNS]) {
-
-    printf("RECONNECT\n");
-
-    initBoard(boards[gameId]);
-    int boardIdx = 7;
-
-    for (int i=0; i<ROWS; i++) {
-        for (int j=0; j<COLUMNS; j++) {
-            if (buffer[boardIdx] == 2) {
-                boards[gameId][i][j] = SERVER_MARK;
-            }
-            else if (buffer[boardIdx] == 1) {
-                boards[gameId][i][j] = CLIENT_MARK;
-            }
-            boardIdx++;
-        }
-    }
-
-    printBoard(boards[gameId], SERVER_MARK);
-    int result = checkWin(boards[gameId], CLIENT_MARK);
-    if (result == GAME_ON) {
-        time(&boardInfo[gameId].latest_time);
-        uint8_t newChoice = serverMakeChoice(boards[gameId]);
-        sendMoveWithChoice(
-                boardInfo[gameId].sd, newChoice, gameId,
-                (uint8_t) sendSequenceNum, boards[gameId], SERVER_MARK);
-        return;
-    }
-
-    uint8_t sm;
-    if (result == WIN) {
-        printf("You lose.\n");
-        sm = LOSE;
-    } else {
-        printf("Draw.\n");
-        sm = DRAW;
-    }
-    uint8_t sb[BUFFER_SIZE] = {
-            VERSION, 0, GAME_COMPLETE, sm, END_GAME, gameId,
-            (uint8_t) sendSequenceNum};
-    sendBuffer(boardInfo[gameId].sd, sb);
-
-    printf("Clean board %d after game completed.\n", gameId);
-    close(boardInfo[gameId].sd);
-    initBoard(boards[gameId]);
-    initBoardInfo(&boardInfo[gameId]);
-}
-
-
-void receiveMove(
-        int sendSequenceNum,
-        const uint8_t buffer[BUFFER_SIZE],
-        char boards[MAX_BOARD][ROWS][COLUMNS]) {
-
-    const uint8_t recvStatus = buffer[2];
-    const uint8_t statusModifier = buffer[3];
-    const uint8_t gameId = buffer[5];
-    if (recvStatus < 0 || recvStatus > 2) {
-        printf("Received invalid game status: %d.\n", recvStatus);
-        respondToInvalidRequest(boardInfo[gameId].sd, sendSequenceNum, gameId);
-        time(&boardInfo[gameId].latest_time);
-        return;
-    }
-    if (recvStatus == GAME_ERROR) {
-        parseGeneralError(statusModifier);
-        return;
-    }
-
-    // when recvStatus == GAME_ON or GAME_COMPLETE
-
-    // check if move is valid
-    uint8_t choice = buffer[1];
-
-    int row = (choice-1) / ROWS;
-    int column = (choice-1) % COLUMNS;
-
-    if (isMoveValid(boards[gameId], row, column, choice) == 0) {
-        printf("The opponent made an invalid move: %d.\n", choice);
-        respondToInvalidRequest(boardInfo[gameId].sd, sendSequenceNum, gameId);
-        time(&boardInfo[gameId].latest_time);
-        return;
-    }
-
-    // move is valid, update board
-    boards[gameId][row][column] = CLIENT_MARK;
-    printBoard(boards[gameId], SERVER_MARK);
-
-    // check local game finished
-    int result = checkWin(boards[gameId], CLIENT_MARK);
-
-    if (recvStatus == GAME_ON) {
-        if (result == GAME_ON) {
-            time(&boardInfo[gameId].latest_time);
-            uint8_t newChoice = serverMakeChoice(boards[gameId]);
-            sendMoveWithChoice(
-                    boardInfo[gameId].sd, newChoice, gameId,
-                    (uint8_t) sendSequenceNum, boards[gameId], SERVER_MARK);
-            return;
-        }
-        printf("Received invalid game status: %d, expected: %d.\n", recvStatus, GAME_ON);
-        respondToInvalidRequest(
-                boardInfo[gameId].sd, sendSequenceNum, gameId);
-        time(&boardInfo[gameId].latest_time);
-        return;
-    }
-    // when recvStatus == GAME_COMPLETE
-    // check if local game and remote game has the same result
-    if (result != statusModifier) {
-        printf("Received invalid status modifier: %d. Expected: %d\n", statusModifier, result);
-        respondToInvalidRequest(boardInfo[gameId].sd, sendSequenceNum, gameId);
-        time(&boardInfo[gameId].latest_time);
-        return;
-    }
-    uint8_t sm;
-    if (result == WIN) {
-        printf("You lose.\n");
-        sm = LOSE;
-    } else {
-        printf("Draw.\n");
-        sm = DRAW;
-    }
-    uint8_t sb[BUFFER_SIZE] = {
-            VERSION, 0, GAME_COMPLETE, sm, END_GAME, gameId,
-            (uint8_t) sendSequenceNum};
-    sendBuffer(boardInfo[gameId].sd, sb);
-
-    printf("Clean board %d after game completed.\n", gameId);
-    close(boardInfo[gameId].sd);
-    initBoard(boards[gameId]);
-    initBoardInfo(&boardInfo[gameId]);
-}
-
-
-/*
- * Function: processBuffer
- * ----------------------------
- *   process a received buffer
- *
- *   gameId:
- *
- *   buffer:
- *
- *   board[ROWS][COLUMNS]: the board for the game
- */
-void processBuffer(
-        uint8_t gameId,
-        const uint8_t buffer[BUFFER_SIZE],
-        char boards[MAX_BOARD][ROWS][COLUMNS]) {
-
-    printf("RECEIVE choice: %d status: %d statusModifier: %d "
-           "gameType: %d gameId: %d sequenceNum: %d\n",
-           buffer[1], buffer[2], buffer[3],
-           buffer[4], buffer[5], buffer[6]);
-
-    const int recvSequenceNum = buffer[6];
-    const int sendSequenceNum = (recvSequenceNum + 1) % 256;
-    const int nextRecvSequenceNum = (sendSequenceNum + 1) % 256;
-
-    uint8_t version = buffer[0];
-    if (version != VERSION) {
-        printf("Received invalid version number: %d.\n", version);
-        respondToInvalidRequest(boardInfo[gameId].sd, sendSequenceNum, gameId);
-        time(&boardInfo[gameId].latest_time);
-        return;
-    }
-    // #receivedBytes and #version are correct and no timeout
-    const uint8_t gameType = buffer[4];
-    if (gameType < 0 || gameType > 3) {
-        printf("Received invalid game type: %d.\n", gameType);
-        respondToInvalidRequest(boardInfo[gameId].sd, sendSequenceNum, gameId);
-        time(&boardInfo[gameId].latest_time);
-        return;
-    }
-    if (gameType == NEW_GAME) {
-        receiveNewGame(recvSequenceNum, sendSequenceNum, nextRecvSequenceNum, gameId);
-        return;
-    }
-
-    if (gameType == RECONNECT) {
-        receiveReconnect(gameId, sendSequenceNum, buffer, boards);
-        return;
-    }
-
-    // Below are the cases when gameType == END_GAME, MOVE
-    // need to check gameId, port & ip, and seqNum
-    if (gameId != buffer[5]) {
-        printf("Received invalid game id: %d.\n", gameId);
-        respondToInvalidRequest(boardInfo[gameId].sd, sendSequenceNum, gameId);
-        time(&boardInfo[gameId].latest_time);
-        return;
-    }
-    // gameId is correct, check sequenceNum
-    if (recvSequenceNum < boardInfo[gameId].sequenceNum) {
-        // receiving a duplicate packet means that the other
-        // side might not have received my last msg, so do a resend
-        // and skip the next move input
-        if (boardInfo[gameId].resendCount < MAX_TRY) {
-            printf("Received a duplicate packet, resend last msg.\n");
-            boardInfo[gameId].resendCount++;
-            sendBuffer(boardInfo[gameId].sd, boardInfo[gameId].bufferSend);
-            time(&boardInfo[gameId].latest_time);
-            return;
-        }
-        printf("Received a duplicate packet, run out of resend chances, exit game.\n");
-        return;
-    }
-    if (recvSequenceNum > boardInfo[gameId].sequenceNum) {
-        printf("Packets arrived out of order. Received sequence number: %d, expected: %d.\n",
-                recvSequenceNum, boardInfo[gameId].sequenceNum);
-        respondToInvalidRequest(boardInfo[gameId].sd, sendSequenceNum, gameId);
-        time(&boardInfo[gameId].latest_time);
-        return;
-    }
-    // when gameId, seqNum are all correct,
-    // gameType can be END_GAME or MOVE
-    // update next expected received sequence number
-    boardInfo[gameId].sequenceNum = (uint8_t) nextRecvSequenceNum;
-
-    if (gameType == END_GAME) {
-        time(&boardInfo[gameId].latest_time);
-
-        int result = checkWin(boards[gameId], CLIENT_MARK);
-        if (result == GAME_ON || result == WIN) {
-            printf("Invalid END GAME command.\n");
-            respondToInvalidRequest(boardInfo[gameId].sd, sendSequenceNum, gameId);
-            time(&boardInfo[gameId].latest_time);
-            return;
-        }
-        if (result == DRAW) printf("Draw.\n");
-        else printf("You win!\n");
-
-        close(boardInfo[gameId].sd);
-        initBoard(boards[gameId]);
-        initBoardInfo(&boardInfo[gameId]);
-        return;
-    }
-
-    // when gameType == MOVE
-    receiveMove(sendSequenceNum, buffer, boards);
-}
-
-
-void checkBoardTimeOut(char boards[MAX_BOARD][ROWS][COLUMNS]) {
-    for (int i = 0; i < MAX_BOARD; i++) {
-        if (boardInfo[i].sd != 0
-            && time(NULL) - boardInfo[i].latest_time >= TIME_LIMIT_SERVER) {
-            // this board is unavailable and has waited for too long
-            if (boardInfo[i].resendCount < MAX_SEND_COUNT) {  // the server can still resend
-                printf("Board[%d] timeout.\n", i);
-                boardInfo[i].resendCount++;
-                // sendBuffer(boardInfo[i].sd, boardInfo[i].bufferSend);
-            } else {  // the server can't resend any more
-                // tell the client its game has ended due to time out
-                uint8_t sb[BUFFER_SIZE] = {
-                        VERSION, 0, GAME_ERROR, TIME_OUT, MOVE, (uint8_t) i,
-                        (uint8_t) (boardInfo[i].sequenceNum - 1) % 256};
-                sendBuffer(boardInfo[i].sd, sb);
-
-                printf("Clean board[%d] after time out.\n", i);
-                close(boardInfo[i].sd);
-                initBoard(boards[i]);
-                initBoardInfo(&boardInfo[i]);
-            }
-        }
-    }
-}
-
-
-void processMulticast(int sd_dgram, long portNumber) {
-    printf("MULTICAST\n");
-
-    uint8_t bufferSend[BUFFER_SIZE];
-    uint8_t bufferRecv[BUFFER_SIZE];
-
-    bufferSend[0] = VERSION;
-    bufferSend[1] = 2;
-
-    struct sockaddr_in addr;
-    socklen_t addrLen = sizeof(addr);
-
-    int cnt = recvfrom(sd_dgram, bufferRecv, sizeof(bufferRecv), 0, (struct sockaddr *) &addr, &addrLen);
-
-    printf("RECEIVE choice: %d status: %d statusModifier: %d "
-           "gameType: %d gameId: %d sequenceNum: %d\n",
-           bufferRecv[1], bufferRecv[2], bufferRecv[3],
-           bufferRecv[4], bufferRecv[5], bufferRecv[6]);
-
-    int found = 0;
-    for (int i = 0; i < MAX_BOARD; i++) {
-        if (boardInfo[i].sd == 0) {
-            found = 1;
-            break;
-        }
-    }
-
-    if (found == 0) {
-        printf("There's no empty board for a multicast.\n");
-        return;
-    }
-
-    if (cnt < 0) {
-        perror("Fail to read");
-    } else if (cnt < BUFFER_SIZE) {
-        printf("Received only %d bytes. (should have received %d bytes)\n", cnt, BUFFER_SIZE);
-    }
-
-    // check version
-    if (bufferRecv[0] != VERSION) {
-        printf("Received invalid version number: %d, expected: %d.\n", bufferRecv[0], VERSION);
-    }
-
-    // check command
-    if (bufferRecv[1] != 1) {
-        printf("Received invalid version number: %d, expected: %d.\n", bufferRecv[1], 1);
-    }
-
-    uint8_t port_array[2];
-    u16_to_u8(htons(portNumber), port_array);
-    bufferSend[2] = port_array[0];
-    bufferSend[3] = port_array[1];
-
-    cnt = sendto(sd_dgram, bufferSend, sizeof(bufferSend), 0, (struct sockaddr *) &addr, sizeof(addr));
-
-    printf("SEND choice: %d status: %d statusModifier: %d "
-           "gameType: %d gameId: %d sequenceNum: %d\n",
-           bufferSend[1], bufferSend[2], bufferSend[3],
-           bufferSend[4], bufferSend[5], bufferSend[6]);
-
-    if (cnt < 0) {
-        perror("sendto in processMulticast");
-        close(sd_dgram);
-    }
-}
-
-/*
- * Function: playServer
- * ----------------------------
- *   Simulate the game play process for server
- *
- *   sd_stream: socket file descriptor of the server
- *
- *   sd_dgram:
- *
- *   multicast_address:
- */
-void playServer(
-        int sd_stream,
-        int sd_dgram,
-        long portNumber) {
-
-    char boards[MAX_BOARD][ROWS][COLUMNS];
-
-    // initialize boardInfo and boards
-    for (int i=0; i<MAX_BOARD; ++i) {
-        initBoardInfo(&boardInfo[i]);
-        initBoard(boards[i]);
-    }
-    printBoard(boards[0], SERVER_MARK);
-
-    // start the game
-    for (long j=0; j<LONG_MAX; j++) {
-        checkBoardTimeOut(boards);
-
-        fd_set socketFDS;
-        int maxSD = sd_stream;
-        struct timeval timeout;
-
-        FD_ZERO(&socketFDS);
-        FD_SET(sd_stream, &socketFDS);
-        FD_SET(sd_dgram, &socketFDS);
-
-        if (sd_dgram> maxSD)
-            maxSD = sd_dgram;
-
-        // update socketFDS
-        for (int i=0; i<MAX_BOARD; i++) {
-            if (boardInfo[i].sd > 0) {
-                FD_SET(boardInfo[i].sd, &socketFDS);
-                if (boardInfo[i].sd > maxSD)
-                    maxSD = boardInfo[i].sd;
-            }
-        }
-        timeout.tv_sec = TIME_LIMIT_SERVER;
-        timeout.tv_usec = 0;
-
-        //printf("maxSD: %d, sd_dgram: %d, sd_stream: %d\n", maxSD, sd_dgram, sd_stream);
-
-        // block until something arrives
-        int selectResult = select(maxSD+1, &socketFDS, NULL, NULL, &timeout);
-
-        if (selectResult < 0) {
-            perror("Failed to select: ");
-            //continue; todo
-            break;
-        }
-        if (selectResult == 0) {
-            printf("No message in the past %d seconds.\n", TIME_LIMIT_SERVER);
-            continue;
-        }
-
-        if (FD_ISSET(sd_dgram, &socketFDS)) {
-            processMulticast(sd_dgram, portNumber);
-        }
-        
-        // establish new connection
-        if (FD_ISSET(sd_stream, &socketFDS)) {
-            uint8_t gameId;
-            struct sockaddr_in from_address;
-            socklen_t fromLength;
-            int connected_sd = accept(sd_stream, (struct sockaddr *) &from_address, &fromLength);
-            if (connected_sd < 0) perror("");
-
-            for (gameId=0; gameId<MAX_BOARD; gameId++) {
-                if (boardInfo[gameId].sd == 0) {
-                    boardInfo[gameId].sd = connected_sd;
-                    FD_SET(connected_sd, &socketFDS);
-                    break;
-                }
-            }
-            if (gameId == MAX_BOARD) {
-                uint8_t sb[BUFFER_SIZE] = {
-                        VERSION, 0, GAME_ERROR, OUT_OF_RESOURCES, MOVE, (uint8_t) 0, (uint8_t) 1};
-                sendBuffer(connected_sd, sb);
-                close(connected_sd);
-            }
-        }
-        // receive buffer from all connected clients
-        for (int i=0; i<MAX_BOARD; i++) {
-            if (FD_ISSET(boardInfo[i].sd, &socketFDS)) {  // todo why not: if(boardInfo[gameId].sd_stream != 0)
-                uint8_t buffer[BUFFER_SIZE];
-                int rc = read(boardInfo[i].sd, &buffer, sizeof(buffer));
-                if (rc == 0) { // the client disconnected normally
-                    printf("Clean board %d after disconnected from client.\n", i);
-                    close(boardInfo[i].sd); // close the socket
-                    initBoardInfo(&boardInfo[i]);
-                    initBoard(boards[i]);
-                    continue;
-                }
-                if (rc < 0) {
-                    perror("Fail to read: ");
-                    continue;
-                }
-                if (rc < BUFFER_SIZE) {
-                    printf("Received only %d bytes. (should have received %d bytes)\n", rc, BUFFER_SIZE);
-                    continue;
-                }
-                processBuffer((uint8_t) i, buffer, boards);
-            }
-        }
-    }
-}
+#include <poll.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+
+#include "tictactoe.h"
+
+
+/*
+ * a connection waiting for a board, in a doubly linked list so that one
+ * that hangs up leaves it in O(1) from wherever it is
+ */
+struct waiter {
+    int sd;  // -1 while the node is free
+    struct waiter *next;  // towards the back of the waitlist, or the next free node
+    struct waiter *prev;
+};
+
+
+/*
+ * a connection on its way to the loop of the detached game its RESUME
+ * names, or of the recovered game its RECONNECT claimed, with the bytes
+ * it had received after that frame and those not yet sent to it
+ */
+struct handoff {
+    int sd;
+    uint8_t frame[BUFFER_SIZE];  // the RESUME or RECONNECT
+    struct connection_buffers *buffers;  // what the connection received and has yet to send, NULL if it had no slot
+    int recvDone;  // io_uring: the old loop's multishot recv has ended
+    struct event_loop *owner;  // of the game, or of its replica on a standby
+    struct detached_game *recovered;  // the game a RECONNECT claimed, else NULL
+    struct handoff *next;
+};
+
+
+/*
+ * One event loop per worker thread. Each owns its listening socket, its
+ * epoll instance and its shard of the session table, so the move path
+ * never touches another thread's state.
+ */
+struct event_loop {
+    int id;
+    int epfd;
+    int sd_stream;
+    int sd_dgram;  // only the first loop answers multicast, -1 elsewhere
+    long portNumber;
+    struct session_table sessions;
+    struct timer_wheel wheel;
+    uint64_t now;  // monotonic ms, refreshed after every wakeup
+    struct board_info **dirty;  // games with output queued this iteration
+    uint32_t dirtyCount;
+    int engine;  // ENGINE_EPOLL, or ENGINE_URING once its ring is set up
+    struct uring uring;
+    uint64_t receivedNs;  // when the bytes being processed arrived
+    struct loop_stats stats;
+    struct snapshot snapshot;  // header is NULL when games are not snapshotted
+    struct replica_stream replica;  // sd is -1 when games are not replicated
+    uint64_t nextSweepMs;  // when to send all live games to the standby again
+    uint64_t secretState;  // xorshift state for session token secrets
+    struct waiter *waiters;  // waitCapacity nodes, NULL when connections are turned away instead
+    uint32_t waitCapacity;
+    uint32_t waitCount;
+    struct waiter *waitFront;  // waited longest
+    struct waiter *waitBack;
+    struct waiter *waitFree;
+    int mailFd;  // eventfd, written whenever other threads leave work for this loop
+    pthread_mutex_t mailLock;  // guards handoffs and inbox
+    struct handoff *handoffs;  // connections posted by any loop, taken by this one
+    struct game_record *inbox;  // records from the standby's replication thread
+    uint32_t inboxCount;
+    struct replica_table standby;  // replicas is NULL unless the server is a standby
+    pthread_t thread;
+};
+
+// io_uring requests carry their kind in the low 3 bits of user_data; those
+// for a game also carry its slot (high 32 bits) and generation (the rest),
+// those for a waiting connection its node and its socket
+#define REQ_ACCEPT 0
+#define REQ_MULTICAST 1
+#define REQ_RECV 2
+#define REQ_SEND 3
+#define REQ_WAITER 4
+#define REQ_MAIL 5
+#define REQ_CANCEL 6
+#define REQ_KIND_BITS 3
+#define REQ_KIND_MASK 0x7
+#define REQ_GENERATION_MASK 0x1fffffff
+
+// records a standby loop holds in its inbox between two wakeups, more are
+// dropped until the primary's next sweep
+#define REPLICA_INBOX 4096
+
+static struct event_loop *loops;
+static int loopCount;
+static __thread struct event_loop *loop;  // the loop of the calling thread
+static int aiLevel = AI_HARD;
+static uint32_t timeoutMs = TIME_LIMIT_SERVER * 1000;
+
+/*
+ * A game recovered from a snapshot waits in its old slot, without a
+ * socket, for its client to RECONNECT. The client may land on any loop,
+ * so the recovered games are listed here, by loop then slot, and indexed
+ * by what a RECONNECT tells of them, see claimDetachedGame; both are
+ * built before the loops start and only claimed changes afterwards.
+ */
+struct detached_game {
+    int loopId;
+    uint32_t slot;
+    uint8_t claimed;  // by the first RECONNECT or by expiry, given back if that RECONNECT goes astray
+    uint32_t next;  // index of the next game in its detachedIndex chain, plus 1, 0 at the end
+    struct game_record record;
+};
+
+static struct detached_game *detached;
+static uint32_t detachedCount;
+
+// the gameId byte of a RECONNECT and the 9 squares of its X marks
+#define DETACHED_INDEX_BITS 17
+
+// the first game of each chain, plus 1, 0 for none
+static uint32_t *detachedIndex;
+
+void queueSend(struct board_info *boardInfoPtr);
+void processBuffer(struct board_info *boardInfoPtr, const uint8_t buffer[BUFFER_SIZE]);
+void processMuxFrame(struct board_info *channelPtr, const uint8_t buffer[BUFFER_SIZE]);
+void admitWaiting();
+int armRecv(struct board_info *boardInfoPtr);
+uint64_t requestTag(int kind, const struct board_info *boardInfoPtr);
+void writeToken(uint8_t token[TOKEN_SIZE], const struct board_info *boardInfoPtr);
+void startHandoff(struct board_info *boardInfoPtr, const uint8_t buffer[BUFFER_SIZE], struct event_loop *owner,
+                  struct detached_game *recovered);
+void unclaimDetachedGame(struct detached_game *game);
+int skipWaitlist(int connected_sd, struct waiter *waiter);
+struct event_loop *replicaOwner(const uint8_t token[TOKEN_SIZE]);
+
+
+/*
+ * the version to answer a game with: whatever its client negotiated,
+ * or the legacy version before the first valid frame arrived
+ */
+uint8_t sessionVersion(const struct board_info *boardInfoPtr) {
+    return boardInfoPtr->version ? boardInfoPtr->version : VERSION;
+}
+
+
+/*
+ * the slot that owns the socket of a game: its VERSION_MUX connection,
+ * or the game itself
+ */
+struct board_info *connectionOf(struct board_info *boardInfoPtr) {
+    return (boardInfoPtr->channel != NULL) ? boardInfoPtr->channel : boardInfoPtr;
+}
+
+
+/*
+ * 1 if a game can be snapshotted and replicated: a 3×3 game on a
+ * connection of its own, which is what a RECONNECT can continue
+ */
+int isRecorded(const struct board_info *boardInfoPtr) {
+    return boardInfoPtr->version != VERSION_MUX && boardInfoPtr->variant == VARIANT_CLASSIC;
+}
+
+
+/*
+ * the record of a game isRecorded, with its session token if it has one
+ */
+void recordSession(struct game_record *record, const struct board_info *boardInfoPtr, uint8_t state) {
+    uint8_t token[TOKEN_SIZE];
+    writeToken(token, boardInfoPtr);
+    fillRecord(record, boardInfoPtr, state, boardInfoPtr->secret ? token : NULL);
+}
+
+
+/*
+ * put a recorded game back into a slot: the frame it last sent is sent
+ * again under the slot's gameId, should a duplicate ask for it
+ */
+void restoreRecord(struct board_info *boardInfoPtr, const struct game_record *record) {
+    boardInfoPtr->board = record->board;
+    boardInfoPtr->sequenceNum = record->sequenceNum;
+    boardInfoPtr->version = record->version;
+    memcpy(boardInfoPtr->bufferSend, record->lastFrame, COMPACT_FRAME_SIZE);
+    uint32_t gameId, sequenceNum;
+    readFrameIds(boardInfoPtr->bufferSend, &gameId, &sequenceNum);
+    writeFrameIds(boardInfoPtr->bufferSend, boardInfoPtr->gameId, sequenceNum);
+}
+
+
+/*
+ * return 1 if choice is a free square of the game's board, else return 0
+ */
+int isSessionMoveValid(const struct board_info *boardInfoPtr, int choice) {
+    if (boardInfoPtr->variant == VARIANT_CLASSIC) return isMoveValid(&boardInfoPtr->board, choice);
+    return variants[boardInfoPtr->variant].isMoveValid(boardInfoPtr->wide, choice);
+}
+
+
+/*
+ * checkWin on the game's board
+ */
+int checkSessionWin(const struct board_info *boardInfoPtr, char mark) {
+    if (boardInfoPtr->variant == VARIANT_CLASSIC) return checkWin(&boardInfoPtr->board, mark);
+    return checkWideWin(boardInfoPtr->wide, mark);
+}
+
+
+/*
+ * restart the idle timer of a game
+ */
+void touchSession(struct board_info *boardInfoPtr) {
+    armTimer(&loop->wheel, &boardInfoPtr->timer, loop->now + timeoutMs);
+}
+
+
+
+/*
+ * give a slot back to the session table, which starts the game of the
+ * connection that has waited longest for one
+ */
+void freeSession(struct board_info *boardInfoPtr) {
+    releaseSession(&loop->sessions, boardInfoPtr);
+    admitWaiting();
+}
+
+
+/*
+ * close a game's socket and give its slot back to the session table.
+ * Whatever is still queued, typically the frame ending the game, is
+ * written first if the socket takes it.
+ */
+void cleanSession(struct board_info *boardInfoPtr) {
+    cancelTimer(&loop->wheel, &boardInfoPtr->timer);
+    if (boardInfoPtr->handoff != NULL) unclaimDetachedGame(boardInfoPtr->handoff->recovered);
+    free(boardInfoPtr->handoff);
+    boardInfoPtr->handoff = NULL;
+    // the games of a VERSION_MUX connection end with it
+    while (boardInfoPtr->channel == NULL && boardInfoPtr->muxNext != NULL)
+        cleanSession(boardInfoPtr->muxNext);
+    if (loop->snapshot.header != NULL && isRecorded(boardInfoPtr))
+        clearRecord(&loop->snapshot, boardInfoPtr->gameId - loop->sessions.firstGameId);
+    if (loop->replica.sd >= 0 && isRecorded(boardInfoPtr)) {
+        struct game_record record;
+        recordSession(&record, boardInfoPtr, RECORD_FREE);
+        replicateRecord(&loop->replica, &record);
+    }
+    if (boardInfoPtr->channel != NULL) {  // the socket belongs to the connection
+        boardInfoPtr->muxPrev->muxNext = boardInfoPtr->muxNext;
+        if (boardInfoPtr->muxNext != NULL) boardInfoPtr->muxNext->muxPrev = boardInfoPtr->muxPrev;
+        boardInfoPtr->channel = NULL;
+        freeSession(boardInfoPtr);
+        return;
+    }
+    if (boardInfoPtr->sd < 0) {  // detached, its socket is gone already
+        freeSession(boardInfoPtr);
+        return;
+    }
+    if (boardInfoPtr->buffers != NULL && boardInfoPtr->overflow == 0 && boardInfoPtr->sending == 0)
+        flushOutQueue(boardInfoPtr->sd, &boardInfoPtr->buffers->outQueue);
+    // io_uring holds its own reference to the socket, shutting it down
+    // is what ends the multishot recv armed on it
+    if (loop->engine == ENGINE_URING) shutdown(boardInfoPtr->sd, SHUT_RDWR);
+    close(boardInfoPtr->sd);
+    freeSession(boardInfoPtr);
+}
+
+
+/*
+ * Function: detachSession
+ * ----------------------------
+ *   Close the socket of a game that has lost its client but keep the game,
+ *   so that its client can RESUME it on a new connection with its session
+ *   token. A game without a token is cleaned instead. A detached game
+ *   expires like an idle one unless another connection claims it first.
+ */
+void detachSession(struct board_info *boardInfoPtr) {
+    if (boardInfoPtr->secret == 0 || boardInfoPtr->overflow) {
+        cleanSession(boardInfoPtr);
+        return;
+    }
+    if (loop->engine == ENGINE_URING) shutdown(boardInfoPtr->sd, SHUT_RDWR);
+    close(boardInfoPtr->sd);
+    boardInfoPtr->dirty = 0;
+    boardInfoPtr->sending = 0;
+    boardInfoPtr->resendCount = 0;
+    releaseBuffers(&loop->sessions, boardInfoPtr);
+    touchSession(boardInfoPtr);
+    // other loops check the tokens they are given against it
+    __atomic_store_n(&boardInfoPtr->sd, -1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * give a game a new session token secret, never 0
+ */
+void issueToken(struct board_info *boardInfoPtr) {
+    uint32_t secret;
+    do {
+        loop->secretState ^= loop->secretState << 13;
+        loop->secretState ^= loop->secretState >> 7;
+        loop->secretState ^= loop->secretState << 17;
+        secret = (uint32_t) (loop->secretState >> 32);
+    } while (secret == 0);
+    __atomic_store_n(&boardInfoPtr->secret, secret, __ATOMIC_RELAXED);
+}
+
+
+void writeToken(uint8_t token[TOKEN_SIZE], const struct board_info *boardInfoPtr) {
+    uint32_t slot = boardInfoPtr->gameId - loop->sessions.firstGameId;
+    token[0] = (uint8_t) loop->id;
+    token[1] = (uint8_t) (slot >> 16);
+    token[2] = (uint8_t) (slot >> 8);
+    token[3] = (uint8_t) slot;
+    token[4] = (uint8_t) (boardInfoPtr->secret >> 24);
+    token[5] = (uint8_t) (boardInfoPtr->secret >> 16);
+    token[6] = (uint8_t) (boardInfoPtr->secret >> 8);
+    token[7] = (uint8_t) boardInfoPtr->secret;
+}
+
+
+/*
+ * read the loop id, slot and secret of a session token, see writeToken
+ */
+void readToken(const uint8_t token[TOKEN_SIZE], int *loopIdPtr, uint32_t *slotPtr, uint32_t *secretPtr) {
+    *loopIdPtr = token[0];
+    *slotPtr = (uint32_t) token[1] << 16 | (uint32_t) token[2] << 8 | token[3];
+    *secretPtr = (uint32_t) token[4] << 24 | (uint32_t) token[5] << 16 | (uint32_t) token[6] << 8 | token[7];
+}
+
+
+/*
+ * Function: isTokenDetached
+ * ----------------------------
+ *   Check whether a session token names a detached game, which may belong
+ *   to any loop. The token is the index itself: its loop id and slot find
+ *   the game in O(1), its secret proves the game is still the one the
+ *   token was issued for. Only the loop that owns the game can be sure,
+ *   the game may expire right after, so this only spares that loop the
+ *   connections it would turn away.
+ */
+int isTokenDetached(const uint8_t token[TOKEN_SIZE]) {
+    int loopId;
+    uint32_t slot, secret;
+    readToken(token, &loopId, &slot, &secret);
+    if (loopId >= loopCount || slot >= loops[loopId].sessions.capacity || secret == 0) return 0;
+
+    const struct board_info *detachedPtr = &loops[loopId].sessions.slots[slot];
+    return __atomic_load_n(&detachedPtr->secret, __ATOMIC_RELAXED) == secret
+           && __atomic_load_n(&detachedPtr->sd, __ATOMIC_RELAXED) < 0;
+}
+
+
+/*
+ * record the state of a game in the snapshot and send it to the standby,
+ * for those that are configured and games that isRecorded
+ */
+void saveSession(const struct board_info *boardInfoPtr) {
+    if (isRecorded(boardInfoPtr) == 0 || (loop->snapshot.header == NULL && loop->replica.sd < 0)) return;
+    struct game_record record;
+    recordSession(&record, boardInfoPtr, RECORD_LIVE);
+    if (loop->snapshot.header != NULL)
+        saveRecord(&loop->snapshot, boardInfoPtr->gameId - loop->sessions.firstGameId, &record);
+    if (loop->replica.sd >= 0) replicateRecord(&loop->replica, &record);
+}
+
+
+/*
+ * how long a loop may block: until its next timer, or its next sweep
+ * when it replicates games or keeps replicas
+ */
+int loopWaitMs() {
+    int waitMs = nextTimeout(&loop->wheel);
+    if (waitMs < 0 || waitMs > TIME_LIMIT_SERVER * 1000) waitMs = TIME_LIMIT_SERVER * 1000;
+    if (loop->replica.sd < 0 && loop->standby.replicas == NULL) return waitMs;
+    const uint64_t now = monotonicMs();
+    const int sweepMs = (loop->nextSweepMs > now) ? (int) (loop->nextSweepMs - now) : 0;
+    return (sweepMs < waitMs) ? sweepMs : waitMs;
+}
+
+
+/*
+ * once per REPLICA_SWEEP_MS, forget the replicated games the primary
+ * stopped refreshing and send every live game to the standby again
+ */
+void sweepReplica() {
+    if (loop->now < loop->nextSweepMs) return;
+    loop->nextSweepMs = loop->now + REPLICA_SWEEP_MS;
+    if (loop->standby.replicas != NULL) expireReplicas(&loop->standby, loop->now);
+    if (loop->replica.sd < 0) return;
+    for (uint32_t slot = 0; slot < loop->sessions.used; slot++) {
+        const struct board_info *boardInfoPtr = &loop->sessions.slots[slot];
+        if (boardInfoPtr->sd != 0) saveSession(boardInfoPtr);
+    }
+}
+
+
+uint32_t detachedKey(uint8_t gameId, uint16_t x) {
+    return (uint32_t) gameId << (ROWS * COLUMNS) | (x & ((1u << (ROWS * COLUMNS)) - 1));
+}
+
+
+/*
+ * index every recovered game by the gameId byte and the X marks of its
+ * record, once they are all listed
+ */
+void indexDetached() {
+    if (detachedCount == 0) return;
+    detachedIndex = calloc((size_t) 1 << DETACHED_INDEX_BITS, sizeof(uint32_t));
+    if (detachedIndex == NULL) {
+        logErrno(LOG_ERROR, "Failed to index recovered games, none can be reconnected to");
+        return;
+    }
+    for (uint32_t i = 0; i < detachedCount; i++) {
+        uint32_t key = detachedKey((uint8_t) detached[i].record.gameId, detached[i].record.board.x);
+        detached[i].next = detachedIndex[key];
+        detachedIndex[key] = i + 1;
+    }
+}
+
+
+/*
+ * Function: claimDetachedGame
+ * ----------------------------
+ *   Find the recovered game a RECONNECT continues and claim it, so no
+ *   other connection can. The record of that game has the same gameId
+ *   byte and the client's X marks, but for the one move the server may
+ *   not have seen: at most 10 chains of detachedIndex are looked at,
+ *   whatever the number of recovered games.
+ *
+ *   gameId: the gameId byte of the RECONNECT
+ *
+ *   board: the board sent by the client
+ *
+ *   gamePtr: set to the claimed game
+ *
+ *   return: -1 if no recovered game matches, else what matchRecord says
+ */
+int claimDetachedGame(uint8_t gameId, const struct bitboard *board, struct detached_game **gamePtr) {
+    if (detachedIndex == NULL) return -1;
+    // the client's X marks, then each of them less one of its moves
+    uint16_t x = board->x, unseen = 0, moves = board->x;
+    for (;;) {
+        for (uint32_t i = detachedIndex[detachedKey(gameId, x & ~unseen)]; i != 0; i = detached[i - 1].next) {
+            struct detached_game *game = &detached[i - 1];
+            if (__atomic_load_n(&game->claimed, __ATOMIC_RELAXED)) continue;
+            int replay = matchRecord(&game->record, board);
+            if (replay < 0) continue;
+
+            uint8_t unclaimed = 0;
+            if (__atomic_compare_exchange_n(&game->claimed, &unclaimed, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                *gamePtr = game;
+                return replay;
+            }
+        }
+        if (moves == 0) return -1;
+        unseen = moves & -moves;
+        moves &= moves - 1;
+    }
+}
+
+
+void unclaimDetachedGame(struct detached_game *game) {
+    if (game != NULL) __atomic_store_n(&game->claimed, 0, __ATOMIC_RELEASE);
+}
+
+
+int compareDetached(const void *a, const void *b) {
+    const struct detached_game *x = a, *y = b;
+    if (x->loopId != y->loopId) return x->loopId - y->loopId;
+    return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+
+/*
+ * the detached list entry of a recovered game of the calling loop
+ */
+struct detached_game *findDetached(const struct board_info *boardInfoPtr) {
+    struct detached_game key = {loop->id, boardInfoPtr->gameId - loop->sessions.firstGameId};
+    return bsearch(&key, detached, detachedCount, sizeof(struct detached_game), compareDetached);
+}
+
+
+/*
+ * claim a recovered game of the calling loop by its detached list entry,
+ * so that no RECONNECT can; return 0 if one has already
+ */
+int claimRecoveredGame(const struct board_info *boardInfoPtr) {
+    struct detached_game *game = findDetached(boardInfoPtr);
+    uint8_t unclaimed = 0;
+    return game == NULL
+           || __atomic_compare_exchange_n(&game->claimed, &unclaimed, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Function: flushSessions
+ * ----------------------------
+ *   Hand the output queued during this loop iteration to the kernel, one
+ *   sendmsg per game, or one io_uring send submitted with everything
+ *   else. Games that let their queue overflow are dropped here rather
+ *   than being allowed to stall the loop.
+ */
+void flushSessions() {
+    uint64_t now = (loop->dirtyCount > 0) ? monotonicNs() : 0;
+    for (uint32_t i = 0; i < loop->dirtyCount; i++) {
+        struct board_info *boardInfoPtr = loop->dirty[i];
+        // a slot can be listed twice if it was released and reused
+        if (boardInfoPtr->dirty == 0 || boardInfoPtr->sd <= 0) continue;
+        boardInfoPtr->dirty = 0;
+
+        if (boardInfoPtr->overflow) {
+            LOG(LOG_WARN, "Board[%u] is not reading its replies, disconnect.\n", boardInfoPtr->gameId);
+            COUNT_STAT(&loop->stats, STAT_SLOW_CONSUMERS);
+            cleanSession(boardInfoPtr);
+            continue;
+        } else if (loop->engine == ENGINE_URING) {
+            queueSend(boardInfoPtr);
+        } else if (flushOutQueue(boardInfoPtr->sd, &boardInfoPtr->buffers->outQueue) == 0) {
+            LOG(LOG_INFO, "Detach board %u after a failed send.\n", boardInfoPtr->gameId);
+            detachSession(boardInfoPtr);
+            continue;
+        }
+        // a move is answered once its reply leaves the loop
+        if (boardInfoPtr->receivedNs != 0) {
+            recordValue(&loop->stats.moveLatency, (now - boardInfoPtr->receivedNs) / 1000);
+            boardInfoPtr->receivedNs = 0;
+        }
+    }
+    loop->dirtyCount = 0;
+    if (loop->replica.sd >= 0) flushReplicaStream(&loop->replica);
+}
+
+
+/*
+ * remember that a game has output to flush at the end of this iteration
+ */
+void markDirty(struct board_info *boardInfoPtr) {
+    if (boardInfoPtr->dirty) return;
+    if (loop->dirtyCount == loop->sessions.capacity) flushSessions();
+    boardInfoPtr->dirty = 1;
+    loop->dirty[loop->dirtyCount++] = boardInfoPtr;
+}
+
+
+/*
+ * the frames of this loop that a duplicate never gets again, errors above
+ * all, so that they leave the bufferSend of their game alone. Like
+ * bufferSend, it only holds the header of a frame.
+ */
+static __thread uint8_t controlFrame[COMPACT_FRAME_SIZE];
+
+// a legacy frame of this loop, its header copied in front of zeros that
+// are never written
+static __thread uint8_t legacyFrame[BUFFER_SIZE];
+
+
+/*
+ * queue the frame whose header is sb on the connection of a game; once
+ * the game has a session token, every frame carries it
+ */
+void queueFrameBytes(struct board_info *boardInfoPtr, uint8_t sb[COMPACT_FRAME_SIZE]) {
+    const int len = frameLength(sb[0]);
+    struct board_info *connectionPtr = connectionOf(boardInfoPtr);
+    if (connectionPtr->buffers == NULL) return;  // detached, there is no one to send it to
+
+    uint32_t gameId, sequenceNum;
+    readFrameIds(sb, &gameId, &sequenceNum);
+    LOG(LOG_DEBUG, "SEND choice: %d status: %d statusModifier: %d "
+           "gameType: %d gameId: %u sequenceNum: %u\n",
+           sb[1], sb[2], sb[3], sb[4], gameId, sequenceNum);
+
+    if (boardInfoPtr->secret != 0) writeToken(sb + TOKEN_OFFSET, boardInfoPtr);
+    if (len > COMPACT_FRAME_SIZE) {
+        memcpy(legacyFrame, sb, COMPACT_FRAME_SIZE);
+        sb = legacyFrame;
+    }
+    // a VERSION_MUX connection may have more replies in one iteration than
+    // the queue holds, so only a socket that takes none of them overflows
+    if (queueBytes(&connectionPtr->buffers->outQueue, sb, (uint32_t) len) == 0
+        && (connectionPtr->sending != 0 || connectionPtr->sd <= 0
+            || flushOutQueue(connectionPtr->sd, &connectionPtr->buffers->outQueue) == 0
+            || queueBytes(&connectionPtr->buffers->outQueue, sb, (uint32_t) len) == 0))
+        connectionPtr->overflow = 1;
+    markDirty(connectionPtr);
+}
+
+
+/*
+ * Function: queueFrame
+ * ----------------------------
+ *   Queue the frame in a game's bufferSend instead of writing it right
+ *   away; it stays there for resends, so only the frames a duplicate
+ *   should get again are built in it: the answer to NEW_GAME, the
+ *   server's moves and the end of the game.
+ *
+ *   Frames are built in place: bufferSend is the game's frame template,
+ *   only its header bytes change from one frame to the next, so nothing is
+ *   cleared or copied to build a reply. It holds nothing past the header,
+ *   the zero tail of a legacy frame is added by queueFrameBytes.
+ *
+ *   boardInfoPtr: the game, only the first frameLength(bufferSend[0]) bytes are sent
+ */
+void queueFrame(struct board_info *boardInfoPtr) {
+    queueFrameBytes(boardInfoPtr, boardInfoPtr->bufferSend);
+}
+
+
+/*
+ * queue a frame that is not to be resent, an error typically, built in
+ * the loop's controlFrame instead of the game's bufferSend
+ */
+void queueControlFrame(
+        struct board_info *boardInfoPtr,
+        uint8_t version,
+        uint8_t status,
+        uint8_t statusModifier,
+        uint32_t gameId,
+        uint32_t sequenceNum) {
+
+    // the ids and token of the last control frame, whatever game it was for
+    memset(controlFrame + MUX_GAME_ID_OFFSET, 0, COMPACT_FRAME_SIZE - MUX_GAME_ID_OFFSET);
+    writeFrameHeader(controlFrame, version, 0, status, statusModifier, MOVE, gameId, sequenceNum);
+    queueFrameBytes(boardInfoPtr, controlFrame);
+}
+
+
+/*
+ * queue a MALFORMED_REQUEST error for a game and count it under reason,
+ * one of the STAT_MALFORMED_* counters
+ */
+void queueInvalidRequest(struct board_info *boardInfoPtr, uint32_t sendSequenceNum, int reason) {
+    COUNT_STAT(&loop->stats, reason);
+    queueControlFrame(boardInfoPtr, sessionVersion(boardInfoPtr), GAME_ERROR, MALFORMED_REQUEST,
+                      boardInfoPtr->gameId, sendSequenceNum);
+}
+
+
+/*
+ * queue an error for a frame of a VERSION_MUX connection that none of its
+ * games can take, naming the gameId the frame named
+ */
+void queueMuxError(
+        struct board_info *channelPtr,
+        uint8_t statusModifier,
+        uint32_t gameId,
+        uint32_t sendSequenceNum) {
+
+    queueControlFrame(channelPtr, VERSION_MUX, GAME_ERROR, statusModifier, gameId, sendSequenceNum);
+}
+
+
+/*
+ * play the server's next move and queue the frame announcing it
+ */
+void queueMove(struct board_info *boardInfoPtr, uint8_t choice, uint32_t sendSequenceNum) {
+    connectionOf(boardInfoPtr)->receivedNs = loop->receivedNs;
+    uint8_t *sb = boardInfoPtr->bufferSend;
+    if (boardInfoPtr->variant == VARIANT_CLASSIC)
+        buildMoveFrame(
+                sb, sessionVersion(boardInfoPtr), choice, boardInfoPtr->gameId,
+                sendSequenceNum, &boardInfoPtr->board, SERVER_MARK);
+    else
+        buildWideMoveFrame(
+                sb, sessionVersion(boardInfoPtr), &variants[boardInfoPtr->variant], choice,
+                boardInfoPtr->gameId, sendSequenceNum, boardInfoPtr->wide, SERVER_MARK);
+    queueFrame(boardInfoPtr);
+}
+
+
+uint8_t serverMakeChoice(const struct board_info *boardInfoPtr) {
+    if (boardInfoPtr->variant == VARIANT_CLASSIC) return aiChooseMove(&boardInfoPtr->board, aiLevel);
+    return variants[boardInfoPtr->variant].chooseMove(boardInfoPtr->wide);
+}
+
+
+void receiveNewGame(
+        struct board_info *boardInfoPtr,
+        uint8_t variant,
+        uint32_t recvSequenceNum,
+        uint32_t sendSequenceNum,
+        uint32_t nextRecvSequenceNum) {
+
+    const int order = compareSequence(boardInfoPtr->version, recvSequenceNum, boardInfoPtr->sequenceNum);
+
+    // check sequence number
+    if (order < 0) {
+        // receiving a duplicate packet means that the other
+        // side might not have received my last msg, so do a resend
+        // and skip the next move input
+        if (boardInfoPtr->resendCount < MAX_TRY) {
+            LOG(LOG_WARN, "Received a duplicate packet, resend last msg.\n");
+            boardInfoPtr->resendCount++;
+            COUNT_STAT(&loop->stats, STAT_RESENDS);
+            queueFrame(boardInfoPtr);
+            touchSession(boardInfoPtr);
+        } else
+            LOG(LOG_WARN, "Received a duplicate packet, run out of resend chances, exit game.\n");
+        return;
+    }
+    if (order > 0) {
+        LOG(LOG_WARN, "Packets arrived out of order. "
+               "Received sequence number: %u, expected: %u.\n",
+               recvSequenceNum, boardInfoPtr->sequenceNum);
+
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_SEQUENCE);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    if (variant >= VARIANT_COUNT) {
+        LOG(LOG_WARN, "Received invalid board variant: %d.\n", variant);
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_VARIANT);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    // only the games of the larger variants have a wideboard
+    if (variant != VARIANT_CLASSIC && boardInfoPtr->wide == NULL
+        && (boardInfoPtr->wide = malloc(sizeof(struct wideboard))) == NULL) {
+        logErrno(LOG_ERROR, "Failed to allocate a wideboard");
+        queueControlFrame(boardInfoPtr, sessionVersion(boardInfoPtr), GAME_ERROR, OUT_OF_RESOURCES,
+                          boardInfoPtr->gameId, sendSequenceNum);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    // update boardInfo
+    boardInfoPtr->sequenceNum = nextRecvSequenceNum;
+    boardInfoPtr->variant = variant;
+    if (variant != VARIANT_CLASSIC) initWideBoard(boardInfoPtr->wide);
+    touchSession(boardInfoPtr);
+    COUNT_STAT(&loop->stats, STAT_GAMES_STARTED);
+    // games of a VERSION_MUX connection end with it, there is nothing to resume
+    if (boardInfoPtr->channel == NULL) issueToken(boardInfoPtr);
+
+    // send game id and session token to client, and the variant it got
+    writeFrameHeader(boardInfoPtr->bufferSend, sessionVersion(boardInfoPtr), variant, GAME_ON, 0, MOVE,
+                     boardInfoPtr->gameId, sendSequenceNum);
+    queueFrame(boardInfoPtr);
+}
+
+/*
+ * read the board of a RECONNECT, return 1 if a game can reach it, else 0
+ */
+int readReconnectBoard(const uint8_t buffer[BUFFER_SIZE], struct bitboard *board) {
+    initBoard(board);
+    for (int i=0; i<ROWS*COLUMNS; i++) {
+        if (buffer[7+i] == 2)
+            placeMark(board, i+1, SERVER_MARK);
+        else if (buffer[7+i] == 1)
+            placeMark(board, i+1, CLIENT_MARK);
+        else if (buffer[7+i] != 0) {
+            LOG(LOG_WARN, "Received invalid square value: %d.\n", buffer[7+i]);
+            return 0;
+        }
+    }
+    if (isPositionLegal(board) == 0) {
+        LOG(LOG_WARN, "Received a board that cannot be reached in a game.\n");
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * Function: answerReconnect
+ * ----------------------------
+ *   Go on with the board a RECONNECT brought, now in the game's slot
+ *
+ *   replay: the server's move the client lost, to send again, else 0
+ */
+void answerReconnect(struct board_info *boardInfoPtr, uint32_t sendSequenceNum, int replay) {
+    logBoard(&boardInfoPtr->board, SERVER_MARK);
+    int result = checkWin(&boardInfoPtr->board, CLIENT_MARK);
+    if (result == GAME_ON) {
+        touchSession(boardInfoPtr);
+        issueToken(boardInfoPtr);
+        uint8_t newChoice = (replay > 0) ? (uint8_t) replay : serverMakeChoice(boardInfoPtr);
+        queueMove(boardInfoPtr, newChoice, sendSequenceNum);
+        return;
+    }
+
+    uint8_t sm;
+    if (result == WIN) {
+        LOG(LOG_INFO, "You lose.\n");
+        sm = LOSE;
+    } else {
+        LOG(LOG_INFO, "Draw.\n");
+        sm = DRAW;
+    }
+    writeFrameHeader(boardInfoPtr->bufferSend, sessionVersion(boardInfoPtr), 0, GAME_COMPLETE, sm, END_GAME,
+                     boardInfoPtr->gameId, sendSequenceNum);
+    queueFrame(boardInfoPtr);
+
+    LOG(LOG_INFO, "Clean board %u after game completed.\n", boardInfoPtr->gameId);
+    COUNT_STAT(&loop->stats, STAT_GAMES_COMPLETED);
+    cleanSession(boardInfoPtr);
+}
+
+
+/*
+ * Function: receiveReconnect
+ * ----------------------------
+ *   Continue a game from the board the client sends. A game the server
+ *   recovered from its snapshot is continued in the slot it was restored
+ *   to: the connection is handed over to the loop that owns it, which
+ *   answers the RECONNECT, see resumeHandoff. Any other board is trusted
+ *   and played on in this slot.
+ */
+void receiveReconnect(
+        struct board_info *boardInfoPtr,
+        uint32_t sendSequenceNum,
+        const uint8_t buffer[BUFFER_SIZE]) {
+
+    LOG(LOG_DEBUG, "RECONNECT\n");
+
+    // a RECONNECT carries a 3×3 board
+    boardInfoPtr->variant = VARIANT_CLASSIC;
+    if (readReconnectBoard(buffer, &boardInfoPtr->board) == 0) {
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_BOARD);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    // a connection that plays a game already keeps it
+    struct detached_game *recovered;
+    if (boardInfoPtr->secret == 0 && claimDetachedGame(buffer[5], &boardInfoPtr->board, &recovered) >= 0) {
+        startHandoff(boardInfoPtr, buffer, &loops[recovered->loopId], recovered);
+        return;
+    }
+    answerReconnect(boardInfoPtr, sendSequenceNum, 0);
+}
+
+
+/*
+ * Function: receiveResume
+ * ----------------------------
+ *   Continue the game of a session token on this connection. The game
+ *   stays in its slot, on the loop that owns it, and keeps its gameId:
+ *   the connection is handed over to that loop, which answers the RESUME,
+ *   see resumeHandoff. On a standby, a token it did not issue may be that
+ *   of a replicated game, kept by the loop replicaOwner names.
+ */
+void receiveResume(
+        struct board_info *boardInfoPtr,
+        uint32_t sendSequenceNum,
+        const uint8_t buffer[BUFFER_SIZE]) {
+
+    LOG(LOG_DEBUG, "RESUME\n");
+
+    if (boardInfoPtr->secret != 0) {
+        LOG(LOG_WARN, "Received RESUME for a connection that has a game.\n");
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_GAME_TYPE);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    const uint8_t *token = buffer + TOKEN_OFFSET;
+    if (isTokenDetached(token)) {
+        startHandoff(boardInfoPtr, buffer, &loops[token[0]], NULL);
+        return;
+    }
+    if (loop->standby.replicas != NULL) {
+        startHandoff(boardInfoPtr, buffer, replicaOwner(token), NULL);
+        return;
+    }
+    LOG(LOG_INFO, "Received an unknown session token.\n");
+    queueControlFrame(boardInfoPtr, sessionVersion(boardInfoPtr), GAME_ERROR, UNKNOWN_SESSION,
+                      boardInfoPtr->gameId, sendSequenceNum);
+    touchSession(boardInfoPtr);
+}
+
+
+void receiveMove(
+        struct board_info *boardInfoPtr,
+        uint32_t sendSequenceNum,
+        const uint8_t buffer[BUFFER_SIZE]) {
+
+    const uint8_t recvStatus = buffer[2];
+    const uint8_t statusModifier = buffer[3];
+    if (recvStatus < 0 || recvStatus > 2) {
+        LOG(LOG_WARN, "Received invalid game status: %d.\n", recvStatus);
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_STATUS);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    if (recvStatus == GAME_ERROR) {
+        parseGeneralError(statusModifier);
+        return;
+    }
+
+    // when recvStatus == GAME_ON or GAME_COMPLETE
+
+    // check if move is valid
+    uint8_t choice = buffer[1];
+
+    if (isSessionMoveValid(boardInfoPtr, choice) == 0) {
+        LOG(LOG_WARN, "The opponent made an invalid move: %d.\n", choice);
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_MOVE);
+        touchSession(boardInfoPtr);
+        return;
+    }
+
+    // move is valid, update board
+    if (boardInfoPtr->variant == VARIANT_CLASSIC) {
+        placeMark(&boardInfoPtr->board, choice, CLIENT_MARK);
+        logBoard(&boardInfoPtr->board, SERVER_MARK);
+    } else {
+        variants[boardInfoPtr->variant].placeMark(boardInfoPtr->wide, choice, CLIENT_MARK);
+    }
+
+    // check local game finished
+    int result = checkSessionWin(boardInfoPtr, CLIENT_MARK);
+
+    if (recvStatus == GAME_ON) {
+        if (result == GAME_ON) {
+            touchSession(boardInfoPtr);
+            uint8_t newChoice = serverMakeChoice(boardInfoPtr);
+            queueMove(boardInfoPtr, newChoice, sendSequenceNum);
+            return;
+        }
+        LOG(LOG_WARN, "Received invalid game status: %d, expected: %d.\n", recvStatus, GAME_ON);
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_STATUS);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    // when recvStatus == GAME_COMPLETE
+    // check if local game and remote game has the same result
+    if (result != statusModifier) {
+        LOG(LOG_WARN, "Received invalid status modifier: %d. Expected: %d\n", statusModifier, result);
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_STATUS);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    uint8_t sm;
+    if (result == WIN) {
+        LOG(LOG_INFO, "You lose.\n");
+        sm = LOSE;
+    } else {
+        LOG(LOG_INFO, "Draw.\n");
+        sm = DRAW;
+    }
+    writeFrameHeader(boardInfoPtr->bufferSend, sessionVersion(boardInfoPtr), 0, GAME_COMPLETE, sm, END_GAME,
+                     boardInfoPtr->gameId, sendSequenceNum);
+    queueFrame(boardInfoPtr);
+
+    LOG(LOG_INFO, "Clean board %u after game completed.\n", boardInfoPtr->gameId);
+    COUNT_STAT(&loop->stats, STAT_GAMES_COMPLETED);
+    cleanSession(boardInfoPtr);
+}
+
+
+/*
+ * Function: processBuffer
+ * ----------------------------
+ *   process a received buffer
+ *
+ *   boardInfoPtr: the game the buffer was received for
+ *
+ *   buffer:
+ */
+void processBuffer(
+        struct board_info *boardInfoPtr,
+        const uint8_t buffer[BUFFER_SIZE]) {
+
+    // frames of a VERSION_MUX connection are addressed to one of its games
+    if (boardInfoPtr->channel == NULL && (boardInfoPtr->version == VERSION_MUX
+                                          || (boardInfoPtr->version == 0 && buffer[0] == VERSION_MUX))) {
+        processMuxFrame(boardInfoPtr, buffer);
+        return;
+    }
+
+    uint32_t gameId, recvSequenceNum;
+    readFrameIds(buffer, &gameId, &recvSequenceNum);
+
+    LOG(LOG_DEBUG, "RECEIVE choice: %d status: %d statusModifier: %d "
+           "gameType: %d gameId: %u sequenceNum: %u\n",
+           buffer[1], buffer[2], buffer[3],
+           buffer[4], gameId, recvSequenceNum);
+
+    const uint32_t idMask = frameIdMask(buffer[0]);
+    const uint32_t sendSequenceNum = (recvSequenceNum + 1) & idMask;
+    const uint32_t nextRecvSequenceNum = (sendSequenceNum + 1) & idMask;
+
+    // the first frame of a game fixes its protocol version
+    uint8_t version = buffer[0];
+    if (boardInfoPtr->version == 0 && isVersionValid(version))
+        boardInfoPtr->version = version;
+    if (version != boardInfoPtr->version) {
+        LOG(LOG_WARN, "Received invalid version number: %d.\n", version);
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_VERSION);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    // #receivedBytes and #version are correct and no timeout
+    const uint8_t gameType = buffer[4];
+    if (gameType < 0 || gameType > RESUME) {
+        LOG(LOG_WARN, "Received invalid game type: %d.\n", gameType);
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_GAME_TYPE);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    if (gameType == NEW_GAME) {
+        receiveNewGame(boardInfoPtr, buffer[1], recvSequenceNum, sendSequenceNum, nextRecvSequenceNum);
+        return;
+    }
+
+    if (gameType == RECONNECT) {
+        receiveReconnect(boardInfoPtr, sendSequenceNum, buffer);
+        return;
+    }
+
+    if (gameType == RESUME) {
+        receiveResume(boardInfoPtr, sendSequenceNum, buffer);
+        return;
+    }
+
+    // Below are the cases when gameType == END_GAME, MOVE
+    // need to check gameId, port & ip, and seqNum
+    if (gameId != (boardInfoPtr->gameId & idMask)) {
+        LOG(LOG_WARN, "Received invalid game id: %u.\n", gameId);
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_GAME_ID);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    // gameId is correct, check sequenceNum, which may have wrapped around
+    const int order = compareSequence(version, recvSequenceNum, boardInfoPtr->sequenceNum);
+    if (order < 0) {
+        // receiving a duplicate packet means that the other
+        // side might not have received my last msg, so do a resend
+        // and skip the next move input
+        if (boardInfoPtr->resendCount < MAX_TRY) {
+            LOG(LOG_WARN, "Received a duplicate packet, resend last msg.\n");
+            boardInfoPtr->resendCount++;
+            COUNT_STAT(&loop->stats, STAT_RESENDS);
+            queueFrame(boardInfoPtr);
+            touchSession(boardInfoPtr);
+            return;
+        }
+        LOG(LOG_WARN, "Received a duplicate packet, run out of resend chances, exit game.\n");
+        return;
+    }
+    if (order > 0) {
+        LOG(LOG_WARN, "Packets arrived out of order. Received sequence number: %u, expected: %u.\n",
+                recvSequenceNum, boardInfoPtr->sequenceNum);
+        queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_SEQUENCE);
+        touchSession(boardInfoPtr);
+        return;
+    }
+    // when gameId, seqNum are all correct,
+    // gameType can be END_GAME or MOVE
+    // update next expected received sequence number
+    boardInfoPtr->sequenceNum = nextRecvSequenceNum;
+
+    if (gameType == END_GAME) {
+        touchSession(boardInfoPtr);
+
+        int result = checkSessionWin(boardInfoPtr, CLIENT_MARK);
+        if (result == GAME_ON || result == WIN) {
+            LOG(LOG_WARN, "Invalid END GAME command.\n");
+            queueInvalidRequest(boardInfoPtr, sendSequenceNum, STAT_MALFORMED_STATUS);
+            touchSession(boardInfoPtr);
+            return;
+        }
+        if (result == DRAW) LOG(LOG_INFO, "Draw.\n");
+        else LOG(LOG_INFO, "You win!\n");
+
+        COUNT_STAT(&loop->stats, STAT_GAMES_COMPLETED);
+        cleanSession(boardInfoPtr);
+        return;
+    }
+
+    // when gameType == MOVE
+    receiveMove(boardInfoPtr, sendSequenceNum, buffer);
+}
+
+
+/*
+ * Function: processMuxFrame
+ * ----------------------------
+ *   Hand a frame received on a VERSION_MUX connection to the game it names.
+ *   NEW_GAME takes a fresh slot for the game; every other frame finds its
+ *   game in O(1), since a gameId is its slot in the session table.
+ *
+ *   channelPtr: the slot of the connection, which plays no game itself
+ */
+void processMuxFrame(struct board_info *channelPtr, const uint8_t buffer[BUFFER_SIZE]) {
+    uint32_t gameId, recvSequenceNum;
+    readFrameIds(buffer, &gameId, &recvSequenceNum);
+    const uint32_t sendSequenceNum = recvSequenceNum + 1;
+
+    channelPtr->version = VERSION_MUX;
+    touchSession(channelPtr);
+    if (buffer[0] != VERSION_MUX) {
+        LOG(LOG_WARN, "Received invalid version number: %d.\n", buffer[0]);
+        COUNT_STAT(&loop->stats, STAT_MALFORMED_VERSION);
+        queueMuxError(channelPtr, MALFORMED_REQUEST, gameId, sendSequenceNum);
+        return;
+    }
+
+    const uint8_t gameType = buffer[4];
+    if (gameType == NEW_GAME) {
+        struct board_info *boardInfoPtr = acquireSession(&loop->sessions);
+        if (boardInfoPtr == NULL) {
+            COUNT_STAT(&loop->stats, STAT_REJECTED);
+            queueMuxError(channelPtr, OUT_OF_RESOURCES, gameId, sendSequenceNum);
+            return;
+        }
+        boardInfoPtr->sd = channelPtr->sd;
+        boardInfoPtr->version = VERSION_MUX;
+        boardInfoPtr->channel = channelPtr;
+        boardInfoPtr->muxPrev = channelPtr;
+        boardInfoPtr->muxNext = channelPtr->muxNext;
+        if (channelPtr->muxNext != NULL) channelPtr->muxNext->muxPrev = boardInfoPtr;
+        channelPtr->muxNext = boardInfoPtr;
+        touchSession(boardInfoPtr);
+        processBuffer(boardInfoPtr, buffer);
+        return;
+    }
+
+    // games are only played over a VERSION_MUX connection, never resumed on one
+    if (gameType != MOVE && gameType != END_GAME) {
+        LOG(LOG_WARN, "Received invalid game type: %d.\n", gameType);
+        COUNT_STAT(&loop->stats, STAT_MALFORMED_GAME_TYPE);
+        queueMuxError(channelPtr, MALFORMED_REQUEST, gameId, sendSequenceNum);
+        return;
+    }
+    const uint32_t slot = gameId - loop->sessions.firstGameId;
+    if (slot >= loop->sessions.used || loop->sessions.slots[slot].channel != channelPtr) {
+        LOG(LOG_WARN, "Received invalid game id: %u.\n", gameId);
+        COUNT_STAT(&loop->stats, STAT_MALFORMED_GAME_ID);
+        queueMuxError(channelPtr, MALFORMED_REQUEST, gameId, sendSequenceNum);
+        return;
+    }
+    processBuffer(&loop->sessions.slots[slot], buffer);
+}
+
+
+/*
+ * Function: onSessionTimeout
+ * ----------------------------
+ *   Called by the timer wheel when a game has been idle for timeoutMs
+ */
+void onSessionTimeout(struct timer *timer) {
+    struct board_info *boardInfoPtr =
+            (struct board_info *) ((char *) timer - offsetof(struct board_info, timer));
+
+    // a detached game goes after as many timeouts as a connected one would
+    // be given. A recovered game is claimed first, so that no RECONNECT
+    // can; if one has claimed it already, its connection is on its way
+    // to this slot, see resumeHandoff. Other detached games have no
+    // detached list entry to look up.
+    if (boardInfoPtr->sd < 0) {
+        if (boardInfoPtr->resendCount++ < MAX_SEND_COUNT
+            || (boardInfoPtr->recovered && claimRecoveredGame(boardInfoPtr) == 0)) {
+            touchSession(boardInfoPtr);
+            return;
+        }
+        LOG(LOG_INFO, "Detached board[%u] was not resumed.\n", boardInfoPtr->gameId);
+        COUNT_STAT(&loop->stats, STAT_GAMES_TIMED_OUT);
+        cleanSession(boardInfoPtr);
+        return;
+    }
+
+    // this board is unavailable and has waited for too long
+    if (boardInfoPtr->resendCount < MAX_SEND_COUNT) {  // the server can still resend
+        LOG(LOG_INFO, "Board[%u] timeout.\n", boardInfoPtr->gameId);
+        boardInfoPtr->resendCount++;
+        touchSession(boardInfoPtr);
+    } else {  // the server can't resend any more
+        // tell the client its game has ended due to time out
+        queueControlFrame(boardInfoPtr, sessionVersion(boardInfoPtr), GAME_ERROR, TIME_OUT,
+                          boardInfoPtr->gameId,
+                          (boardInfoPtr->sequenceNum - 1) & frameIdMask(sessionVersion(boardInfoPtr)));
+
+        LOG(LOG_INFO, "Clean board[%u] after time out.\n", boardInfoPtr->gameId);
+        COUNT_STAT(&loop->stats, STAT_GAMES_TIMED_OUT);
+        cleanSession(boardInfoPtr);
+    }
+}
+
+
+/*
+ * games in progress over all loops, read without locking
+ */
+uint32_t countActiveGames() {
+    uint32_t active = 0;
+    for (int i = 0; i < loopCount; i++)
+        active += __atomic_load_n(&loops[i].sessions.active, __ATOMIC_RELAXED);
+    return active;
+}
+
+
+uint32_t countCapacity() {
+    uint32_t capacity = 0;
+    for (int i = 0; i < loopCount; i++) capacity += loops[i].sessions.capacity;
+    return capacity;
+}
+
+
+void processMulticast(int sd_dgram, long portNumber) {
+    LOG(LOG_DEBUG, "MULTICAST\n");
+
+    uint8_t bufferSend[BUFFER_SIZE] = {0};
+    uint8_t bufferRecv[BUFFER_SIZE];
+
+    bufferSend[1] = 2;
+
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+
+    int cnt = recvfrom(sd_dgram, bufferRecv, sizeof(bufferRecv), 0, (struct sockaddr *) &addr, &addrLen);
+
+    LOG(LOG_DEBUG, "RECEIVE choice: %d status: %d statusModifier: %d "
+           "gameType: %d gameId: %d sequenceNum: %d\n",
+           bufferRecv[1], bufferRecv[2], bufferRecv[3],
+           bufferRecv[4], bufferRecv[5], bufferRecv[6]);
+
+    // a full server stays silent so clients pick another one
+    uint32_t active = countActiveGames();
+    uint32_t capacity = countCapacity();
+    if (active >= capacity) {
+        LOG(LOG_WARN, "There's no empty board for a multicast.\n");
+        return;
+    }
+
+    if (cnt < 0) {
+        logErrno(LOG_ERROR, "Fail to read");
+    } else if (cnt < frameLength(bufferRecv[0])) {
+        LOG(LOG_WARN, "Received only %d bytes. (should have received %d bytes)\n", cnt, frameLength(bufferRecv[0]));
+    }
+
+    // check version, the reply is sent in the version of the query
+    if (isVersionValid(bufferRecv[0]) == 0) {
+        LOG(LOG_WARN, "Received invalid version number: %d, expected: %d or %d.\n",
+               bufferRecv[0], VERSION, VERSION_COMPACT);
+        bufferSend[0] = VERSION;
+    } else {
+        bufferSend[0] = bufferRecv[0];
+    }
+
+    // check command
+    if (bufferRecv[1] != 1) {
+        LOG(LOG_WARN, "Received invalid version number: %d, expected: %d.\n", bufferRecv[1], 1);
+    }
+
+    uint8_t port_array[2];
+    u16_to_u8(htons(portNumber), port_array);
+    bufferSend[2] = port_array[0];
+    bufferSend[3] = port_array[1];
+
+    // then the share of boards in use, in permille
+    uint8_t load_array[2];
+    u16_to_u8(htons((uint16_t) ((uint64_t) active * 1000 / capacity)), load_array);
+    bufferSend[4] = load_array[0];
+    bufferSend[5] = load_array[1];
+
+    cnt = sendto(sd_dgram, bufferSend, frameLength(bufferSend[0]), 0, (struct sockaddr *) &addr, sizeof(addr));
+
+    LOG(LOG_DEBUG, "SEND choice: %d status: %d statusModifier: %d "
+           "gameType: %d gameId: %d sequenceNum: %d\n",
+           bufferSend[1], bufferSend[2], bufferSend[3],
+           bufferSend[4], bufferSend[5], bufferSend[6]);
+
+    if (cnt < 0) {
+        logErrno(LOG_ERROR, "sendto in processMulticast");
+        close(sd_dgram);
+    } else {
+        COUNT_STAT(&loop->stats, STAT_MULTICAST_ANSWERED);
+    }
+}
+
+
+/*
+ * start receiving the frames of a game's socket with the loop's engine
+ *
+ * return 1 on success, else 0
+ */
+int watchConnection(struct board_info *boardInfoPtr) {
+    if (loop->engine == ENGINE_URING) return armRecv(boardInfoPtr);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = boardInfoPtr;
+    return setNonBlocking(boardInfoPtr->sd) == 1
+           && epoll_ctl(loop->epfd, EPOLL_CTL_ADD, boardInfoPtr->sd, &ev) == 0;
+}
+
+
+/*
+ * Function: startConnection
+ * ----------------------------
+ *   Give a connection the session slot it is played in, its buffers
+ *   unless it brings its own, start its idle timer and its receives. The
+ *   frames it sent while it waited for the slot are still in the socket
+ *   and are read as usual.
+ */
+void startConnection(struct board_info *boardInfoPtr, int connected_sd) {
+    boardInfoPtr->sd = connected_sd;
+    touchSession(boardInfoPtr);
+    if (boardInfoPtr->buffers == NULL && attachBuffers(&loop->sessions, boardInfoPtr) == 0) {
+        logErrno(LOG_ERROR, "Failed to allocate connection buffers");
+        cleanSession(boardInfoPtr);
+        return;
+    }
+    if (watchConnection(boardInfoPtr) == 0) {
+        LOG(LOG_ERROR, "Clean board %u, failed to register its connection.\n", boardInfoPtr->gameId);
+        cleanSession(boardInfoPtr);
+    }
+}
+
+
+/*
+ * watch a waiting connection for events, its first frame (EPOLLIN) and
+ * its client hanging up (EPOLLRDHUP): with epoll it is registered for
+ * them, with io_uring it gets a one-shot poll
+ *
+ * return 1 on success, else 0
+ */
+int watchWaiter(struct waiter *waiter, uint32_t events) {
+    if (loop->engine == ENGINE_URING) {
+        struct io_uring_sqe *sqe = getSqe(&loop->uring);
+        if (sqe == NULL) return 0;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = waiter->sd;
+        // poll and epoll share their event bits, and poll.h hides POLLRDHUP without _GNU_SOURCE
+        sqe->poll32_events = events;
+        // the socket tells a poll of this waiter from one of the node's previous waiters
+        sqe->user_data = (uint64_t) (waiter - loop->waiters) << 32 | (uint64_t) waiter->sd << REQ_KIND_BITS | REQ_WAITER;
+        return 1;
+    }
+    struct epoll_event ev;
+    ev.events = events | EPOLLET;
+    ev.data.ptr = waiter;
+    return epoll_ctl(loop->epfd, EPOLL_CTL_ADD, waiter->sd, &ev) == 0;
+}
+
+
+/*
+ * take a waiter out of the waitlist and give its node back, return its socket
+ */
+int unlinkWaiter(struct waiter *waiter) {
+    int sd = waiter->sd;
+    if (waiter->prev != NULL) waiter->prev->next = waiter->next;
+    else loop->waitFront = waiter->next;
+    if (waiter->next != NULL) waiter->next->prev = waiter->prev;
+    else loop->waitBack = waiter->prev;
+    waiter->sd = -1;
+    waiter->prev = NULL;
+    waiter->next = loop->waitFree;
+    loop->waitFree = waiter;
+    loop->waitCount--;
+    return sd;
+}
+
+
+/*
+ * Function: onWaiterEvent
+ * ----------------------------
+ *   Drop a waiting connection whose client has hung up, so that no board
+ *   is given to it, or let one whose first frame has come skip the
+ *   waitlist, see skipWaitlist. With epoll the notice may be stale, for a
+ *   connection that has had its board since and whose node now holds
+ *   another one, so the socket is asked again first.
+ */
+void onWaiterEvent(struct waiter *waiter) {
+    if (waiter->sd < 0) return;
+    struct pollfd pfd = {waiter->sd, EPOLLRDHUP, 0};
+    if (poll(&pfd, 1, 0) == 1 && (pfd.revents & (EPOLLRDHUP | POLLHUP | POLLERR)) != 0) {
+        // closing also removes it from epoll
+        close(unlinkWaiter(waiter));
+        COUNT_STAT(&loop->stats, STAT_WAIT_ABANDONED);
+        LOG(LOG_INFO, "Loop %d: a waiting connection hung up, %u still wait.\n", loop->id, loop->waitCount);
+        return;
+    }
+    if (skipWaitlist(waiter->sd, waiter)) return;
+    // the frame stays in the socket until the connection has its board,
+    // only a hangup is news until then
+    if (loop->engine == ENGINE_URING && watchWaiter(waiter, EPOLLRDHUP) == 0)
+        logErrno(LOG_WARN, "Failed to watch a waiting connection");
+}
+
+
+/*
+ * Function: waitForBoard
+ * ----------------------------
+ *   Hold a connection the server has no board for at the back of the
+ *   loop's waitlist and tell the client its position there with a
+ *   GAME_QUEUED frame. The position is sent once, when the connection
+ *   joins; telling every waiter each time the front moves would cost a
+ *   send per waiter for every board freed. With the waitlist full too,
+ *   tell the client the server is full and close it.
+ */
+void waitForBoard(int connected_sd) {
+    // a fresh socket has room for one frame, so these never block
+    if (loop->waitFree == NULL) {
+        static const uint8_t outOfResources[BUFFER_SIZE] = {
+                VERSION, 0, GAME_ERROR, OUT_OF_RESOURCES, MOVE, (uint8_t) 0, (uint8_t) 1};
+        if (setNonBlocking(connected_sd) == 1) send(connected_sd, outOfResources, BUFFER_SIZE, MSG_NOSIGNAL);
+        close(connected_sd);
+        COUNT_STAT(&loop->stats, STAT_REJECTED);
+        return;
+    }
+
+    // the client has not said which version it speaks yet
+    static __thread uint8_t queued[BUFFER_SIZE] = {VERSION, 0, GAME_QUEUED, 0, NEW_GAME};
+    uint8_t position[2];
+    u16_to_u8(htons((uint16_t) (loop->waitCount + 1)), position);
+    queued[5] = position[0];
+    queued[6] = position[1];
+    if (setNonBlocking(connected_sd) == 0
+        || send(connected_sd, queued, BUFFER_SIZE, MSG_NOSIGNAL) != BUFFER_SIZE) {
+        logErrno(LOG_INFO, "Failed to tell a connection its place in the waitlist");
+        close(connected_sd);
+        COUNT_STAT(&loop->stats, STAT_WAIT_ABANDONED);
+        return;
+    }
+
+    struct waiter *waiter = loop->waitFree;
+    loop->waitFree = waiter->next;
+    waiter->sd = connected_sd;
+    waiter->next = NULL;
+    waiter->prev = loop->waitBack;
+    if (loop->waitBack != NULL) loop->waitBack->next = waiter;
+    else loop->waitFront = waiter;
+    loop->waitBack = waiter;
+    loop->waitCount++;
+    // it still gets its board, only its first frame and a hangup would go unnoticed until then
+    if (watchWaiter(waiter, EPOLLIN | EPOLLRDHUP) == 0) logErrno(LOG_WARN, "Failed to watch a waiting connection");
+    COUNT_STAT(&loop->stats, STAT_WAITLISTED);
+    LOG(LOG_INFO, "Loop %d: no board left, connection waits at position %u.\n", loop->id, loop->waitCount);
+}
+
+
+/*
+ * Function: admitWaiting
+ * ----------------------------
+ *   Start the games of the connections at the front of the waitlist for
+ *   as long as the session table has free slots, called whenever a slot
+ *   is released
+ */
+void admitWaiting() {
+    while (loop->waitFront != NULL) {
+        struct board_info *boardInfoPtr = acquireSession(&loop->sessions);
+        if (boardInfoPtr == NULL) return;
+        int connected_sd = unlinkWaiter(loop->waitFront);
+        // registered again for its frames; io_uring's poll goes stale and is ignored
+        if (loop->engine == ENGINE_EPOLL) epoll_ctl(loop->epfd, EPOLL_CTL_DEL, connected_sd, NULL);
+        LOG(LOG_INFO, "Loop %d: board %u goes to a waiting connection.\n", loop->id, boardInfoPtr->gameId);
+        startConnection(boardInfoPtr, connected_sd);
+    }
+}
+
+
+/*
+ * Function: admitConnection
+ * ----------------------------
+ *   Give an accepted connection a session slot, or a place in the
+ *   waitlist while every slot is taken. Slots only free up through
+ *   admitWaiting, so nobody gets ahead of a waiting connection, but for
+ *   those continuing a game that has a slot already, see skipWaitlist.
+ */
+void admitConnection(int connected_sd) {
+    struct board_info *boardInfoPtr = acquireSession(&loop->sessions);
+    if (boardInfoPtr != NULL) startConnection(boardInfoPtr, connected_sd);
+    else if (skipWaitlist(connected_sd, NULL) == 0) waitForBoard(connected_sd);
+}
+
+
+/*
+ * Function: acceptConnections
+ * ----------------------------
+ *   Accept every pending connection on the (edge-triggered) listening
+ *   socket and admit each one
+ */
+void acceptConnections() {
+    for (;;) {
+        struct sockaddr_in from_address;
+        socklen_t fromLength = sizeof(from_address);
+        int connected_sd = accept(loop->sd_stream, (struct sockaddr *) &from_address, &fromLength);
+        if (connected_sd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) logErrno(LOG_ERROR, "accept");
+            return;
+        }
+        admitConnection(connected_sd);
+    }
+}
+
+
+/*
+ * wake a loop for the work other threads have left it
+ */
+void wakeLoop(struct event_loop *owner) {
+    const uint64_t one = 1;
+    if (write(owner->mailFd, &one, sizeof(one)) < 0) logErrno(LOG_ERROR, "Failed to wake a loop");
+}
+
+
+/*
+ * leave a connection this loop no longer reads to the loop its handoff names
+ */
+void mailHandoff(struct handoff *handoff) {
+    struct event_loop *owner = handoff->owner;
+    pthread_mutex_lock(&owner->mailLock);
+    handoff->next = owner->handoffs;
+    owner->handoffs = handoff;
+    pthread_mutex_unlock(&owner->mailLock);
+    wakeLoop(owner);
+}
+
+
+/*
+ * give a connection this loop no longer reads to the loop of the game it
+ * continues, see startHandoff, and free the slot it had here
+ */
+void postHandoff(struct board_info *boardInfoPtr) {
+    struct handoff *handoff = boardInfoPtr->handoff;
+    handoff->sd = boardInfoPtr->sd;
+    handoff->buffers = boardInfoPtr->buffers;
+    boardInfoPtr->buffers = NULL;
+    boardInfoPtr->handoff = NULL;
+    freeSession(boardInfoPtr);
+    mailHandoff(handoff);
+}
+
+
+/*
+ * Function: startHandoff
+ * ----------------------------
+ *   Hand a connection whose RESUME names a detached game, or whose
+ *   RECONNECT claimed a recovered one, over to the loop that owns the
+ *   game, which reattaches it to the game's slot, so that no loop ever
+ *   touches the games of another. The connection's own slot is freed
+ *   once this loop has stopped reading the socket: right away with epoll,
+ *   once its multishot recv has been cancelled and its send in flight
+ *   has completed with io_uring. Whatever it received after the frame or
+ *   has not sent yet goes along.
+ */
+void startHandoff(struct board_info *boardInfoPtr, const uint8_t buffer[BUFFER_SIZE], struct event_loop *owner,
+                  struct detached_game *recovered) {
+    struct handoff *handoff = malloc(sizeof(struct handoff));
+    struct io_uring_sqe *sqe = (handoff != NULL && loop->engine == ENGINE_URING) ? getSqe(&loop->uring) : NULL;
+    if (handoff == NULL || (loop->engine == ENGINE_URING && sqe == NULL)) {
+        LOG(LOG_ERROR, "Clean board %u, no room to hand it over.\n", boardInfoPtr->gameId);
+        free(handoff);
+        unclaimDetachedGame(recovered);
+        cleanSession(boardInfoPtr);
+        return;
+    }
+    memcpy(handoff->frame, buffer, frameLength(buffer[0]));
+    handoff->recvDone = 0;
+    handoff->owner = owner;
+    handoff->recovered = recovered;
+    boardInfoPtr->handoff = handoff;
+    cancelTimer(&loop->wheel, &boardInfoPtr->timer);
+
+    if (loop->engine == ENGINE_EPOLL) {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, boardInfoPtr->sd, NULL);
+        postHandoff(boardInfoPtr);
+        return;
+    }
+    // the recv ends with a completion of its own, see onRecv
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = requestTag(REQ_RECV, boardInfoPtr);
+    sqe->user_data = requestTag(REQ_CANCEL, NULL);
+}
+
+
+/*
+ * Function: skipWaitlist
+ * ----------------------------
+ *   Hand a connection that has no slot straight to the loop of the game
+ *   its first frame continues, a RESUME naming a detached game or a
+ *   RECONNECT of a recovered one: that game has a slot already, often the
+ *   one the connection would otherwise wait for. The frame is only peeked
+ *   at, and left in the socket for later, unless the connection goes.
+ *
+ *   waiter: the connection's node in the waitlist, NULL if it has none
+ *
+ *   return: 1 if the connection was handed over, else 0
+ */
+int skipWaitlist(int connected_sd, struct waiter *waiter) {
+    struct handoff *handoff = malloc(sizeof(struct handoff));
+    if (handoff == NULL) return 0;
+    uint8_t *frame = handoff->frame;
+    const int got = (int) recv(connected_sd, frame, BUFFER_SIZE, MSG_PEEK | MSG_DONTWAIT);
+    handoff->owner = NULL;
+    handoff->recovered = NULL;
+    struct bitboard board;
+    if (got < COMPACT_FRAME_SIZE || got < frameLength(frame[0])
+        || (frame[0] != VERSION && frame[0] != VERSION_COMPACT)) {
+        // not a whole frame yet, or one of a VERSION_MUX connection
+    } else if (frame[4] == RESUME && isTokenDetached(frame + TOKEN_OFFSET)) {
+        handoff->owner = &loops[frame[TOKEN_OFFSET]];
+    } else if (frame[4] == RECONNECT && readReconnectBoard(frame, &board)
+               && claimDetachedGame(frame[5], &board, &handoff->recovered) >= 0) {
+        handoff->owner = &loops[handoff->recovered->loopId];
+    }
+    if (handoff->owner == NULL) {
+        free(handoff);
+        return 0;
+    }
+
+    // what follows the frame is read by the loop it goes to
+    recv(connected_sd, frame, frameLength(frame[0]), MSG_DONTWAIT);
+    if (waiter != NULL) {
+        unlinkWaiter(waiter);
+        // io_uring's poll goes stale and is ignored
+        if (loop->engine == ENGINE_EPOLL) epoll_ctl(loop->epfd, EPOLL_CTL_DEL, connected_sd, NULL);
+    }
+    handoff->sd = connected_sd;
+    handoff->buffers = NULL;
+    handoff->recvDone = 1;
+    mailHandoff(handoff);
+    return 1;
+}
+
+
+/*
+ * Function: resumeHandoff
+ * ----------------------------
+ *   Reattach a connection handed to this loop to the detached game its
+ *   RESUME names. The RESUME is the last frame the client sent before its
+ *   connection broke, so it goes through the usual checks: a move the
+ *   server had answered gets that answer again, one it never saw is
+ *   played now. Sequence numbers go on from where they were. On a
+ *   standby, a replicated game is restored into a fresh slot and goes on
+ *   the same way, under that slot's gameId. A game that ended while the
+ *   connection was on its way is not there any more: the connection then
+ *   carries on in a fresh slot and is told its token is unknown, like on
+ *   any other loop.
+ *
+ *   A RECONNECT that claimed a recovered game is answered in the slot of
+ *   that game, the same way it would have been in a fresh one, but for
+ *   the server's move the client lost, sent again. Should the game have
+ *   gone meanwhile, its board is trusted in a fresh slot.
+ */
+void resumeHandoff(struct handoff *handoff) {
+    const uint8_t version = handoff->frame[0];
+    const int reconnect = handoff->recovered != NULL;
+    const uint8_t *token = handoff->frame + TOKEN_OFFSET;
+    struct board_info *boardInfoPtr = NULL;
+    int resumed = 0;
+    if (reconnect) {
+        boardInfoPtr = &loop->sessions.slots[handoff->recovered->slot];
+        resumed = boardInfoPtr->recovered && boardInfoPtr->sd < 0;
+    } else {
+        int loopId;
+        uint32_t slot, secret;
+        readToken(token, &loopId, &slot, &secret);
+        if (loopId == loop->id && slot < loop->sessions.capacity) {
+            boardInfoPtr = &loop->sessions.slots[slot];
+            resumed = boardInfoPtr->sd < 0 && boardInfoPtr->secret == secret && boardInfoPtr->version == version
+                      && (boardInfoPtr->recovered == 0 || claimRecoveredGame(boardInfoPtr));
+            if (resumed) boardInfoPtr->recovered = 0;
+        }
+    }
+    if (resumed == 0) {
+        boardInfoPtr = acquireSession(&loop->sessions);
+        struct game_record record;
+        if (boardInfoPtr != NULL && reconnect == 0 && loop->standby.replicas != NULL
+            && takeReplica(&loop->standby, token, loop->now, &record) && record.version == version) {
+            LOG(LOG_INFO, "Board[%u] takes over replicated game %u.\n", boardInfoPtr->gameId, record.gameId);
+            restoreRecord(boardInfoPtr, &record);
+            resumed = 1;
+        }
+    }
+    if (boardInfoPtr == NULL) {
+        LOG(LOG_WARN, "Loop %d: no board for a connection whose game has ended.\n", loop->id);
+        close(handoff->sd);
+        free(handoff->buffers);
+        return;
+    }
+
+    // completions for the game's old connection may still come
+    boardInfoPtr->generation++;
+    boardInfoPtr->resendCount = 0;
+    boardInfoPtr->buffers = handoff->buffers;
+    startConnection(boardInfoPtr, handoff->sd);
+    if (boardInfoPtr->sd != handoff->sd) return;
+    if (boardInfoPtr->buffers->outQueue.head != boardInfoPtr->buffers->outQueue.tail) markDirty(boardInfoPtr);
+
+    loop->receivedNs = monotonicNs();
+    uint32_t gameId, recvSequenceNum;
+    readFrameIds(handoff->frame, &gameId, &recvSequenceNum);
+    const uint32_t sendSequenceNum = (recvSequenceNum + 1) & frameIdMask(version);
+    if (reconnect) {
+        // the slot goes on like a fresh one that was sent the RECONNECT
+        boardInfoPtr->version = version;
+        boardInfoPtr->sequenceNum = 0;
+        boardInfoPtr->variant = VARIANT_CLASSIC;
+        boardInfoPtr->recovered = 0;
+        readReconnectBoard(handoff->frame, &boardInfoPtr->board);
+        int replay = 0;
+        if (resumed) {
+            LOG(LOG_INFO, "Board[%u] continues game %d.\n", boardInfoPtr->gameId, handoff->frame[5]);
+            COUNT_STAT(&loop->stats, STAT_GAMES_RESUMED);
+            replay = matchRecord(&handoff->recovered->record, &boardInfoPtr->board);
+        }
+        answerReconnect(boardInfoPtr, sendSequenceNum, replay);
+    } else if (resumed) {
+        LOG(LOG_INFO, "Board[%u] resumes on a new connection.\n", boardInfoPtr->gameId);
+        COUNT_STAT(&loop->stats, STAT_GAMES_RESUMED);
+        issueToken(boardInfoPtr);
+        handoff->frame[4] = MOVE;
+        handoff->frame[5] = (uint8_t) boardInfoPtr->gameId;
+        processBuffer(boardInfoPtr, handoff->frame);
+    } else {
+        LOG(LOG_INFO, "Received the token of a game that has ended.\n");
+        boardInfoPtr->version = version;
+        queueControlFrame(boardInfoPtr, version, GAME_ERROR, UNKNOWN_SESSION,
+                          boardInfoPtr->gameId, sendSequenceNum);
+    }
+
+    uint8_t buffer[BUFFER_SIZE];
+    while (boardInfoPtr->sd == handoff->sd && boardInfoPtr->handoff == NULL
+           && nextFrame(&boardInfoPtr->buffers->recvRing, buffer))
+        processBuffer(boardInfoPtr, buffer);
+    if (boardInfoPtr->sd == handoff->sd) saveSession(boardInfoPtr);
+}
+
+
+/*
+ * the standby loop that keeps the replicated game a session token names
+ */
+struct event_loop *replicaOwner(const uint8_t token[TOKEN_SIZE]) {
+    return &loops[replicaKey(token) % (uint32_t) loopCount];
+}
+
+
+/*
+ * Function: deliverReplicas
+ * ----------------------------
+ *   Leave the records of a datagram from the primary in the inboxes of
+ *   the loops that keep their games, see replicaOwner. Runs on the
+ *   standby's replication thread, so that each replica table is only
+ *   ever touched by its own loop.
+ */
+void deliverReplicas(const struct game_record *records, int count) {
+    uint8_t woken[MAX_WORKERS] = {0};
+    for (int i = 0; i < count; i++) {
+        struct event_loop *owner = replicaOwner(records[i].token);
+        pthread_mutex_lock(&owner->mailLock);
+        if (owner->inboxCount < REPLICA_INBOX) owner->inbox[owner->inboxCount++] = records[i];
+        pthread_mutex_unlock(&owner->mailLock);
+        woken[owner->id] = 1;
+    }
+    for (int i = 0; i < loopCount; i++)
+        if (woken[i]) wakeLoop(&loops[i]);
+}
+
+
+/*
+ * reattach every connection handed to this loop since the last call and
+ * keep the replicated records delivered to it
+ */
+void readMail() {
+    uint64_t count;
+    if (read(loop->mailFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+        logErrno(LOG_ERROR, "Failed to read the mail eventfd");
+
+    pthread_mutex_lock(&loop->mailLock);
+    struct handoff *handoff = loop->handoffs;
+    loop->handoffs = NULL;
+    for (uint32_t i = 0; i < loop->inboxCount; i++) applyRecord(&loop->standby, &loop->inbox[i], loop->now);
+    loop->inboxCount = 0;
+    pthread_mutex_unlock(&loop->mailLock);
+    while (handoff != NULL) {
+        struct handoff *next = handoff->next;
+        resumeHandoff(handoff);
+        free(handoff);
+        handoff = next;
+    }
+}
+
+
+/*
+ * Function: readBoard
+ * ----------------------------
+ *   Drain a readable game socket until it would block, since with
+ *   edge-triggered epoll there will be no second wakeup for leftover data.
+ *   Bytes are reassembled in the game's receive ring and every complete
+ *   frame is processed, so partial and coalesced reads are both handled.
+ */
+void readBoard(struct board_info *boardInfoPtr) {
+    const int sd = boardInfoPtr->sd;
+
+    // stop as soon as processBuffer has closed the game
+    while (boardInfoPtr->sd == sd) {
+        int rc = fillRecvRing(sd, &boardInfoPtr->buffers->recvRing);
+        if (rc == 0) { // the client disconnected normally
+            LOG(LOG_INFO, "Detach board %u after disconnected from client.\n", boardInfoPtr->gameId);
+            COUNT_STAT(&loop->stats, STAT_DISCONNECTS);
+            detachSession(boardInfoPtr);  // closing also removes it from epoll
+            return;
+        }
+        if (rc < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            // e.g. reset by the client, nothing more will arrive
+            logErrno(LOG_WARN, "Fail to read");
+            COUNT_STAT(&loop->stats, STAT_DISCONNECTS);
+            detachSession(boardInfoPtr);
+            return;
+        }
+
+        loop->receivedNs = monotonicNs();
+        uint8_t buffer[BUFFER_SIZE];
+        while (boardInfoPtr->sd == sd && nextFrame(&boardInfoPtr->buffers->recvRing, buffer))
+            processBuffer(boardInfoPtr, buffer);
+        if (boardInfoPtr->sd == sd) saveSession(boardInfoPtr);
+    }
+}
+
+
+/*
+ * user_data of an io_uring request, see REQ_ACCEPT
+ */
+uint64_t requestTag(int kind, const struct board_info *boardInfoPtr) {
+    if (boardInfoPtr == NULL) return (uint64_t) kind;
+    uint64_t slot = boardInfoPtr->gameId - loop->sessions.firstGameId;
+    return (slot << 32) | ((uint64_t) (boardInfoPtr->generation & REQ_GENERATION_MASK) << REQ_KIND_BITS)
+           | (uint64_t) kind;
+}
+
+
+/*
+ * the game a completion belongs to, NULL if that game has ended since
+ */
+struct board_info *taggedSession(uint64_t tag) {
+    struct board_info *boardInfoPtr = &loop->sessions.slots[tag >> 32];
+    if (boardInfoPtr->sd <= 0
+        || (boardInfoPtr->generation & REQ_GENERATION_MASK) != ((tag >> REQ_KIND_BITS) & REQ_GENERATION_MASK))
+        return NULL;
+    return boardInfoPtr;
+}
+
+
+void armAccept() {
+    struct io_uring_sqe *sqe = getSqe(&loop->uring);
+    if (sqe == NULL) {
+        LOG(LOG_ERROR, "Loop %d: no room to accept connections.\n", loop->id);
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->sd_stream;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = requestTag(REQ_ACCEPT, NULL);
+}
+
+
+void armMulticast() {
+    struct io_uring_sqe *sqe = getSqe(&loop->uring);
+    if (sqe == NULL) {
+        LOG(LOG_ERROR, "Loop %d: no room to poll multicast.\n", loop->id);
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = loop->sd_dgram;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = requestTag(REQ_MULTICAST, NULL);
+}
+
+
+void armMail() {
+    struct io_uring_sqe *sqe = getSqe(&loop->uring);
+    if (sqe == NULL) {
+        LOG(LOG_ERROR, "Loop %d: no room to poll for mail.\n", loop->id);
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = loop->mailFd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = requestTag(REQ_MAIL, NULL);
+}
+
+
+/*
+ * io_uring: the recv of a connection being handed over has ended, it
+ * goes once its send in flight has completed too
+ */
+void endHandoffRecv(struct board_info *boardInfoPtr) {
+    boardInfoPtr->handoff->recvDone = 1;
+    if (boardInfoPtr->sending == 0) postHandoff(boardInfoPtr);
+}
+
+
+/*
+ * start a multishot recv on a game socket, each completion brings
+ * one of the loop's provided buffers
+ */
+int armRecv(struct board_info *boardInfoPtr) {
+    struct io_uring_sqe *sqe = getSqe(&loop->uring);
+    if (sqe == NULL) return 0;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = boardInfoPtr->sd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = requestTag(REQ_RECV, boardInfoPtr);
+    return 1;
+}
+
+
+/*
+ * Function: queueSend
+ * ----------------------------
+ *   Prepare an io_uring send of the contiguous part of a game's output
+ *   queue. Only one send per game is in flight, the rest of the queue
+ *   follows when it completes.
+ */
+void queueSend(struct board_info *boardInfoPtr) {
+    struct out_queue *queue = &boardInfoPtr->buffers->outQueue;
+    if (boardInfoPtr->sending != 0 || queue->head == queue->tail) return;
+
+    uint32_t start = queue->head & (OUT_QUEUE_SIZE - 1);
+    uint32_t len = queue->tail - queue->head;
+    if (len > OUT_QUEUE_SIZE - start) len = OUT_QUEUE_SIZE - start;
+
+    struct io_uring_sqe *sqe = getSqe(&loop->uring);
+    if (sqe == NULL) {
+        LOG(LOG_ERROR, "Clean board %u, no room to send.\n", boardInfoPtr->gameId);
+        cleanSession(boardInfoPtr);
+        return;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = boardInfoPtr->sd;
+    sqe->addr = (uint64_t) (uintptr_t) (queue->data + start);
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = requestTag(REQ_SEND, boardInfoPtr);
+    boardInfoPtr->sending = len;
+}
+
+
+void onAccept(const struct io_uring_cqe *cqe) {
+    if (cqe->res >= 0) {
+        admitConnection(cqe->res);
+    } else {
+        errno = -cqe->res;
+        logErrno(LOG_ERROR, "accept");
+    }
+    if ((cqe->flags & IORING_CQE_F_MORE) == 0) armAccept();
+}
+
+
+/*
+ * Function: onRecv
+ * ----------------------------
+ *   Feed the bytes of a recv completion to the game's receive ring and
+ *   process every complete frame, the same way readBoard does for epoll
+ */
+void onRecv(const struct io_uring_cqe *cqe) {
+    struct board_info *boardInfoPtr = taggedSession(cqe->user_data);
+    int hasBuffer = (cqe->flags & IORING_CQE_F_BUFFER) != 0;
+    uint16_t bid = (uint16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+    if (boardInfoPtr == NULL) {  // the game ended while the recv was queued
+        if (hasBuffer) recycleBuffer(&loop->uring, bid);
+        return;
+    }
+    // the connection is being handed over, see startHandoff: keep what
+    // still arrives for the loop it goes to
+    if (boardInfoPtr->handoff != NULL) {
+        int fits = cqe->res <= 0
+                   || pushRecvRing(&boardInfoPtr->buffers->recvRing, uringBuffer(&loop->uring, bid), (uint32_t) cqe->res);
+        if (hasBuffer) recycleBuffer(&loop->uring, bid);
+        if (fits == 0) {
+            LOG(LOG_WARN, "Clean board %u, receive ring overflow.\n", boardInfoPtr->gameId);
+            cleanSession(boardInfoPtr);
+        } else if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+            endHandoffRecv(boardInfoPtr);
+        }
+        return;
+    }
+    if (cqe->res == 0) {
+        LOG(LOG_INFO, "Detach board %u after disconnected from client.\n", boardInfoPtr->gameId);
+        COUNT_STAT(&loop->stats, STAT_DISCONNECTS);
+        detachSession(boardInfoPtr);
+        return;
+    }
+    if (cqe->res < 0) {
+        if (cqe->res == -ENOBUFS) {  // every buffer is in use, try again later
+            if (armRecv(boardInfoPtr) == 1) return;
+        } else {
+            errno = -cqe->res;
+            logErrno(LOG_WARN, "Fail to read");
+            COUNT_STAT(&loop->stats, STAT_DISCONNECTS);
+        }
+        detachSession(boardInfoPtr);
+        return;
+    }
+
+    int fits = pushRecvRing(&boardInfoPtr->buffers->recvRing, uringBuffer(&loop->uring, bid), (uint32_t) cqe->res);
+    recycleBuffer(&loop->uring, bid);
+    if (fits == 0) {
+        LOG(LOG_WARN, "Clean board %u, receive ring overflow.\n", boardInfoPtr->gameId);
+        cleanSession(boardInfoPtr);
+        return;
+    }
+
+    const int sd = boardInfoPtr->sd;
+    loop->receivedNs = monotonicNs();
+    uint8_t buffer[BUFFER_SIZE];
+    while (boardInfoPtr->sd == sd && boardInfoPtr->handoff == NULL && nextFrame(&boardInfoPtr->buffers->recvRing, buffer))
+        processBuffer(boardInfoPtr, buffer);
+    if (boardInfoPtr->sd != sd) return;
+    if (boardInfoPtr->handoff != NULL) {
+        // this was the recv's last completion, the cancel finds nothing
+        if ((cqe->flags & IORING_CQE_F_MORE) == 0) endHandoffRecv(boardInfoPtr);
+        return;
+    }
+    saveSession(boardInfoPtr);
+
+    if ((cqe->flags & IORING_CQE_F_MORE) == 0 && armRecv(boardInfoPtr) == 0)
+        cleanSession(boardInfoPtr);
+}
+
+
+void onSend(const struct io_uring_cqe *cqe) {
+    struct board_info *boardInfoPtr = taggedSession(cqe->user_data);
+    if (boardInfoPtr == NULL) return;
+
+    boardInfoPtr->sending = 0;
+    if (cqe->res < 0) {
+        errno = -cqe->res;
+        logErrno(LOG_ERROR, "Failed to send data");
+        detachSession(boardInfoPtr);
+        return;
+    }
+    boardInfoPtr->buffers->outQueue.head += (uint32_t) cqe->res;
+    if (boardInfoPtr->handoff != NULL && boardInfoPtr->handoff->recvDone) postHandoff(boardInfoPtr);
+    else if (boardInfoPtr->buffers->outQueue.head != boardInfoPtr->buffers->outQueue.tail) markDirty(boardInfoPtr);
+}
+
+
+/*
+ * Function: runUringLoop
+ * ----------------------------
+ *   Serve the games of one shard through io_uring. Each iteration costs a
+ *   single io_uring_enter that submits the sends of the previous iteration
+ *   and waits for completions; accept and recv stay armed (multishot), so
+ *   the move path makes no system call of its own.
+ */
+void runUringLoop() {
+    armAccept();
+    armMail();
+    if (loop->sd_dgram >= 0) armMulticast();
+
+    for (;;) {
+        flushSessions();
+
+        int waitMs = loopWaitMs();
+        if (waitMs == 0) waitMs = 1;
+        if (submitAndWait(&loop->uring, waitMs) < 0) break;
+
+        loop->now = monotonicMs();
+        expireTimers(&loop->wheel, loop->now, onSessionTimeout);
+        sweepReplica();
+
+        struct io_uring_cqe *next;
+        while ((next = peekCqe(&loop->uring)) != NULL) {
+            struct io_uring_cqe cqe = *next;
+            seenCqe(&loop->uring);
+
+            int kind = (int) (cqe.user_data & REQ_KIND_MASK);
+            if (kind == REQ_RECV) onRecv(&cqe);
+            else if (kind == REQ_SEND) onSend(&cqe);
+            else if (kind == REQ_ACCEPT) onAccept(&cqe);
+            else if (kind == REQ_WAITER) {
+                struct waiter *waiter = &loop->waiters[cqe.user_data >> 32];
+                if ((uint64_t) waiter->sd == (uint32_t) cqe.user_data >> REQ_KIND_BITS) onWaiterEvent(waiter);
+            }
+            else if (kind == REQ_MAIL) {
+                readMail();
+                if ((cqe.flags & IORING_CQE_F_MORE) == 0) armMail();
+            } else if (kind == REQ_MULTICAST) {
+                processMulticast(loop->sd_dgram, loop->portNumber);
+                if ((cqe.flags & IORING_CQE_F_MORE) == 0) armMulticast();
+            }
+            // REQ_CANCEL: the recv it cancels ends with a completion of its own
+        }
+    }
+}
+
+
+/*
+ * Function: runLoop
+ * ----------------------------
+ *   Body of a worker thread: serve the games of one shard until epoll fails,
+ *   or hand over to runUringLoop when the io_uring engine was chosen
+ */
+void *runLoop(void *arg) {
+    loop = arg;
+
+    if (loop->engine == ENGINE_URING) {
+        // the ring belongs to the thread that uses it
+        if (initUring(&loop->uring) == 1) {
+            runUringLoop();
+            freeUring(&loop->uring);
+            return NULL;
+        }
+        LOG(LOG_WARN, "Loop %d: io_uring is not available, using epoll.\n", loop->id);
+        loop->engine = ENGINE_EPOLL;
+    }
+
+    // the listening and multicast sockets are tagged with the address of
+    // their descriptor; every other event carries its board_info slot
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &loop->sd_stream;
+    if (setNonBlocking(loop->sd_stream) == 0
+        || epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->sd_stream, &ev) < 0) {
+        logErrno(LOG_ERROR, "Failed to register stream socket");
+        return NULL;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &loop->mailFd;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->mailFd, &ev) < 0) {
+        logErrno(LOG_ERROR, "Failed to register mail eventfd");
+        return NULL;
+    }
+    if (loop->sd_dgram >= 0) {
+        ev.events = EPOLLIN;  // level-triggered, one datagram per wakeup
+        ev.data.ptr = &loop->sd_dgram;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->sd_dgram, &ev) < 0) {
+            logErrno(LOG_ERROR, "Failed to register datagram socket");
+            return NULL;
+        }
+    }
+
+    // start the game
+    for (long j=0; j<LONG_MAX; j++) {
+        struct epoll_event events[MAX_EVENTS];
+
+        // block until something arrives or the next timer is due
+        int waitMs = loopWaitMs();
+        int n = epoll_wait(loop->epfd, events, MAX_EVENTS, waitMs);
+
+        loop->now = monotonicMs();
+        expireTimers(&loop->wheel, loop->now, onSessionTimeout);
+        sweepReplica();
+        flushSessions();
+
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            logErrno(LOG_ERROR, "Failed to epoll_wait");
+            break;
+        }
+        if (n == 0) {
+            if (waitMs == TIME_LIMIT_SERVER * 1000)
+                LOG(LOG_INFO, "Loop %d: no message in the past %d seconds.\n", loop->id, TIME_LIMIT_SERVER);
+            continue;
+        }
+
+        for (int e=0; e<n; e++) {
+            void *tag = events[e].data.ptr;
+
+            if (tag == &loop->sd_dgram) {
+                processMulticast(loop->sd_dgram, loop->portNumber);
+                continue;
+            }
+            if (tag == &loop->mailFd) {
+                readMail();
+                continue;
+            }
+            // establish new connection
+            if (tag == &loop->sd_stream) {
+                acceptConnections();
+                continue;
+            }
+            if ((struct waiter *) tag >= loop->waiters && (struct waiter *) tag < loop->waiters + loop->waitCapacity) {
+                onWaiterEvent(tag);
+                continue;
+            }
+            // receive buffer from a connected client
+            struct board_info *boardInfoPtr = tag;
+            if (boardInfoPtr->sd > 0 && (events[e].events & ~EPOLLOUT))
+                readBoard(boardInfoPtr);
+            // the socket has room again for output that did not fit earlier
+            if (boardInfoPtr->sd > 0 && (events[e].events & EPOLLOUT)
+                && boardInfoPtr->buffers->outQueue.head != boardInfoPtr->buffers->outQueue.tail)
+                markDirty(boardInfoPtr);
+        }
+        flushSessions();
+    }
+    return NULL;
+}
+
+
+/*
+ * Function: recoverGames
+ * ----------------------------
+ *   Open the snapshot of a loop and put every game that was live in it
+ *   back into its slot, detached until its client reconnects. Runs
+ *   before the loop's thread starts.
+ *
+ *   path: the snapshot path given to the server, the loop's id is appended
+ *
+ *   return: the number of games recovered, -1 if the snapshot can't be used
+ */
+int recoverGames(struct event_loop *l, const char *path) {
+    char loopPath[PATH_MAX];
+    snprintf(loopPath, sizeof(loopPath), "%s.%d", path, l->id);
+    if (openSnapshot(&l->snapshot, loopPath, l->sessions.capacity, l->sessions.firstGameId) == 0)
+        return -1;
+
+    int recovered = 0;
+    for (uint32_t slot = 0; slot < l->sessions.capacity; slot++) {
+        const struct game_record *record = liveRecord(&l->snapshot, slot);
+        if (record == NULL) continue;
+
+        if ((detachedCount & (detachedCount - 1)) == 0) {  // grow at powers of two
+            struct detached_game *grown = realloc(
+                    detached, (detachedCount ? detachedCount * 2 : 16) * sizeof(struct detached_game));
+            if (grown == NULL) {
+                logErrno(LOG_ERROR, "Failed to list recovered games");
+                break;
+            }
+            detached = grown;
+        }
+        struct board_info *boardInfoPtr = claimSession(&l->sessions, slot);
+        boardInfoPtr->sd = -1;
+        boardInfoPtr->recovered = 1;
+        restoreRecord(boardInfoPtr, record);
+        // its client may RESUME it with the token the old server issued
+        int loopId;
+        uint32_t tokenSlot, secret;
+        readToken(record->token, &loopId, &tokenSlot, &secret);
+        if (loopId == l->id && tokenSlot == slot) boardInfoPtr->secret = secret;
+        armTimer(&l->wheel, &boardInfoPtr->timer, l->now + timeoutMs);
+
+        struct detached_game *game = &detached[detachedCount++];
+        game->loopId = l->id;
+        game->slot = slot;
+        game->claimed = 0;
+        game->record = *record;
+        recovered++;
+    }
+    return recovered;
+}
+
+
+/*
+ * Function: playServer
+ * ----------------------------
+ *   Simulate the game play process for server with one event loop
+ *   per listening socket, each on its own thread
+ *
+ *   sd_streams: config->workers listening sockets bound with SO_REUSEPORT
+ *
+ *   sd_dgram: socket file descriptor joined to the multicast group
+ *
+ *   config: port announced in multicast replies, session table size,
+ *   AI level, number of workers, idle timeout, log level, I/O engine,
+ *   metrics port, snapshot path, replication and waitlist size
+ */
+void playServer(
+        const int sd_streams[],
+        int sd_dgram,
+        const struct server_config *config) {
+
+    aiLevel = config->aiLevel;
+    timeoutMs = config->timeoutMs;
+    logLevel = config->logLevel;
+    startLogThread();
+    initAi();
+
+    loopCount = config->workers;
+    loops = calloc((size_t) loopCount, sizeof(struct event_loop));
+    if (loops == NULL) {
+        logErrno(LOG_ERROR, "Failed to allocate event loops");
+        stopLogThread();
+        return;
+    }
+
+    // every loop gets an equal slice of the capacity and of the gameId space
+    uint32_t shardCapacity = (config->maxBoards + loopCount - 1) / loopCount;
+    uint32_t shardWaitlist = (config->waitlist + loopCount - 1) / loopCount;
+    int started = 0;
+    for (int i = 0; i < loopCount; i++) {
+        struct event_loop *l = &loops[i];
+        l->id = i;
+        l->sd_stream = sd_streams[i];
+        l->sd_dgram = (i == 0) ? sd_dgram : -1;
+        l->portNumber = config->portNumber;
+        l->engine = config->engine;
+        l->replica.sd = -1;
+        if (getrandom(&l->secretState, sizeof(l->secretState), 0) != sizeof(l->secretState))
+            l->secretState = monotonicNs();
+        l->secretState |= 1;  // xorshift never leaves 0
+        l->now = monotonicMs();
+        initTimerWheel(&l->wheel, l->now);
+        l->epfd = epoll_create1(0);
+        if (l->epfd < 0) {
+            logErrno(LOG_ERROR, "Failed to create epoll instance");
+            break;
+        }
+        l->mailFd = eventfd(0, EFD_NONBLOCK);
+        if (l->mailFd < 0) {
+            logErrno(LOG_ERROR, "Failed to create mail eventfd");
+            close(l->epfd);
+            break;
+        }
+        pthread_mutex_init(&l->mailLock, NULL);
+        if (initSessionTable(&l->sessions, shardCapacity, (uint32_t) i * shardCapacity) == 0) {
+            close(l->mailFd);
+            close(l->epfd);
+            break;
+        }
+        l->stats.sessions = &l->sessions;
+        initHistogram(&l->stats.moveLatency);
+        l->dirty = calloc(shardCapacity, sizeof(struct board_info *));
+        l->waitCapacity = shardWaitlist;
+        if (shardWaitlist > 0) l->waiters = calloc(shardWaitlist, sizeof(struct waiter));
+        for (uint32_t w = shardWaitlist; w-- > 0 && l->waiters != NULL;) {
+            l->waiters[w].sd = -1;
+            l->waiters[w].next = l->waitFree;
+            l->waitFree = &l->waiters[w];
+        }
+        if (config->replicaPort != 0) {
+            l->inbox = calloc(REPLICA_INBOX, sizeof(struct game_record));
+            if (l->inbox != NULL && initReplicaTable(&l->standby, shardCapacity, timeoutMs * (MAX_SEND_COUNT + 1)) == 0) {
+                free(l->inbox);
+                l->inbox = NULL;
+            }
+        }
+        if (l->dirty == NULL || (shardWaitlist > 0 && l->waiters == NULL) || (config->replicaPort != 0 && l->inbox == NULL)) {
+            logErrno(LOG_ERROR, "Failed to allocate event loop");
+            free(l->dirty);
+            free(l->waiters);
+            free(l->inbox);
+            freeReplicaTable(&l->standby);
+            freeSessionTable(&l->sessions);
+            close(l->mailFd);
+            close(l->epfd);
+            break;
+        }
+        if (config->standby.sin_port != 0) openReplicaStream(&l->replica, &config->standby);
+        if (config->snapshotPath != NULL) {
+            int recovered = recoverGames(l, config->snapshotPath);
+            if (recovered > 0) LOG(LOG_INFO, "Loop %d: recovered %d games.\n", i, recovered);
+        }
+        started++;
+    }
+    LOG(LOG_INFO, "Serving up to %u games on %d loops, %u more connections can wait.\n",
+        shardCapacity * started, started, shardWaitlist * started);
+
+    // every loop is fully set up before the first thread can read another's table
+    loopCount = started;
+    indexDetached();
+    struct loop_stats *stats[MAX_WORKERS];
+    for (int i = 0; i < started; i++) stats[i] = &loops[i].stats;
+    if (config->statsPort != 0) startStatsThread(config->statsPort, stats, started);
+    if (config->replicaPort != 0) startStandby(config->replicaPort, deliverReplicas);
+    for (int i = 0; i < started; i++) {
+        if (pthread_create(&loops[i].thread, NULL, runLoop, &loops[i]) != 0) {
+            logErrno(LOG_ERROR, "Failed to start event loop");
+            loops[i].thread = 0;
+        }
+    }
+    for (int i = 0; i < started; i++)
+        if (loops[i].thread != 0) pthread_join(loops[i].thread, NULL);
+    // the replication thread delivers to the loops until it stops
+    stopStatsThread();
+    stopStandby();
+    for (int i = 0; i < started; i++) {
+        close(loops[i].epfd);
+        free(loops[i].dirty);
+        for (struct waiter *waiter = loops[i].waitFront; waiter != NULL; waiter = waiter->next)
+            close(waiter->sd);
+        free(loops[i].waiters);
+        close(loops[i].mailFd);
+        while (loops[i].handoffs != NULL) {
+            struct handoff *next = loops[i].handoffs->next;
+            close(loops[i].handoffs->sd);
+            free(loops[i].handoffs->buffers);
+            free(loops[i].handoffs);
+            loops[i].handoffs = next;
+        }
+        pthread_mutex_destroy(&loops[i].mailLock);
+        free(loops[i].inbox);
+        freeReplicaTable(&loops[i].standby);
+        closeReplicaStream(&loops[i].replica);
+        closeSnapshot(&loops[i].snapshot);
+        freeSessionTable(&loops[i].sessions);
+    }
+    free(detached);
+    free(detachedIndex);
+    free(loops);
+    stopLogThread();
+}
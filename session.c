@@ -0,0 +1,187 @@
+#include "tictactoe.h"
+
+
+#define NO_SLOT UINT32_MAX
+
+
+/*
+ * Function: initSessionTable
+ * ----------------------------
+ *   Reserve room for capacity games. Slots are handed out lazily from the
+ *   front of the array, so untouched slots never cost resident memory.
+ *
+ *   firstGameId: the gameId of the first slot, so that tables of
+ *   different event loops hand out disjoint gameIds
+ *
+ *   return: returns 1 if succeed, else 0
+ */
+int initSessionTable(struct session_table *table, uint32_t capacity, uint32_t firstGameId) {
+    table->slots = calloc(capacity, sizeof(struct board_info));
+    if (table->slots == NULL) {
+        logErrno(LOG_ERROR, "Failed to allocate session table");
+        return 0;
+    }
+    table->capacity = capacity;
+    table->firstGameId = firstGameId;
+    table->active = 0;
+    table->used = 0;
+    table->freeHead = NO_SLOT;
+    table->spareBuffers = NULL;
+    table->spareCount = 0;
+    return 1;
+}
+
+
+void freeSessionTable(struct session_table *table) {
+    for (uint32_t i = 0; i < table->used; i++) {
+        free(table->slots[i].buffers);
+        free(table->slots[i].wide);
+    }
+    while (table->spareBuffers != NULL) {
+        struct connection_buffers *next = table->spareBuffers->next;
+        free(table->spareBuffers);
+        table->spareBuffers = next;
+    }
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+}
+
+
+/*
+ * initialize slot idx for a new game
+ */
+static struct board_info *resetSession(struct session_table *table, uint32_t idx) {
+    struct board_info *boardInfoPtr = &table->slots[idx];
+    boardInfoPtr->resendCount = 0;
+    boardInfoPtr->sd = 0;
+    initTimer(&boardInfoPtr->timer);
+    boardInfoPtr->gameId = table->firstGameId + idx;
+    boardInfoPtr->nextFree = NO_SLOT;
+    boardInfoPtr->sequenceNum = 0;
+    boardInfoPtr->version = 0;
+    boardInfoPtr->channel = NULL;
+    boardInfoPtr->muxNext = NULL;
+    boardInfoPtr->muxPrev = NULL;
+    initBoard(&boardInfoPtr->board);
+    boardInfoPtr->variant = VARIANT_CLASSIC;
+    // frames are built in place and only ever write their first
+    // COMPACT_FRAME_SIZE bytes (asserted in tictactoe.h), the zero tail
+    // of a legacy frame is added as it is queued
+    memset(boardInfoPtr->bufferSend, 0, COMPACT_FRAME_SIZE);
+    boardInfoPtr->dirty = 0;
+    boardInfoPtr->generation++;
+    boardInfoPtr->sending = 0;
+    boardInfoPtr->receivedNs = 0;
+    boardInfoPtr->overflow = 0;
+    boardInfoPtr->recovered = 0;
+    boardInfoPtr->secret = 0;
+    boardInfoPtr->handoff = NULL;
+    // other threads sum active without locking
+    __atomic_store_n(&table->active, table->active + 1, __ATOMIC_RELAXED);
+    return boardInfoPtr;
+}
+
+
+/*
+ * Function: acquireSession
+ * ----------------------------
+ *   Take a free slot in O(1): reuse the most recently released slot,
+ *   otherwise extend into the never used part of the table
+ *
+ *   return: the initialized slot, or NULL if every slot is taken
+ */
+struct board_info *acquireSession(struct session_table *table) {
+    uint32_t idx;
+    if (table->freeHead != NO_SLOT) {
+        idx = table->freeHead;
+        table->freeHead = table->slots[idx].nextFree;
+    } else if (table->used < table->capacity) {
+        idx = table->used++;
+    } else {
+        return NULL;
+    }
+    return resetSession(table, idx);
+}
+
+
+/*
+ * Function: claimSession
+ * ----------------------------
+ *   Take a given slot, e.g. to restore a game from a snapshot. Slots must
+ *   be claimed in increasing order before any is acquired; the ones
+ *   skipped over go to the free list.
+ *
+ *   return: the initialized slot, or NULL if it can't be claimed
+ */
+struct board_info *claimSession(struct session_table *table, uint32_t idx) {
+    if (idx >= table->capacity || idx < table->used) return NULL;
+    while (table->used < idx) {
+        table->slots[table->used].nextFree = table->freeHead;
+        table->freeHead = table->used++;
+    }
+    table->used++;
+    return resetSession(table, idx);
+}
+
+
+/*
+ * Function: attachBuffers
+ * ----------------------------
+ *   Give a slot that gets a socket of its own a receive ring and an output
+ *   queue, those of a connection that has closed if the table kept some.
+ *   A game without a socket, detached or played over a VERSION_MUX
+ *   connection, costs no more than its slot.
+ *
+ *   return: 1 if succeed, else 0
+ */
+int attachBuffers(struct session_table *table, struct board_info *boardInfoPtr) {
+    struct connection_buffers *buffers = table->spareBuffers;
+    if (buffers != NULL) {
+        table->spareBuffers = buffers->next;
+        table->spareCount--;
+    } else if ((buffers = malloc(sizeof(struct connection_buffers))) == NULL) {
+        return 0;
+    }
+    initRecvRing(&buffers->recvRing);
+    initOutQueue(&buffers->outQueue);
+    boardInfoPtr->buffers = buffers;
+    return 1;
+}
+
+
+/*
+ * keep the buffers of a slot whose socket has closed for the next
+ * connection, up to SPARE_BUFFERS of them
+ */
+void releaseBuffers(struct session_table *table, struct board_info *boardInfoPtr) {
+    struct connection_buffers *buffers = boardInfoPtr->buffers;
+    if (buffers == NULL) return;
+    boardInfoPtr->buffers = NULL;
+    if (table->spareCount >= SPARE_BUFFERS) {
+        free(buffers);
+        return;
+    }
+    buffers->next = table->spareBuffers;
+    table->spareBuffers = buffers;
+    table->spareCount++;
+}
+
+
+/*
+ * Function: releaseSession
+ * ----------------------------
+ *   Return a slot to the free list in O(1), with its buffers and its
+ *   wideboard. The caller closes the socket.
+ */
+void releaseSession(struct session_table *table, struct board_info *boardInfoPtr) {
+    releaseBuffers(table, boardInfoPtr);
+    free(boardInfoPtr->wide);
+    boardInfoPtr->wide = NULL;
+    // other loops look for detached games by token
+    __atomic_store_n(&boardInfoPtr->secret, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&boardInfoPtr->sd, 0, __ATOMIC_RELEASE);
+    boardInfoPtr->nextFree = table->freeHead;
+    table->freeHead = boardInfoPtr->gameId - table->firstGameId;
+    __atomic_store_n(&table->active, table->active - 1, __ATOMIC_RELAXED);
+}
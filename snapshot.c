@@ -0,0 +1,259 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tictactoe.h"
+
+
+/*
+ * A file mapped shared into the server holding one fixed-size record per
+ * slot of a session table. Records are plain stores into the page cache,
+ * so they outlive a crash or kill of the process; a restarted server reads
+ * back the live ones instead of losing every game in progress.
+ */
+
+
+#define SNAPSHOT_MAGIC 0x32535454  // "TTS2"
+
+struct snapshot_header {
+    uint32_t magic;
+    uint32_t recordSize;
+    uint32_t capacity;
+    uint32_t firstGameId;
+    uint8_t reserved[16];
+};
+
+
+/*
+ * FNV-1a over everything but the checksum, a record torn by a crash in
+ * the middle of saveRecord does not match it
+ */
+uint32_t recordChecksum(const struct game_record *record) {
+    const uint8_t *bytes = (const uint8_t *) record;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(struct game_record, checksum); i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+
+/*
+ * Function: inspectSnapshot
+ * ----------------------------
+ *   Read the table geometry a snapshot file was written for, leaving the
+ *   file as it is
+ *
+ *   capacity, firstGameId: get those of the session table it belonged to
+ *
+ *   return: the number of live games in it, -1 if there is no snapshot
+ *   of this format at path
+ */
+int inspectSnapshot(const char *path, uint32_t *capacity, uint32_t *firstGameId) {
+    struct snapshot snap;
+    snap.fd = open(path, O_RDONLY);
+    if (snap.fd < 0) return -1;
+    struct snapshot_header header;
+    struct stat st;
+    if (fstat(snap.fd, &st) < 0 || pread(snap.fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)
+        || header.magic != SNAPSHOT_MAGIC || header.recordSize != sizeof(struct game_record)
+        || (size_t) st.st_size != sizeof(struct snapshot_header) + (size_t) header.capacity * sizeof(struct game_record)) {
+        close(snap.fd);
+        return -1;
+    }
+    snap.size = (size_t) st.st_size;
+    void *map = mmap(NULL, snap.size, PROT_READ, MAP_SHARED, snap.fd, 0);
+    close(snap.fd);
+    if (map == MAP_FAILED) return -1;
+    snap.header = map;
+    snap.records = (struct game_record *) ((uint8_t *) map + sizeof(struct snapshot_header));
+
+    int live = 0;
+    for (uint32_t slot = 0; slot < header.capacity; slot++)
+        if (liveRecord(&snap, slot) != NULL) live++;
+    munmap(map, snap.size);
+    *capacity = header.capacity;
+    *firstGameId = header.firstGameId;
+    return live;
+}
+
+
+/*
+ * Function: checkSnapshots
+ * ----------------------------
+ *   Make sure the snapshots of a server's loops fit the server: a loop
+ *   only reads back the file written for its own slice of the session
+ *   table, so with other -n or -w the live games of a snapshot would be
+ *   lost when it is started over.
+ *
+ *   path: the snapshot path given to the server, each loop appends its id
+ *
+ *   return: 1 if every live game can be recovered, else 0 after logging
+ *   what the server has to be started with
+ */
+int checkSnapshots(const char *path, int workers, uint32_t shardCapacity) {
+    int written = 0, misfit = -1;
+    uint32_t writtenCapacity = 0;
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        char loopPath[PATH_MAX];
+        snprintf(loopPath, sizeof(loopPath), "%s.%d", path, i);
+        uint32_t capacity, firstGameId;
+        int live = inspectSnapshot(loopPath, &capacity, &firstGameId);
+        if (live < 0) continue;
+        written = i + 1;
+        if (live == 0 || misfit >= 0) continue;
+        if (i >= workers || capacity != shardCapacity || firstGameId != (uint32_t) i * shardCapacity) {
+            misfit = i;
+            writtenCapacity = capacity;
+        }
+    }
+    if (misfit < 0) return 1;
+    LOG(LOG_ERROR, "The snapshot of loop %d has live games of a server with -n %u -w %d, "
+                   "start with those or move the snapshot away.\n",
+        misfit, writtenCapacity * (uint32_t) written, written);
+    return 0;
+}
+
+
+/*
+ * Function: openSnapshot
+ * ----------------------------
+ *   Map the snapshot file of a session table, creating it if needed. A
+ *   file of another format, or written for another table geometry without
+ *   a live game, see checkSnapshots, is started over empty.
+ *
+ *   return: 1 if succeed, else 0
+ */
+int openSnapshot(struct snapshot *snap, const char *path, uint32_t capacity, uint32_t firstGameId) {
+    snap->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (snap->fd < 0) {
+        logErrno(LOG_ERROR, "Failed to open snapshot");
+        return 0;
+    }
+    snap->size = sizeof(struct snapshot_header) + (size_t) capacity * sizeof(struct game_record);
+    snap->capacity = capacity;
+
+    // read the header before mapping, a mismatched file is truncated to zeros
+    struct snapshot_header header;
+    struct stat st;
+    int matches = fstat(snap->fd, &st) == 0 && (size_t) st.st_size == snap->size
+            && pread(snap->fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header)
+            && header.magic == SNAPSHOT_MAGIC && header.recordSize == sizeof(struct game_record)
+            && header.capacity == capacity && header.firstGameId == firstGameId;
+    if (matches == 0) {
+        if (st.st_size > 0) LOG(LOG_WARN, "Starting over a snapshot with no game this server can recover.\n");
+        if (ftruncate(snap->fd, 0) < 0 || ftruncate(snap->fd, (off_t) snap->size) < 0) {
+            logErrno(LOG_ERROR, "Failed to size snapshot");
+            close(snap->fd);
+            return 0;
+        }
+    }
+
+    void *map = mmap(NULL, snap->size, PROT_READ | PROT_WRITE, MAP_SHARED, snap->fd, 0);
+    if (map == MAP_FAILED) {
+        logErrno(LOG_ERROR, "Failed to map snapshot");
+        close(snap->fd);
+        return 0;
+    }
+    snap->header = map;
+    snap->records = (struct game_record *) ((uint8_t *) map + sizeof(struct snapshot_header));
+    if (matches == 0) {
+        memset(snap->header, 0, sizeof(struct snapshot_header));
+        snap->header->recordSize = sizeof(struct game_record);
+        snap->header->capacity = capacity;
+        snap->header->firstGameId = firstGameId;
+        snap->header->magic = SNAPSHOT_MAGIC;
+    }
+    return 1;
+}
+
+
+void closeSnapshot(struct snapshot *snap) {
+    if (snap->header == NULL) return;
+    msync(snap->header, snap->size, MS_SYNC);
+    munmap(snap->header, snap->size);
+    close(snap->fd);
+    snap->header = NULL;
+    snap->records = NULL;
+}
+
+
+/*
+ * the record of slot if it holds a game that was live, else NULL
+ */
+const struct game_record *liveRecord(const struct snapshot *snap, uint32_t slot) {
+    const struct game_record *record = &snap->records[slot];
+    if (record->state != RECORD_LIVE
+        || record->gameId != snap->header->firstGameId + slot
+        || isRecordValid(record) == 0)
+        return NULL;
+    return record;
+}
+
+
+/*
+ * Function: fillRecord
+ * ----------------------------
+ *   Describe a game: its board, sequence number, version, session token
+ *   and the header of the last frame sent to it
+ *
+ *   state: RECORD_LIVE, or RECORD_FREE for a game that has ended
+ *
+ *   token: the game's session token, NULL if it has none
+ */
+void fillRecord(struct game_record *record, const struct board_info *boardInfoPtr, uint8_t state,
+                const uint8_t token[TOKEN_SIZE]) {
+    record->gameId = boardInfoPtr->gameId;
+    record->sequenceNum = boardInfoPtr->sequenceNum;
+    record->board = boardInfoPtr->board;
+    record->state = state;
+    record->version = boardInfoPtr->version;
+    record->resendCount = (uint8_t) boardInfoPtr->resendCount;
+    record->reserved = 0;
+    if (token != NULL) memcpy(record->token, token, TOKEN_SIZE);
+    else memset(record->token, 0, TOKEN_SIZE);
+    memcpy(record->lastFrame, boardInfoPtr->bufferSend, COMPACT_FRAME_SIZE);
+    record->checksum = recordChecksum(record);
+}
+
+
+int isRecordValid(const struct game_record *record) {
+    return record->checksum == recordChecksum(record);
+}
+
+
+/*
+ * Function: matchRecord
+ * ----------------------------
+ *   Tell whether the board of a RECONNECT continues a recorded game. The
+ *   client's board either has one more X than the record, the server did
+ *   not see that move, or lacks the server's last move, whose frame was
+ *   lost.
+ *
+ *   return: -1 if it does not, 0 if the server is to choose its next
+ *   move, else the lost move to send again
+ */
+int matchRecord(const struct game_record *record, const struct bitboard *board) {
+    if (board->o == record->board.o && (board->x & record->board.x) == record->board.x
+        && __builtin_popcount(board->x ^ record->board.x) <= 1)
+        return 0;
+
+    // the last frame played a move if it is a MOVE frame with a valid choice
+    uint8_t choice = record->lastFrame[1];
+    if (record->lastFrame[4] != MOVE || record->lastFrame[2] == GAME_ERROR
+        || choice < 1 || choice > ROWS * COLUMNS)
+        return -1;
+    uint16_t lastMove = (uint16_t) (1 << (choice - 1));
+    if ((record->board.o & lastMove) && board->x == record->board.x
+        && board->o == (record->board.o & ~lastMove))
+        return choice;
+    return -1;
+}
+
+
+void saveRecord(struct snapshot *snap, uint32_t slot, const struct game_record *record) {
+    snap->records[slot] = *record;
+}
+
+
+void clearRecord(struct snapshot *snap, uint32_t slot) {
+    snap->records[slot].state = RECORD_FREE;
+}
@@ -0,0 +1,173 @@
+#include <poll.h>
+#include <pthread.h>
+
+#include "tictactoe.h"
+
+
+/*
+ * Serves the counters of every event loop on a local TCP port in the
+ * Prometheus text format. Each connection gets one snapshot; a request
+ * starting with "GET" gets it behind an HTTP header, anything else
+ * (e.g. nc) gets the bare text.
+ */
+
+
+// how long a scraper has to send its request before it gets bare text
+#define STATS_REQUEST_WAIT_MS 100
+
+static const char *statNames[STAT_COUNT][2] = {
+        {"tictactoe_games_started_total", NULL},
+        {"tictactoe_games_completed_total", NULL},
+        {"tictactoe_games_timed_out_total", NULL},
+        {"tictactoe_disconnects_total", NULL},
+        {"tictactoe_resends_total", NULL},
+        {"tictactoe_out_of_resources_total", NULL},
+        {"tictactoe_multicast_answered_total", NULL},
+        {"tictactoe_slow_consumers_total", NULL},
+        {"tictactoe_games_resumed_total", NULL},
+        {"tictactoe_malformed_requests_total", "version"},
+        {"tictactoe_malformed_requests_total", "game_type"},
+        {"tictactoe_malformed_requests_total", "game_id"},
+        {"tictactoe_malformed_requests_total", "sequence"},
+        {"tictactoe_malformed_requests_total", "move"},
+        {"tictactoe_malformed_requests_total", "status"},
+        {"tictactoe_malformed_requests_total", "board"},
+        {"tictactoe_malformed_requests_total", "variant"},
+        {"tictactoe_waitlisted_total", NULL},
+        {"tictactoe_waitlist_abandoned_total", NULL},
+};
+
+static struct loop_stats *const *loopStats;
+static int loopCount;
+static int sd_stats = -1;
+static pthread_t statsThread;
+static volatile int statsRunning;
+
+
+/*
+ * write a snapshot of all loops in the Prometheus text format
+ */
+void writeStats(FILE *out) {
+    fprintf(out, "# TYPE tictactoe_active_games gauge\n");
+    for (int l = 0; l < loopCount; l++)
+        fprintf(out, "tictactoe_active_games{loop=\"%d\"} %u\n",
+                l, __atomic_load_n(&loopStats[l]->sessions->active, __ATOMIC_RELAXED));
+
+    for (int i = 0; i < STAT_COUNT; i++) {
+        // reasons of one metric are contiguous, its TYPE line goes first
+        if (i == 0 || strcmp(statNames[i][0], statNames[i - 1][0]) != 0)
+            fprintf(out, "# TYPE %s counter\n", statNames[i][0]);
+        for (int l = 0; l < loopCount; l++) {
+            uint64_t value = __atomic_load_n(&loopStats[l]->counters[i], __ATOMIC_RELAXED);
+            if (statNames[i][1] != NULL)
+                fprintf(out, "%s{loop=\"%d\",reason=\"%s\"} %lu\n",
+                        statNames[i][0], l, statNames[i][1], (unsigned long) value);
+            else
+                fprintf(out, "%s{loop=\"%d\"} %lu\n", statNames[i][0], l, (unsigned long) value);
+        }
+    }
+
+    static struct histogram latency;
+    initHistogram(&latency);
+    for (int l = 0; l < loopCount; l++) mergeHistogram(&latency, &loopStats[l]->moveLatency);
+
+    const double quantiles[4] = {0.5, 0.9, 0.99, 0.999};
+    fprintf(out, "# TYPE tictactoe_move_latency_us summary\n");
+    for (int q = 0; q < 4; q++)
+        fprintf(out, "tictactoe_move_latency_us{quantile=\"%g\"} %lu\n",
+                quantiles[q], (unsigned long) histogramPercentile(&latency, quantiles[q] * 100));
+    fprintf(out, "tictactoe_move_latency_us_sum %lu\n", (unsigned long) latency.sum);
+    fprintf(out, "tictactoe_move_latency_us_count %lu\n", (unsigned long) latency.total);
+}
+
+
+void serveStats(int sd) {
+    char request[16] = {0};
+    struct pollfd pfd = {sd, POLLIN, 0};
+    if (poll(&pfd, 1, STATS_REQUEST_WAIT_MS) == 1) recv(sd, request, sizeof(request) - 1, 0);
+
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    if (out == NULL) return;
+    if (strncmp(request, "GET", 3) == 0)
+        fprintf(out, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n\r\n");
+    writeStats(out);
+    fclose(out);
+
+    for (size_t sent = 0; sent < length;) {
+        ssize_t rc = send(sd, text + sent, length - sent, MSG_NOSIGNAL);
+        if (rc <= 0) break;
+        sent += (size_t) rc;
+    }
+    free(text);
+}
+
+
+void *runStatsThread(void *arg) {
+    while (statsRunning) {
+        struct pollfd pfd = {sd_stats, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) != 1) continue;
+
+        int sd = accept(sd_stats, NULL, NULL);
+        if (sd < 0) continue;
+        serveStats(sd);
+        close(sd);
+    }
+    return NULL;
+}
+
+
+/*
+ * Function: startStatsThread
+ * ----------------------------
+ *   Serve metrics on 127.0.0.1:port from a thread of their own
+ *
+ *   stats: the counters of each event loop, they must outlive the thread
+ *
+ *   return: 1 on success, else 0
+ */
+int startStatsThread(long port, struct loop_stats *const stats[], int count) {
+    loopStats = stats;
+    loopCount = count;
+
+    sd_stats = socket(AF_INET, SOCK_STREAM, 0);
+    if (sd_stats < 0) {
+        logErrno(LOG_ERROR, "Opening stats socket error");
+        return 0;
+    }
+    int one = 1;
+    setsockopt(sd_stats, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sd_stats, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(sd_stats, 16) < 0) {
+        logErrno(LOG_ERROR, "Failed to open stats port");
+        close(sd_stats);
+        sd_stats = -1;
+        return 0;
+    }
+
+    statsRunning = 1;
+    if (pthread_create(&statsThread, NULL, runStatsThread, NULL) != 0) {
+        logErrno(LOG_ERROR, "Failed to start stats thread");
+        statsRunning = 0;
+        close(sd_stats);
+        sd_stats = -1;
+        return 0;
+    }
+    LOG(LOG_INFO, "Serving metrics on 127.0.0.1:%d.\n", (int) port);
+    return 1;
+}
+
+
+void stopStatsThread() {
+    if (sd_stats < 0) return;
+    statsRunning = 0;
+    pthread_join(statsThread, NULL);
+    close(sd_stats);
+    sd_stats = -1;
+}
@@ -0,0 +1,568 @@
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "tictactoe.h"
+
+
+/*
+ * Protocol checks against a real server: each one forks a server on a
+ * loopback port, plays frames at it and compares the answers. Every
+ * result is one "test=<name> result=ok|FAIL" line, and the exit status
+ * is the number of failures.
+ */
+
+
+// how long a check waits for a frame before it fails
+#define TEST_RECV_TIMEOUT_MS 2000
+
+
+struct test_server {
+    pid_t pid;
+    int port;
+};
+
+
+/*
+ * fork a server with config on an ephemeral loopback port
+ *
+ * return 1 if it is listening, else 0
+ */
+int startServer(struct test_server *server, struct server_config *config) {
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (sd < 0 || bind(sd, (struct sockaddr *) &address, sizeof(address)) < 0
+        || listen(sd, config->backlog) < 0
+        || getsockname(sd, (struct sockaddr *) &address, &length) < 0) {
+        perror("test listen");
+        return 0;
+    }
+    server->port = ntohs(address.sin_port);
+    config->portNumber = server->port;
+
+    server->pid = fork();
+    if (server->pid < 0) {
+        perror("fork");
+        return 0;
+    }
+    if (server->pid == 0) {
+        int streams[1] = {sd};
+        playServer(streams, -1, config);
+        _exit(0);
+    }
+    close(sd);
+    return 1;
+}
+
+
+void stopServer(struct test_server *server) {
+    kill(server->pid, SIGKILL);
+    waitpid(server->pid, NULL, 0);
+}
+
+
+/*
+ * the defaults of tictactoeServer, quiet, on one loop
+ */
+void defaultConfig(struct server_config *config) {
+    memset(config, 0, sizeof(*config));
+    config->maxBoards = MAX_BOARD;
+    config->aiLevel = AI_HARD;
+    config->workers = 1;
+    config->timeoutMs = TIME_LIMIT_SERVER * 1000;
+    config->logLevel = LOG_ERROR;
+    config->engine = ENGINE_EPOLL;
+    config->waitlist = WAITLIST_SIZE;
+    config->backlog = LISTEN_BACKLOG;
+}
+
+
+int connectServer(const struct test_server *server) {
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(server->port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct timeval timeout = {TEST_RECV_TIMEOUT_MS / 1000, (TEST_RECV_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(sd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        perror("test connect");
+        close(sd);
+        return -1;
+    }
+    return sd;
+}
+
+
+/*
+ * read one whole frame, whatever its version, return 1 if succeed, else 0
+ */
+int recvFrame(int sd, uint8_t frame[BUFFER_SIZE]) {
+    int got = 0, len = COMPACT_FRAME_SIZE;
+    while (got < len) {
+        int rc = (int) recv(sd, frame + got, len - got, 0);
+        if (rc <= 0) return 0;
+        got += rc;
+        if (got >= 1) len = frameLength(frame[0]);
+    }
+    return 1;
+}
+
+
+/*
+ * read the answer to the first frame of a connection, past the GAME_QUEUED
+ * a full server sends first, return 1 if succeed, else 0
+ */
+int recvAnswer(int sd, uint8_t frame[BUFFER_SIZE]) {
+    int received;
+    while ((received = recvFrame(sd, frame)) && frame[2] == GAME_QUEUED) continue;
+    return received;
+}
+
+
+void sendFrame(int sd, uint8_t version, uint8_t choice, uint8_t status, uint8_t statusModifier,
+               uint8_t gameType, uint32_t gameId, uint32_t sequenceNum) {
+    uint8_t frame[BUFFER_SIZE] = {0};
+    writeFrameHeader(frame, version, choice, status, statusModifier, gameType, gameId, sequenceNum);
+    send(sd, frame, frameLength(version), MSG_NOSIGNAL);
+}
+
+
+int report(const char *name, int ok) {
+    printf("test=%s result=%s\n", name, ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
+
+
+/*
+ * A duplicate of the client's last move gets the server's last move
+ * again, even when an error was sent in between, and a legacy frame
+ * never carries anything past its header and token.
+ */
+int testResendAfterError(uint8_t version) {
+    struct server_config config;
+    defaultConfig(&config);
+    struct test_server server;
+    if (startServer(&server, &config) == 0) return 1;
+
+    int ok = 0;
+    int sd = connectServer(&server);
+    uint8_t reply[BUFFER_SIZE], move[BUFFER_SIZE], error[BUFFER_SIZE], resent[BUFFER_SIZE];
+    if (sd >= 0) {
+        sendFrame(sd, version, 0, GAME_ON, 0, NEW_GAME, 0, 0);
+        const int started = recvFrame(sd, reply) && reply[2] == GAME_ON;
+        const uint8_t gameId = reply[5];
+
+        sendFrame(sd, version, 5, GAME_ON, 0, MOVE, gameId, 2);
+        const int moved = recvFrame(sd, move) && move[2] == GAME_ON && move[6] == 3;
+
+        // square 5 is taken
+        sendFrame(sd, version, 5, GAME_ON, 0, MOVE, gameId, 4);
+        const int refused = recvFrame(sd, error) && error[2] == GAME_ERROR && error[3] == MALFORMED_REQUEST;
+
+        sendFrame(sd, version, 5, GAME_ON, 0, MOVE, gameId, 2);
+        const int len = frameLength(version);
+        const int same = recvFrame(sd, resent) && memcmp(resent, move, len) == 0;
+
+        int clean = 1;
+        for (int i = COMPACT_FRAME_SIZE; i < len; i++)
+            clean &= (move[i] | error[i] | resent[i]) == 0;
+        ok = started && moved && refused && same && clean;
+        close(sd);
+    }
+    stopServer(&server);
+    return report(version == VERSION ? "resendAfterError/legacy" : "resendAfterError/compact", ok);
+}
+
+
+/*
+ * A client that loses its connection mid-game and RESUMEs it on a new
+ * one with its token gets its last move answered again, in the same
+ * game under the same gameId, and plays on; an unknown token is refused
+ * and leaves the connection usable.
+ */
+int testResume(int engine) {
+    struct server_config config;
+    defaultConfig(&config);
+    config.engine = engine;
+    struct test_server server;
+    if (startServer(&server, &config) == 0) return 1;
+
+    uint8_t reply[BUFFER_SIZE], move[BUFFER_SIZE], resent[BUFFER_SIZE], frame[BUFFER_SIZE] = {0};
+    int sd = connectServer(&server);
+    sendFrame(sd, VERSION_COMPACT, 0, GAME_ON, 0, NEW_GAME, 0, 0);
+    const int started = recvFrame(sd, reply) && reply[2] == GAME_ON;
+    const uint8_t gameId = reply[5];
+    sendFrame(sd, VERSION_COMPACT, 5, GAME_ON, 0, MOVE, gameId, 2);
+    const int moved = recvFrame(sd, move) && move[2] == GAME_ON;
+    close(sd);
+    // the server has to see the connection go first
+    usleep(100 * 1000);
+
+    sd = connectServer(&server);
+    writeFrameHeader(frame, VERSION_COMPACT, 5, GAME_ON, 0, RESUME, gameId, 2);
+    memcpy(frame + TOKEN_OFFSET, move + TOKEN_OFFSET, TOKEN_SIZE);
+    send(sd, frame, COMPACT_FRAME_SIZE, MSG_NOSIGNAL);
+    const int resumed = recvFrame(sd, resent) && memcmp(resent, move, TOKEN_OFFSET) == 0
+                        && memcmp(resent + TOKEN_OFFSET, move + TOKEN_OFFSET, TOKEN_SIZE) != 0;
+
+    // square 5 and the server's answer are taken, find a free one
+    int choice = 1;
+    while (choice == 5 || choice == move[1]) choice++;
+    sendFrame(sd, VERSION_COMPACT, (uint8_t) choice, GAME_ON, 0, MOVE, gameId, 4);
+    const int playsOn = recvFrame(sd, reply) && reply[2] != GAME_ERROR && reply[5] == gameId && reply[6] == 5;
+    close(sd);
+
+    sd = connectServer(&server);
+    send(sd, frame, COMPACT_FRAME_SIZE, MSG_NOSIGNAL);
+    const int unknown = recvFrame(sd, reply) && reply[2] == GAME_ERROR && reply[3] == UNKNOWN_SESSION;
+    sendFrame(sd, VERSION_COMPACT, 0, GAME_ON, 0, NEW_GAME, 0, 0);
+    const int usable = recvFrame(sd, reply) && reply[2] == GAME_ON;
+    close(sd);
+
+    stopServer(&server);
+    return report(engine == ENGINE_URING ? "resume/uring" : "resume/epoll",
+                  started && moved && resumed && playsOn && unknown && usable);
+}
+
+
+/*
+ * a loopback port free right now, for the stats listener the server opens itself
+ */
+int freePort() {
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    int port = 0;
+    if (sd >= 0 && bind(sd, (struct sockaddr *) &address, sizeof(address)) == 0
+        && getsockname(sd, (struct sockaddr *) &address, &length) == 0)
+        port = ntohs(address.sin_port);
+    if (sd >= 0) close(sd);
+    return port;
+}
+
+
+/*
+ * read the value loop 0 reports for a counter on the stats port, -1 if none
+ */
+long readStat(int statsPort, const char *name) {
+    struct test_server stats = {0, statsPort};
+    int sd = connectServer(&stats);
+    if (sd < 0) return -1;
+    static char page[1 << 16];
+    int got = 0, rc;
+    while (got < (int) sizeof(page) - 1 && (rc = (int) recv(sd, page + got, sizeof(page) - 1 - got, 0)) > 0)
+        got += rc;
+    page[got] = 0;
+    close(sd);
+
+    char line[128];
+    snprintf(line, sizeof(line), "\n%s{loop=\"0\"} ", name);
+    const char *found = strstr(page, line);
+    return found == NULL ? -1 : strtol(found + strlen(line), NULL, 10);
+}
+
+
+/*
+ * A waiting connection whose client hangs up leaves the waitlist at
+ * once rather than when a board frees up, those behind it move up, and
+ * each one is told its position when it joins.
+ */
+int testWaiterHangup(int engine) {
+    struct server_config config;
+    defaultConfig(&config);
+    config.maxBoards = 1;
+    config.timeoutMs = 100;
+    config.engine = engine;
+    config.statsPort = freePort();
+    struct test_server server;
+    if (startServer(&server, &config) == 0) return 1;
+
+    int ok = 0;
+    uint8_t reply[BUFFER_SIZE];
+    int playing = connectServer(&server);
+    sendFrame(playing, VERSION_COMPACT, 0, GAME_ON, 0, NEW_GAME, 0, 0);
+    const int started = recvFrame(playing, reply) && reply[2] == GAME_ON;
+
+    int first = connectServer(&server);
+    const int firstQueued = recvFrame(first, reply) && reply[2] == GAME_QUEUED && reply[5] == 0 && reply[6] == 1;
+    int second = connectServer(&server);
+    const int secondQueued = recvFrame(second, reply) && reply[2] == GAME_QUEUED && reply[6] == 2;
+    sendFrame(second, VERSION_COMPACT, 0, GAME_ON, 0, NEW_GAME, 0, 0);
+
+    close(first);
+    long abandoned = -1;
+    for (int tries = 0; tries < 20 && abandoned != 1; tries++) {
+        usleep(50 * 1000);
+        abandoned = readStat((int) config.statsPort, "tictactoe_waitlist_abandoned_total");
+    }
+
+    // the board goes to the second waiter once the game's timeouts run out
+    close(playing);
+    const int admitted = recvFrame(second, reply) && reply[2] == GAME_ON;
+    ok = started && firstQueued && secondQueued && abandoned == 1 && admitted;
+    close(second);
+    stopServer(&server);
+    return report(engine == ENGINE_URING ? "waiterHangup/uring" : "waiterHangup/epoll", ok);
+}
+
+
+/*
+ * On a full server, a RESUME does not queue behind the connections
+ * already waiting for the slot its own game holds: it is answered in
+ * that slot right away, and those waiting keep waiting.
+ */
+int testResumeWaiting(int engine) {
+    struct server_config config;
+    defaultConfig(&config);
+    config.maxBoards = 1;
+    config.timeoutMs = 1000;
+    config.engine = engine;
+    struct test_server server;
+    if (startServer(&server, &config) == 0) return 1;
+
+    uint8_t reply[BUFFER_SIZE], move[BUFFER_SIZE], resent[BUFFER_SIZE], frame[BUFFER_SIZE] = {0};
+    int sd = connectServer(&server);
+    sendFrame(sd, VERSION_COMPACT, 0, GAME_ON, 0, NEW_GAME, 0, 0);
+    const int started = recvFrame(sd, reply) && reply[2] == GAME_ON;
+    const uint8_t gameId = reply[5];
+    sendFrame(sd, VERSION_COMPACT, 5, GAME_ON, 0, MOVE, gameId, 2);
+    const int moved = recvFrame(sd, move) && move[2] == GAME_ON;
+    close(sd);
+    usleep(100 * 1000);
+
+    int waiting = connectServer(&server);
+    const int queued = recvFrame(waiting, reply) && reply[2] == GAME_QUEUED && reply[6] == 1;
+    sendFrame(waiting, VERSION_COMPACT, 0, GAME_ON, 0, NEW_GAME, 0, 0);
+
+    sd = connectServer(&server);
+    const uint64_t sent = monotonicMs();
+    writeFrameHeader(frame, VERSION_COMPACT, 5, GAME_ON, 0, RESUME, gameId, 2);
+    memcpy(frame + TOKEN_OFFSET, move + TOKEN_OFFSET, TOKEN_SIZE);
+    send(sd, frame, COMPACT_FRAME_SIZE, MSG_NOSIGNAL);
+    const int resumed = recvAnswer(sd, resent) && memcmp(resent, move, TOKEN_OFFSET) == 0
+                        && monotonicMs() - sent < config.timeoutMs;
+    const int stillWaiting = recv(waiting, reply, sizeof(reply), MSG_DONTWAIT) < 0 && errno == EAGAIN;
+    close(sd);
+    close(waiting);
+
+    stopServer(&server);
+    return report(engine == ENGINE_URING ? "resumeWaiting/uring" : "resumeWaiting/epoll",
+                  started && moved && queued && resumed && stillWaiting);
+}
+
+
+/*
+ * A client whose server goes down RESUMEs its game on the standby the
+ * server replicated it to, in one round trip: the standby answers its
+ * last move again under a gameId of its own and a new token, and the
+ * game plays on with the sequence numbers it had.
+ */
+int testStandby(int engine) {
+    struct server_config standbyConfig, config;
+    defaultConfig(&standbyConfig);
+    standbyConfig.engine = engine;
+    standbyConfig.replicaPort = freePort();
+    defaultConfig(&config);
+    config.engine = engine;
+    config.standby.sin_family = AF_INET;
+    config.standby.sin_port = htons((uint16_t) standbyConfig.replicaPort);
+    config.standby.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    struct test_server standby, server;
+    if (startServer(&standby, &standbyConfig) == 0) return 1;
+    if (startServer(&server, &config) == 0) {
+        stopServer(&standby);
+        return 1;
+    }
+
+    uint8_t reply[BUFFER_SIZE], move[BUFFER_SIZE], resent[BUFFER_SIZE], frame[BUFFER_SIZE] = {0};
+    int sd = connectServer(&server);
+    sendFrame(sd, VERSION_COMPACT, 0, GAME_ON, 0, NEW_GAME, 0, 0);
+    const int started = recvFrame(sd, reply) && reply[2] == GAME_ON;
+    const uint8_t gameId = reply[5];
+    sendFrame(sd, VERSION_COMPACT, 5, GAME_ON, 0, MOVE, gameId, 2);
+    const int moved = recvFrame(sd, move) && move[2] == GAME_ON;
+    // the record goes out with the move, and again with the next sweep
+    // should the standby not have been listening yet
+    usleep((REPLICA_SWEEP_MS + 200) * 1000);
+    stopServer(&server);
+    close(sd);
+
+    sd = connectServer(&standby);
+    writeFrameHeader(frame, VERSION_COMPACT, 5, GAME_ON, 0, RESUME, gameId, 2);
+    memcpy(frame + TOKEN_OFFSET, move + TOKEN_OFFSET, TOKEN_SIZE);
+    send(sd, frame, COMPACT_FRAME_SIZE, MSG_NOSIGNAL);
+    const int resumed = recvFrame(sd, resent) && memcmp(resent, move, 5) == 0 && resent[6] == move[6]
+                        && memcmp(resent + TOKEN_OFFSET, move + TOKEN_OFFSET, TOKEN_SIZE) != 0;
+    const uint8_t newGameId = resent[5];
+
+    int choice = 1;
+    while (choice == 5 || choice == move[1]) choice++;
+    sendFrame(sd, VERSION_COMPACT, (uint8_t) choice, GAME_ON, 0, MOVE, newGameId, 4);
+    const int playsOn = recvFrame(sd, reply) && reply[2] != GAME_ERROR && reply[5] == newGameId && reply[6] == 5;
+    close(sd);
+
+    // the game was taken over, its token is no good a second time
+    sd = connectServer(&standby);
+    send(sd, frame, COMPACT_FRAME_SIZE, MSG_NOSIGNAL);
+    const int once = recvFrame(sd, reply) && reply[2] == GAME_ERROR && reply[3] == UNKNOWN_SESSION;
+    close(sd);
+
+    stopServer(&standby);
+    return report(engine == ENGINE_URING ? "standby/uring" : "standby/epoll",
+                  started && moved && resumed && playsOn && once);
+}
+
+
+/*
+ * A server restarted on its snapshot sends a RECONNECT the move of the
+ * recovered game its client never received, answers the RESUME of
+ * another one with the token the old server issued, and a snapshot that
+ * a server with another -n or -w would lose games of is refused.
+ */
+int testRecover(int engine) {
+    char dir[] = "/tmp/tictactoeTestXXXXXX", path[64], loopPath[80];
+    if (mkdtemp(dir) == NULL) return report("recover", 0);
+    snprintf(path, sizeof(path), "%s/snapshot", dir);
+    snprintf(loopPath, sizeof(loopPath), "%s.0", path);
+
+    struct server_config config;
+    defaultConfig(&config);
+    config.engine = engine;
+    config.snapshotPath = path;
+    struct test_server server;
+    if (startServer(&server, &config) == 0) return 1;
+    uint8_t reply[BUFFER_SIZE], move[BUFFER_SIZE], frame[BUFFER_SIZE] = {0};
+    int sd = connectServer(&server);
+    sendFrame(sd, VERSION_COMPACT, 0, GAME_ON, 0, NEW_GAME, 0, 0);
+    const int started = recvFrame(sd, reply) && reply[2] == GAME_ON;
+    const uint8_t gameId = reply[5];
+    sendFrame(sd, VERSION_COMPACT, 5, GAME_ON, 0, MOVE, gameId, 2);
+    const int moved = recvFrame(sd, move) && move[2] == GAME_ON;
+    uint8_t other[BUFFER_SIZE], otherMove[BUFFER_SIZE];
+    int otherSd = connectServer(&server);
+    sendFrame(otherSd, VERSION_COMPACT, 0, GAME_ON, 0, NEW_GAME, 0, 0);
+    const int otherStarted = recvFrame(otherSd, other) && other[2] == GAME_ON;
+    sendFrame(otherSd, VERSION_COMPACT, 1, GAME_ON, 0, MOVE, other[5], 2);
+    const int otherMoved = recvFrame(otherSd, otherMove) && otherMove[2] == GAME_ON;
+    stopServer(&server);
+    close(sd);
+    close(otherSd);
+
+    const int fits = checkSnapshots(path, 1, config.maxBoards) == 1
+                     && checkSnapshots(path, 2, (config.maxBoards + 1) / 2) == 0
+                     && checkSnapshots(path, 1, config.maxBoards * 2) == 0;
+
+    config.statsPort = freePort();
+    if (startServer(&server, &config) == 0) return 1;
+    sd = connectServer(&server);
+    // the client lost the server's move
+    writeFrameHeader(frame, VERSION_COMPACT, 0, GAME_ON, 0, RECONNECT, gameId, 0);
+    frame[7 + 4] = 1;
+    send(sd, frame, COMPACT_FRAME_SIZE, MSG_NOSIGNAL);
+    const int replayed = recvFrame(sd, reply) && reply[2] == GAME_ON && reply[1] == move[1]
+                         && readStat((int) config.statsPort, "tictactoe_games_resumed_total") == 1;
+    close(sd);
+
+    sd = connectServer(&server);
+    memset(frame, 0, sizeof(frame));
+    writeFrameHeader(frame, VERSION_COMPACT, 1, GAME_ON, 0, RESUME, other[5], 2);
+    memcpy(frame + TOKEN_OFFSET, otherMove + TOKEN_OFFSET, TOKEN_SIZE);
+    send(sd, frame, COMPACT_FRAME_SIZE, MSG_NOSIGNAL);
+    const int resumed = recvFrame(sd, reply) && memcmp(reply, otherMove, TOKEN_OFFSET) == 0
+                        && readStat((int) config.statsPort, "tictactoe_games_resumed_total") == 2;
+    close(sd);
+    stopServer(&server);
+
+    unlink(loopPath);
+    rmdir(dir);
+    return report(engine == ENGINE_URING ? "recover/uring" : "recover/epoll",
+                  started && moved && otherStarted && otherMoved && fits && replayed && resumed);
+}
+
+
+/*
+ * On a server restarted full of recovered games, a RECONNECT does not
+ * wait for the slot of the game it continues: it is answered in that
+ * slot right away, long before the game would have expired, and the
+ * game plays on there.
+ */
+int testRecoverFull(int engine) {
+    char dir[] = "/tmp/tictactoeTestXXXXXX", path[64], loopPath[80];
+    if (mkdtemp(dir) == NULL) return report("recoverFull", 0);
+    snprintf(path, sizeof(path), "%s/snapshot", dir);
+    snprintf(loopPath, sizeof(loopPath), "%s.0", path);
+
+    struct server_config config;
+    defaultConfig(&config);
+    config.maxBoards = 1;
+    config.timeoutMs = 1000;
+    config.engine = engine;
+    config.snapshotPath = path;
+    struct test_server server;
+    if (startServer(&server, &config) == 0) return 1;
+    uint8_t reply[BUFFER_SIZE], move[BUFFER_SIZE], frame[BUFFER_SIZE] = {0};
+    int sd = connectServer(&server);
+    sendFrame(sd, VERSION_COMPACT, 0, GAME_ON, 0, NEW_GAME, 0, 0);
+    const int started = recvFrame(sd, reply) && reply[2] == GAME_ON;
+    const uint8_t gameId = reply[5];
+    sendFrame(sd, VERSION_COMPACT, 5, GAME_ON, 0, MOVE, gameId, 2);
+    const int moved = recvFrame(sd, move) && move[2] == GAME_ON;
+    stopServer(&server);
+    close(sd);
+
+    config.statsPort = freePort();
+    if (startServer(&server, &config) == 0) return 1;
+    sd = connectServer(&server);
+    const uint64_t sent = monotonicMs();
+    writeFrameHeader(frame, VERSION_COMPACT, 0, GAME_ON, 0, RECONNECT, gameId, 0);
+    frame[7 + 4] = 1;
+    send(sd, frame, COMPACT_FRAME_SIZE, MSG_NOSIGNAL);
+    const int replayed = recvAnswer(sd, reply) && reply[2] == GAME_ON && reply[1] == move[1]
+                         && monotonicMs() - sent < config.timeoutMs
+                         && readStat((int) config.statsPort, "tictactoe_games_resumed_total") == 1;
+    const uint8_t newGameId = reply[5];
+
+    int choice = 1;
+    while (choice == 5 || choice == move[1]) choice++;
+    // sequence numbers start over with a RECONNECT
+    sendFrame(sd, VERSION_COMPACT, (uint8_t) choice, GAME_ON, 0, MOVE, newGameId, 0);
+    const int playsOn = recvFrame(sd, reply) && reply[2] != GAME_ERROR && reply[5] == newGameId;
+    close(sd);
+    stopServer(&server);
+
+    unlink(loopPath);
+    rmdir(dir);
+    return report(engine == ENGINE_URING ? "recoverFull/uring" : "recoverFull/epoll",
+                  started && moved && replayed && playsOn);
+}
+
+
+int main() {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    signal(SIGPIPE, SIG_IGN);
+
+    int failures = 0;
+    failures += testResendAfterError(VERSION);
+    failures += testResendAfterError(VERSION_COMPACT);
+    failures += testResume(ENGINE_EPOLL);
+    failures += testResume(ENGINE_URING);
+    failures += testWaiterHangup(ENGINE_EPOLL);
+    failures += testWaiterHangup(ENGINE_URING);
+    failures += testResumeWaiting(ENGINE_EPOLL);
+    failures += testResumeWaiting(ENGINE_URING);
+    failures += testStandby(ENGINE_EPOLL);
+    failures += testStandby(ENGINE_URING);
+    failures += testRecover(ENGINE_EPOLL);
+    failures += testRecover(ENGINE_URING);
+    failures += testRecoverFull(ENGINE_EPOLL);
+    failures += testRecoverFull(ENGINE_URING);
+    return failures;
+}
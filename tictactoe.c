@@ -1,290 +1,599 @@
-#include "tictactoe.h"
-
-
-/*
- * Function: checkWin
- * ----------------------------
- *   Check if someone wins, or if there is a draw, or if the game should go on
- *
- *   board[ROWS][COLUMNS]: the board
- *
- *   mark: the mark of the player who moved last
- *
- *   return: Returns GAME_ON (0), DRAW (1), WIN (2), or LOSE (3)
- */
-int checkWin(char board[ROWS][COLUMNS], char mark) {
-    if (board[0][0] == board[0][1] && board[0][1] == board[0][2])  // row
-        return (mark == board[0][0]) ? WIN : LOSE;
-    else if (board[1][0] == board[1][1] && board[1][1] == board[1][2])  // row
-        return (mark == board[1][0]) ? WIN : LOSE;
-    else if (board[2][0] == board[2][1] && board[2][1] == board[2][2])  // row
-        return (mark == board[2][0]) ? WIN : LOSE;
-    else if (board[0][0] == board[1][0] && board[1][0] == board[2][0])  // column
-        return (mark == board[0][0]) ? WIN : LOSE;
-    else if (board[0][1] == board[1][1] && board[1][1] == board[2][1])  // column
-        return (mark == board[0][1]) ? WIN : LOSE;
-    else if (board[0][2] == board[1][2] && board[1][2] == board[2][2])  // column
-        return (mark == board[0][2]) ? WIN : LOSE;
-    else if (board[0][0] == board[1][1] && board[1][1] == board[2][2])  // diagonal
-        return (mark == board[0][0]) ? WIN : LOSE;
-    else if (board[2][0] == board[1][1] && board[1][1] == board[0][2])  // diagonal
-        return (mark == board[2][0]) ? WIN : LOSE;
-    else if (board[0][0] != '1' && board[0][1] != '2' && board[0][2] != '3' &&
-             board[1][0] != '4' && board[1][1] != '5' && board[1][2] != '6' &&
-             board[2][0] != '7' && board[2][1] != '8' && board[2][2] != '9')
-        return DRAW;
-    else return GAME_ON;
-}
-
-
-/*
- * Function: printBoard
- * ----------------------------
- *   Print out the board and all the squares/values
- *
- *   board[ROWS][COLUMNS]: the board
- *
- *   mark: the current player's mark
- */
-void printBoard(char board[ROWS][COLUMNS], char mark) {
-    printf("\n\n\n\tCurrent TicTacToe Game\n\n");
-    printf("Your mark is (%c)\n\n\n", mark);
-    printf("     |     |     \n");
-    printf("  %c  |  %c  |  %c \n", board[0][0], board[0][1], board[0][2]);
-    printf("_____|_____|_____\n");
-    printf("     |     |     \n");
-    printf("  %c  |  %c  |  %c \n", board[1][0], board[1][1], board[1][2]);
-    printf("_____|_____|_____\n");
-    printf("     |     |     \n");
-    printf("  %c  |  %c  |  %c \n", board[2][0], board[2][1], board[2][2]);
-    printf("     |     |     \n\n");
-}
-
-
-/*
- * return 1 if statusModifier == TRY_AGAIN else return 0
- */
-int parseGeneralError(uint8_t statusModifier) {
-    if (statusModifier == OUT_OF_RESOURCES) {
-        printf("Out of resources.\n");
-        return 1;
-    }
-    else if (statusModifier == MALFORMED_REQUEST)
-        printf("Malformed request.\n");
-    else if (statusModifier == SERVER_SHUTDOWN)
-        printf("Server shutdown.\n");
-    else if (statusModifier == TIME_OUT)
-        printf("Time out.\n");
-    else if (statusModifier == TRY_AGAIN) {
-        printf("Try again.\n");
-        return 1;
-    }
-    else printf("Unknown error.\n");
-
-    return 0;
-}
-
-
-void respondToInvalidRequest(
-        int sd,
-        int sendSequenceNum,
-        uint8_t gameId) {
-
-    uint8_t sb[BUFFER_SIZE] = {
-            VERSION, 0, GAME_ERROR, MALFORMED_REQUEST, MOVE, gameId,
-            (uint8_t) sendSequenceNum};
-
-    sendBuffer(sd, sb);
-}
-
-
-/*
- * Function: sendBuffer
- * ----------------------------
- *   send choice for each step in the game
- *
- *   sd: socket descriptor
- *
- *   buffer:
- *
- *   target_address_pointer: the pointer pointing to a target socket address
- *
- *   return: returns 1 if send succeed, else 0
- */
-int sendBuffer(int connected_sd, uint8_t buffer[BUFFER_SIZE]) {
-    int writeResult = (int) write(connected_sd, buffer, BUFFER_SIZE);
-    if (writeResult < 0) {
-        perror("Failed to send data");
-        return 0;
-    }
-    printf("SEND choice: %d status: %d statusModifier: %d "
-           "gameType: %d gameId: %d sequenceNum: %d\n",
-           buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6]);
-    return 1;
-}
-
-
-/*
- * Function: sendMoveWithChoice
- * ----------------------------
- *   Send a move to the other node, given a valid position
- *
- *   sd: socket file descriptor
- *
- *   choice:
- *
- *   gameId:
- *
- *   sequenceNum:
- *
- *   board[ROWS][COLUMNS]: the board for the game
- *
- *   mark: the mark for the player, either 'X' or 'O'
- *
- *   return: game status, either GAME_ON (0), or GAME_ERROR (2)
- */
-int sendMoveWithChoice(
-        int sd,
-        uint8_t choice,
-        uint8_t gameId,
-        uint8_t sequenceNum,
-        char board[ROWS][COLUMNS],
-        char mark) {
-
-    // 1. update board and check win
-    int row = (choice-1) / ROWS;
-    int column = (choice-1) % COLUMNS;
-
-    board[row][column] = mark;
-    printBoard(board, mark);
-
-    int result = checkWin(board, mark);
-
-    // 2. send msg
-    int status = (result == GAME_ON) ? GAME_ON : GAME_COMPLETE;
-
-    uint8_t sb[BUFFER_SIZE] = {
-            VERSION, choice, (uint8_t) status, (uint8_t) result, MOVE,
-            gameId, sequenceNum};
-
-    if (sendBuffer(sd, sb) == 0) return GAME_ERROR;
-    return GAME_ON;
-}
-
-
-/*
- * Function: isMoveValid
- * ----------------------------
- *   Check if a move overlaps with some previous move
- *
- *   board[ROWS][COLUMNS]: the board
- * 
- *   (row, column): the position of the new move
- * 
- *   choice: the position of the new move (1-9)
- *
- *   return: returns 0 if the new move is invalid, return 1 otherwise.
- */
-int isMoveValid(char board[ROWS][COLUMNS], int row, int column, int choice) {
-    if (choice > 9 || choice < 1) return 0;
-    if (board[row][column] == (choice+'0')) return 1;
-    else return 0;
-}
-
-
-/*
- * Function: initBoard
- * ----------------------------
- *   Initialize the board with values from 1 to 9
- *
- *   board[ROWS][COLUMNS]: the board
- */
-void initBoard(char board[ROWS][COLUMNS]) {
-    int i, j, count = 1;
-    for (i=0; i<3; i++) {
-        for (j = 0; j < 3; j++) {
-            board[i][j] = (char) (count + '0');
-            count++;
-        }
-    }
-}
-
-
-/*
- * Function: isDigitValid
- * ----------------------------
- *   check a given character is constructed by digits or not
- *   s: target string pointer
- *   return 1 if is valid digits else return 0
- */
-int isDigitValid(const char *s) {
-    while (*s) {
-        if (*s >= '0' && *s <= '9') s++;
-        else return 0;
-    }
-    return 1;
-}
-
-
-/*
- * Function: validate a given string is valid ip address or not
- * ----------------------------
- *   check a given character is constructed by digits or not
- *
- */
-int isIpValid(const char *ip) {
-    char ip_str[29];
-    strcpy(ip_str, ip);
-
-    int num, dots = 0;
-    char *ptr = strtok(ip_str, DELIM);
-
-    if (ip == NULL || ptr == NULL) return 0;
-
-    while (ptr) {
-        if (!isDigitValid(ptr)) return 0;
-
-        num = (uint8_t) strtol(ptr, NULL, 10);
-
-        if (num >= 0 && num <= 255) {
-            ptr = strtok(NULL, DELIM);
-            if (ptr != NULL) dots++;
-        }
-        else return 0;
-    }
-    return (dots == 3) ? 1 : 0;
-}
-
-
-/*
- * return 1 if port number is valid, else return 0
- */
-int isPortNumValid(const char *portNum) {
-    int len = (int) strlen(portNum);
-    if (len <= 0) return 0;
-    if (portNum[0] > '9' || portNum[0] < '1') return 0;
-    for (int i = 1; i < strlen(portNum); i++)
-        if (portNum[i] > '9' || portNum[i] < '0') return 0;
-    return 1;
-}
-
-
-/*
- * convert a network short type integer (2 bytes) to an array of uint8_t integers (1 byte)
- * where 1st element represents the first 8 bits and 2nd element represents the last 8 bits.
- * Both unsigned.
- */
-void u16_to_u8(uint16_t port_s, uint8_t port_array[2]) {
-    port_array[0] = port_s >> 0;
-    port_array[1] = port_s >> 8;
-}
-
-
-/*
- * reverse of u16_to_u8
- */
-uint16_t u8_to_u16(const uint8_t port_array[2]) {
-    uint16_t port_s = port_array[1] << 8;
-    port_s = port_s ^ (uint16_t) port_array[0];
-    return port_s;
-}
+#include "tictactoe.h"
+
+
+/*
+ * return the ternary encoding of a board (0 empty, 1 CLIENT_MARK,
+ * 2 SERVER_MARK per square), the index into outcomeTable
+ */
+int boardIndex(const struct bitboard *board) {
+    return ternaryTable[board->x] + 2 * ternaryTable[board->o];
+}
+
+
+/*
+ * return 1 if the board can be reached by alternating moves
+ * starting with CLIENT_MARK, else return 0
+ */
+int isPositionLegal(const struct bitboard *board) {
+    if ((board->x & board->o) != 0) return 0;
+    return (outcomeTable[boardIndex(board)] & LEGAL_POSITION) != 0;
+}
+
+
+/*
+ * Function: checkWin
+ * ----------------------------
+ *   Check if someone wins, or if there is a draw, or if the game should go on.
+ *   The outcome of every position is precomputed in outcomeTable.
+ *
+ *   board: the board
+ *
+ *   mark: the mark of the player who moved last
+ *
+ *   return: Returns GAME_ON (0), DRAW (1), WIN (2), or LOSE (3)
+ */
+int checkWin(const struct bitboard *board, char mark) {
+    const int outcome = outcomeTable[boardIndex(board)] & OUTCOME_MASK;
+
+    if (outcome == OUTCOME_X_WINS) return (mark == CLIENT_MARK) ? WIN : LOSE;
+    if (outcome == OUTCOME_O_WINS) return (mark == SERVER_MARK) ? WIN : LOSE;
+    if (outcome == OUTCOME_DRAW) return DRAW;
+    return GAME_ON;
+}
+
+
+/*
+ * Function: printBoard
+ * ----------------------------
+ *   Print out the board and all the squares/values
+ *
+ *   board: the board
+ *
+ *   mark: the current player's mark
+ */
+void printBoard(const struct bitboard *board, char mark) {
+    char squares[ROWS * COLUMNS];
+    for (int i = 0; i < ROWS * COLUMNS; i++) {
+        if ((board->x >> i) & 1) squares[i] = CLIENT_MARK;
+        else if ((board->o >> i) & 1) squares[i] = SERVER_MARK;
+        else squares[i] = (char) (i + 1 + '0');
+    }
+
+    printf("\n\n\n\tCurrent TicTacToe Game\n\n");
+    printf("Your mark is (%c)\n\n\n", mark);
+    printf("     |     |     \n");
+    printf("  %c  |  %c  |  %c \n", squares[0], squares[1], squares[2]);
+    printf("_____|_____|_____\n");
+    printf("     |     |     \n");
+    printf("  %c  |  %c  |  %c \n", squares[3], squares[4], squares[5]);
+    printf("_____|_____|_____\n");
+    printf("     |     |     \n");
+    printf("  %c  |  %c  |  %c \n", squares[6], squares[7], squares[8]);
+    printf("     |     |     \n\n");
+}
+
+
+/*
+ * return 1 if statusModifier == TRY_AGAIN else return 0
+ */
+int parseGeneralError(uint8_t statusModifier) {
+    if (statusModifier == OUT_OF_RESOURCES) {
+        LOG(LOG_WARN, "Out of resources.\n");
+        return 1;
+    }
+    else if (statusModifier == MALFORMED_REQUEST)
+        LOG(LOG_WARN, "Malformed request.\n");
+    else if (statusModifier == SERVER_SHUTDOWN)
+        LOG(LOG_WARN, "Server shutdown.\n");
+    else if (statusModifier == TIME_OUT)
+        LOG(LOG_WARN, "Time out.\n");
+    else if (statusModifier == TRY_AGAIN) {
+        LOG(LOG_WARN, "Try again.\n");
+        return 1;
+    }
+    else LOG(LOG_WARN, "Unknown error.\n");
+
+    return 0;
+}
+
+
+/*
+ * the frame sendMoveWithChoice and respondToInvalidRequest build, only its
+ * header is ever written, so the tail of a legacy frame stays zero
+ */
+static __thread uint8_t frameTemplate[BUFFER_SIZE];
+
+
+void respondToInvalidRequest(
+        int sd,
+        uint8_t version,
+        int sendSequenceNum,
+        uint8_t gameId) {
+
+    writeFrameHeader(frameTemplate, version, 0, GAME_ERROR, MALFORMED_REQUEST, MOVE,
+                     gameId, (uint32_t) sendSequenceNum);
+
+    sendBuffer(sd, frameTemplate);
+}
+
+
+/*
+ * return 1 if version is one of the protocol versions we speak, else return 0
+ */
+int isVersionValid(uint8_t version) {
+    return version == VERSION || version == VERSION_COMPACT || version == VERSION_MUX;
+}
+
+
+/*
+ * return the number of bytes of a frame whose 1st byte is version.
+ * Unknown versions are treated as legacy frames.
+ */
+int frameLength(uint8_t version) {
+    return (version == VERSION_COMPACT || version == VERSION_MUX) ? COMPACT_FRAME_SIZE : BUFFER_SIZE;
+}
+
+
+/*
+ * Function: writeFrameIds
+ * ----------------------------
+ *   Write the gameId and sequence number of a frame in the layout of its
+ *   version, sb[0]: one byte each, or 32 bits each for VERSION_MUX
+ */
+void writeFrameIds(uint8_t sb[COMPACT_FRAME_SIZE], uint32_t gameId, uint32_t sequenceNum) {
+    if (sb[0] != VERSION_MUX) {
+        sb[5] = (uint8_t) gameId;
+        sb[6] = (uint8_t) sequenceNum;
+        return;
+    }
+    gameId = htonl(gameId);
+    sequenceNum = htonl(sequenceNum);
+    memcpy(sb + MUX_GAME_ID_OFFSET, &gameId, sizeof(gameId));
+    memcpy(sb + MUX_SEQUENCE_OFFSET, &sequenceNum, sizeof(sequenceNum));
+}
+
+
+/*
+ * reverse of writeFrameIds
+ */
+void readFrameIds(const uint8_t buffer[COMPACT_FRAME_SIZE], uint32_t *gameId, uint32_t *sequenceNum) {
+    if (buffer[0] != VERSION_MUX) {
+        *gameId = buffer[5];
+        *sequenceNum = buffer[6];
+        return;
+    }
+    memcpy(gameId, buffer + MUX_GAME_ID_OFFSET, sizeof(*gameId));
+    memcpy(sequenceNum, buffer + MUX_SEQUENCE_OFFSET, sizeof(*sequenceNum));
+    *gameId = ntohl(*gameId);
+    *sequenceNum = ntohl(*sequenceNum);
+}
+
+
+/*
+ * Function: writeFrameHeader
+ * ----------------------------
+ *   Write the header of a frame in place, bytes past it are left as they
+ *   are, so a frame can be reused without clearing it
+ */
+void writeFrameHeader(
+        uint8_t sb[COMPACT_FRAME_SIZE],
+        uint8_t version,
+        uint8_t choice,
+        uint8_t status,
+        uint8_t statusModifier,
+        uint8_t gameType,
+        uint32_t gameId,
+        uint32_t sequenceNum) {
+
+    sb[0] = version;
+    sb[1] = choice;
+    sb[2] = status;
+    sb[3] = statusModifier;
+    sb[4] = gameType;
+    writeFrameIds(sb, gameId, sequenceNum);
+}
+
+
+/*
+ * gameIds and sequence numbers of a version count modulo frameIdMask(version) + 1
+ */
+uint32_t frameIdMask(uint8_t version) {
+    return (version == VERSION_MUX) ? UINT32_MAX : UINT8_MAX;
+}
+
+
+/*
+ * Function: compareSequence
+ * ----------------------------
+ *   Order two sequence numbers with serial number arithmetic (RFC 1982),
+ *   so that the order survives the counter wrapping around
+ *
+ *   return: negative if a comes before b, 0 if they are equal, else positive
+ */
+int compareSequence(uint8_t version, uint32_t a, uint32_t b) {
+    if (version == VERSION_MUX) return (int32_t) (a - b) < 0 ? -1 : (a != b);
+    return (int8_t) (uint8_t) (a - b);
+}
+
+
+/*
+ * Function: sendBuffer
+ * ----------------------------
+ *   send choice for each step in the game
+ *
+ *   sd: socket descriptor
+ *
+ *   buffer: the frame, only the first frameLength(buffer[0]) bytes are sent
+ *
+ *   return: returns 1 if send succeed, else 0
+ */
+int sendBuffer(int connected_sd, uint8_t buffer[BUFFER_SIZE]) {
+    int writeResult = (int) write(connected_sd, buffer, frameLength(buffer[0]));
+    if (writeResult < 0) {
+        logErrno(LOG_ERROR, "Failed to send data");
+        return 0;
+    }
+    LOG(LOG_DEBUG, "SEND choice: %d status: %d statusModifier: %d "
+           "gameType: %d gameId: %d sequenceNum: %d\n",
+           buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6]);
+    return 1;
+}
+
+
+void initOutQueue(struct out_queue *queue) {
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+
+/*
+ * Function: queueBytes
+ * ----------------------------
+ *   Append a frame to an output queue
+ *
+ *   return: 1 if it fits, 0 if the queue is over its high-water mark
+ */
+int queueBytes(struct out_queue *queue, const uint8_t *bytes, uint32_t len) {
+    const uint32_t mask = OUT_QUEUE_SIZE - 1;
+    if (OUT_QUEUE_SIZE - (queue->tail - queue->head) < len) return 0;
+
+    uint32_t start = queue->tail & mask;
+    uint32_t first = OUT_QUEUE_SIZE - start;
+    if (first >= len) {
+        memcpy(queue->data + start, bytes, len);
+    } else {
+        memcpy(queue->data + start, bytes, first);
+        memcpy(queue->data, bytes + first, len - first);
+    }
+    queue->tail += len;
+    return 1;
+}
+
+
+/*
+ * Function: flushOutQueue
+ * ----------------------------
+ *   Write everything queued with as few sendmsg calls as possible,
+ *   normally one covering both halves of the ring
+ *
+ *   return: 1 if the queue is empty or the socket is full, 0 on error
+ */
+int flushOutQueue(int sd, struct out_queue *queue) {
+    const uint32_t mask = OUT_QUEUE_SIZE - 1;
+    while (queue->tail != queue->head) {
+        uint32_t pending = queue->tail - queue->head;
+        uint32_t start = queue->head & mask;
+        uint32_t first = OUT_QUEUE_SIZE - start;
+        if (first > pending) first = pending;
+
+        struct iovec iov[2] = {
+                {queue->data + start, first},
+                {queue->data, pending - first}};
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (pending > first) ? 2 : 1;
+
+        int rc = (int) sendmsg(sd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (rc < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            logErrno(LOG_ERROR, "Failed to send data");
+            return 0;
+        }
+        queue->head += (uint32_t) rc;
+    }
+    return 1;
+}
+
+
+void initRecvRing(struct recv_ring *ring) {
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+
+/*
+ * Function: fillRecvRing
+ * ----------------------------
+ *   Read as much as fits into the free space of the ring with a single
+ *   readv, which may return partial frames or several frames at once
+ *
+ *   sd: socket descriptor
+ *
+ *   ring: the receive ring of the connection
+ *
+ *   return: the result of readv, 0 if the peer disconnected, -1 on error
+ */
+int fillRecvRing(int sd, struct recv_ring *ring) {
+    const uint32_t mask = RECV_RING_SIZE - 1;
+    uint32_t space = RECV_RING_SIZE - (ring->tail - ring->head);
+    uint32_t start = ring->tail & mask;
+    uint32_t first = RECV_RING_SIZE - start;
+    if (first > space) first = space;
+
+    struct iovec iov[2] = {
+            {ring->data + start, first},
+            {ring->data, space - first}};
+    int rc = (int) readv(sd, iov, (space > first) ? 2 : 1);
+    if (rc > 0) ring->tail += (uint32_t) rc;
+    return rc;
+}
+
+
+/*
+ * Function: pushRecvRing
+ * ----------------------------
+ *   Append bytes that were already received, e.g. by an io_uring recv
+ *
+ *   return: 1 if they fit, else 0
+ */
+int pushRecvRing(struct recv_ring *ring, const uint8_t *bytes, uint32_t len) {
+    const uint32_t mask = RECV_RING_SIZE - 1;
+    if (RECV_RING_SIZE - (ring->tail - ring->head) < len) return 0;
+
+    uint32_t start = ring->tail & mask;
+    uint32_t first = RECV_RING_SIZE - start;
+    if (first >= len) {
+        memcpy(ring->data + start, bytes, len);
+    } else {
+        memcpy(ring->data + start, bytes, first);
+        memcpy(ring->data, bytes + first, len - first);
+    }
+    ring->tail += len;
+    return 1;
+}
+
+
+/*
+ * Function: nextFrame
+ * ----------------------------
+ *   Take the oldest complete frame out of the ring, the frame size comes
+ *   from its version byte
+ *
+ *   ring: the receive ring of the connection
+ *
+ *   frame: receives the frame
+ *
+ *   return: 1 if a complete frame was copied, 0 if more bytes are needed
+ */
+int nextFrame(struct recv_ring *ring, uint8_t frame[BUFFER_SIZE]) {
+    const uint32_t mask = RECV_RING_SIZE - 1;
+    uint32_t available = ring->tail - ring->head;
+    if (available == 0) return 0;
+
+    uint32_t start = ring->head & mask;
+    uint32_t len = (uint32_t) frameLength(ring->data[start]);
+    if (available < len) return 0;
+
+    uint32_t first = RECV_RING_SIZE - start;
+    if (first >= len) {
+        memcpy(frame, ring->data + start, len);
+    } else {
+        memcpy(frame, ring->data + start, first);
+        memcpy(frame + first, ring->data, len - first);
+    }
+    ring->head += len;
+    return 1;
+}
+
+
+/*
+ * Function: buildMoveFrame
+ * ----------------------------
+ *   Play a valid move on the board and write the MOVE frame announcing it
+ *
+ *   sb: the frame, bytes past the header are left as they are
+ *
+ *   version: protocol version of the frame
+ *
+ *   choice:
+ *
+ *   gameId:
+ *
+ *   sequenceNum:
+ *
+ *   board: the board for the game
+ *
+ *   mark: the mark for the player, either 'X' or 'O'
+ */
+void buildMoveFrame(
+        uint8_t sb[COMPACT_FRAME_SIZE],
+        uint8_t version,
+        uint8_t choice,
+        uint32_t gameId,
+        uint32_t sequenceNum,
+        struct bitboard *board,
+        char mark) {
+
+    // 1. update board and check win
+    placeMark(board, choice, mark);
+    logBoard(board, mark);
+
+    int result = checkWin(board, mark);
+
+    // 2. build msg
+    int status = (result == GAME_ON) ? GAME_ON : GAME_COMPLETE;
+
+    writeFrameHeader(sb, version, choice, (uint8_t) status, (uint8_t) result, MOVE, gameId, sequenceNum);
+}
+
+
+/*
+ * Function: sendMoveWithChoice
+ * ----------------------------
+ *   Send a move to the other node, given a valid position
+ *
+ *   sd: socket file descriptor
+ *
+ *   the other arguments are the ones of buildMoveFrame
+ *
+ *   return: game status, either GAME_ON (0), or GAME_ERROR (2)
+ */
+int sendMoveWithChoice(
+        int sd,
+        uint8_t version,
+        uint8_t choice,
+        uint32_t gameId,
+        uint32_t sequenceNum,
+        struct bitboard *board,
+        char mark) {
+
+    buildMoveFrame(frameTemplate, version, choice, gameId, sequenceNum, board, mark);
+
+    if (sendBuffer(sd, frameTemplate) == 0) return GAME_ERROR;
+    return GAME_ON;
+}
+
+
+/*
+ * Function: isMoveValid
+ * ----------------------------
+ *   Check if a move overlaps with some previous move
+ *
+ *   board: the board
+ * 
+ *   choice: the position of the new move (1-9)
+ *
+ *   return: returns 0 if the new move is invalid, return 1 otherwise.
+ */
+int isMoveValid(const struct bitboard *board, int choice) {
+    if (choice > 9 || choice < 1) return 0;
+    return (((board->x | board->o) >> (choice-1)) & 1) == 0;
+}
+
+
+/*
+ * Function: placeMark
+ * ----------------------------
+ *   Put mark on square choice (1-9), the move must be valid
+ */
+void placeMark(struct bitboard *board, int choice, char mark) {
+    if (mark == CLIENT_MARK) board->x |= (uint16_t) (1 << (choice-1));
+    else board->o |= (uint16_t) (1 << (choice-1));
+}
+
+
+/*
+ * Function: initBoard
+ * ----------------------------
+ *   Initialize an empty board
+ *
+ *   board: the board
+ */
+void initBoard(struct bitboard *board) {
+    board->x = 0;
+    board->o = 0;
+}
+
+
+/*
+ * Function: isDigitValid
+ * ----------------------------
+ *   check a given character is constructed by digits or not
+ *   s: target string pointer
+ *   return 1 if is valid digits else return 0
+ */
+int isDigitValid(const char *s) {
+    while (*s) {
+        if (*s >= '0' && *s <= '9') s++;
+        else return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * Function: validate a given string is valid ip address or not
+ * ----------------------------
+ *   check a given character is constructed by digits or not
+ *
+ */
+int isIpValid(const char *ip) {
+    char ip_str[29];
+    strcpy(ip_str, ip);
+
+    int num, dots = 0;
+    char *ptr = strtok(ip_str, DELIM);
+
+    if (ip == NULL || ptr == NULL) return 0;
+
+    while (ptr) {
+        if (!isDigitValid(ptr)) return 0;
+
+        num = (uint8_t) strtol(ptr, NULL, 10);
+
+        if (num >= 0 && num <= 255) {
+            ptr = strtok(NULL, DELIM);
+            if (ptr != NULL) dots++;
+        }
+        else return 0;
+    }
+    return (dots == 3) ? 1 : 0;
+}
+
+
+/*
+ * return 1 if port number is valid, else return 0
+ */
+int isPortNumValid(const char *portNum) {
+    int len = (int) strlen(portNum);
+    if (len <= 0) return 0;
+    if (portNum[0] > '9' || portNum[0] < '1') return 0;
+    for (int i = 1; i < strlen(portNum); i++)
+        if (portNum[i] > '9' || portNum[i] < '0') return 0;
+    return 1;
+}
+
+
+/*
+ * put a socket into non-blocking mode, return 1 if succeed, else return 0
+ */
+int setNonBlocking(int sd) {
+    int flags = fcntl(sd, F_GETFL, 0);
+    if (flags < 0 || fcntl(sd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        logErrno(LOG_ERROR, "fcntl O_NONBLOCK");
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * convert a network short type integer (2 bytes) to an array of uint8_t integers (1 byte)
+ * where 1st element represents the first 8 bits and 2nd element represents the last 8 bits.
+ * Both unsigned.
+ */
+void u16_to_u8(uint16_t port_s, uint8_t port_array[2]) {
+    port_array[0] = port_s >> 0;
+    port_array[1] = port_s >> 8;
+}
+
+
+/*
+ * reverse of u16_to_u8
+ */
+uint16_t u8_to_u16(const uint8_t port_array[2]) {
+    uint16_t port_s = port_array[1] << 8;
+    port_s = port_s ^ (uint16_t) port_array[0];
+    return port_s;
+}
@@ -1,114 +1,672 @@
-#ifndef TICTACTOE_H
-#define TICTACTOE_H
-
-#include <arpa/inet.h>
-#include <errno.h>
-#include <limits.h>
-#include <memory.h>
-#include <netinet/in.h>
-#include <stdio.h>
-#include <stdint.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/socket.h>
-#include <sys/select.h>
-#include <time.h>
-#include <unistd.h>
-
-#include "tictactoe.h"
-
-
-#define ROWS  3
-#define COLUMNS  3
-#define MAX_BOARD 3
-#define MAX_TRY 3
-
-#define CLIENT_MARK 'X'
-#define SERVER_MARK 'O'
-
-// 1st byte
-#define VERSION 8
-
-// 3rd byte
-#define GAME_ON 0
-#define GAME_COMPLETE 1
-#define GAME_ERROR 2
-//#define RETRY 3
-
-// 4th byte, when 3rd byte == GAME_COMPLETE
-#define DRAW 1
-#define WIN 2
-#define LOSE 3
-
-// 4th byte, when 3rd byte == GAME_ERROR
-#define OUT_OF_RESOURCES 1
-#define MALFORMED_REQUEST 2
-#define SERVER_SHUTDOWN 3
-#define TIME_OUT 4
-#define TRY_AGAIN 5
-
-// 5th Byte
-#define NEW_GAME 0
-#define MOVE 1
-#define END_GAME 2
-#define RECONNECT 3
-
-#define BUFFER_SIZE 1000
-
-#define TIME_LIMIT_SERVER 10
-
-#define DELIM "."
-
-#define MAX_SEND_COUNT 3
-
-// multicast
-#define MC_PORT 1818
-#define MC_GROUP "239.0.0.1"
-
-
-int parseGeneralError(uint8_t statusModifier);
-
-int checkWin(char board[ROWS][COLUMNS], char mark);
-
-int isMoveValid(char board[ROWS][COLUMNS], int row, int column, int choice);
-
-void initBoard(char board[ROWS][COLUMNS]);
-
-void printBoard(char board[ROWS][COLUMNS], char mark);
-
-void playServer(
-        int sd_stream,
-        int sd_dgram,
-        long portNumber);
-
-void playClient(
-        int connected_sd,
-        int sd_dgram,
-        struct sockaddr_in multicast_address);
-
-int isIpValid(const char *ip_str);
-
-int isPortNumValid(const char *portNum);
-
-int sendBuffer(
-        int connected_sd,
-        uint8_t buffer[BUFFER_SIZE]);
-
-int sendMoveWithChoice(
-        int sd,
-        uint8_t choice,
-        uint8_t gameId,
-        uint8_t sequenceNum,
-        char board[ROWS][COLUMNS],
-        char mark);
-
-void respondToInvalidRequest(
-        int sd,
-        int sendSequenceNum,
-        uint8_t gameId);
-
-void u16_to_u8(uint16_t port_s, uint8_t port_array[2]);
-
-uint16_t u8_to_u16(const uint8_t port_array[2]);
-
-#endif
+#ifndef TICTACTOE_H
+#define TICTACTOE_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <memory.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tictactoe.h"
+
+
+#define ROWS  3
+#define COLUMNS  3
+// default and upper bound of the number of concurrent games per server
+#define MAX_BOARD 1024
+#define MAX_BOARD_LIMIT (1 << 24)
+// default and upper bound of the number of connections waiting for a board per server
+#define WAITLIST_SIZE 256
+#define MAX_WAITLIST 65535
+// default listen() backlog of each worker's socket, the kernel caps it at net.core.somaxconn
+#define LISTEN_BACKLOG SOMAXCONN
+#define MAX_TRY 3
+
+#define CLIENT_MARK 'X'
+#define SERVER_MARK 'O'
+
+// all 9 squares, bit (choice-1) stands for square choice
+#define FULL_BOARD 0x1ff
+
+// 1st byte, the version also selects the frame size
+#define VERSION 8  // legacy frames of BUFFER_SIZE bytes
+#define VERSION_COMPACT 9  // frames of COMPACT_FRAME_SIZE bytes
+#define VERSION_MUX 10  // COMPACT_FRAME_SIZE frames of many games sharing one connection
+
+// 3rd byte
+#define GAME_ON 0
+#define GAME_COMPLETE 1
+#define GAME_ERROR 2
+//#define RETRY 3
+#define GAME_QUEUED 4  // no board yet, bytes 5-6 are the position in the waitlist, big-endian
+
+// 4th byte, when 3rd byte == GAME_COMPLETE
+#define DRAW 1
+#define WIN 2
+#define LOSE 3
+
+// 4th byte, when 3rd byte == GAME_ERROR
+#define OUT_OF_RESOURCES 1
+#define MALFORMED_REQUEST 2
+#define SERVER_SHUTDOWN 3
+#define TIME_OUT 4
+#define TRY_AGAIN 5
+#define UNKNOWN_SESSION 6  // RESUME with a token the server does not know
+
+// 5th Byte
+#define NEW_GAME 0
+#define MOVE 1
+#define END_GAME 2
+#define RECONNECT 3
+#define RESUME 4  // the last frame sent, again, with the session token
+
+#define BUFFER_SIZE 1000
+
+// bytes 0-6 header, 7-15 board for RECONNECT
+#define COMPACT_FRAME_SIZE 16
+
+// VERSION_MUX frames carry a 32-bit gameId in bytes 5-8 and a 32-bit
+// sequence number in bytes 9-12, both big-endian, instead of bytes 5 and 6
+#define MUX_GAME_ID_OFFSET 5
+#define MUX_SEQUENCE_OFFSET 9
+
+// bytes 7-14 of server frames and of RESUME: loop id, slot (24 bits)
+// and secret (32 bits) of the session, all zeros before one is issued
+#define TOKEN_OFFSET 7
+#define TOKEN_SIZE 8
+
+// a server frame never writes past COMPACT_FRAME_SIZE, even a legacy one,
+// which is what lets resetSession clear only that much of bufferSend
+_Static_assert(TOKEN_OFFSET + TOKEN_SIZE <= COMPACT_FRAME_SIZE, "the token must fit a compact frame");
+_Static_assert(MUX_SEQUENCE_OFFSET + 4 <= COMPACT_FRAME_SIZE, "mux ids must fit a compact frame");
+
+// per-connection receive ring, a power of two holding at least two legacy frames
+#define RECV_RING_SIZE 2048
+
+// per-connection output queue, a power of two; a peer that lets it fill up is disconnected
+#define OUT_QUEUE_SIZE 4096
+
+#define TIME_LIMIT_SERVER 10
+
+// timer wheel geometry, 4 levels of 64 slots cover 2^24 ms (about 4.6 hours)
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+// max events returned by a single epoll_wait
+#define MAX_EVENTS 64
+
+#define DELIM "."
+
+#define MAX_SEND_COUNT 3
+
+// multicast
+#define MC_PORT 1818
+#define MC_GROUP "239.0.0.1"
+
+
+/*
+ * a board as two 9-bit masks, x for the squares of CLIENT_MARK
+ * and o for the squares of SERVER_MARK
+ */
+struct bitboard {
+    uint16_t x;
+    uint16_t o;
+};
+
+// board variants, asked for in the choice byte of NEW_GAME
+#define VARIANT_CLASSIC 0  // 3×3, played on a bitboard
+#define VARIANT_COUNT 4
+
+// the other variants keep one bit per square, up to 15×15
+#define MAX_SQUARES 225
+#define WIDE_WORDS ((MAX_SQUARES + 63) / 64)
+
+struct wideboard {
+    uint64_t x[WIDE_WORDS];
+    uint64_t o[WIDE_WORDS];
+    uint16_t moves;  // squares taken
+    uint8_t outcome;  // OUTCOME_*, updated by the variant's placeMark
+};
+
+/*
+ * an N×N board won by k marks in a row, with its kernels specialised
+ * for that size; they are NULL for VARIANT_CLASSIC
+ */
+struct variant {
+    const char *name;
+    uint8_t size;
+    uint8_t lineLength;
+    uint16_t squares;
+    void (*placeMark)(struct wideboard *board, int choice, char mark);
+    int (*isMoveValid)(const struct wideboard *board, int choice);
+    uint8_t (*chooseMove)(const struct wideboard *board);
+};
+
+extern const struct variant variants[VARIANT_COUNT];
+
+int findVariant(const char *name);
+
+void initWideBoard(struct wideboard *board);
+
+int checkWideWin(const struct wideboard *board, char mark);
+
+// log levels, each one includes the ones above it
+#define LOG_ERROR 0
+#define LOG_WARN 1
+#define LOG_INFO 2
+#define LOG_DEBUG 3  // every frame sent and received
+#define LOG_BOARD 4  // board rendering after every move
+
+#define LOG_MAX_ARGS 6
+
+// count the arguments after the format, at most LOG_MAX_ARGS
+#define LOG_NARGS(...) LOG_NARGS_(__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(fmt, a, b, c, d, e, f, n, ...) n
+
+/*
+ * LOG(level, fmt, ...) records a line when level is enabled. fmt must be
+ * a string literal and the arguments ints, since they are formatted later.
+ */
+#define LOG(level, ...) \
+    do { \
+        if ((level) <= logLevel) logWrite((level), LOG_NARGS(__VA_ARGS__), __VA_ARGS__); \
+    } while (0)
+
+extern volatile sig_atomic_t logLevel;
+
+// number of ternary board encodings, 3^9
+#define POSITIONS 19683
+
+// outcomeTable entries: outcome in the low 2 bits, then side to move and legality
+#define OUTCOME_MASK 0x3
+#define OUTCOME_ON 0
+#define OUTCOME_X_WINS 1
+#define OUTCOME_O_WINS 2
+#define OUTCOME_DRAW 3
+#define O_TO_MOVE 0x4
+#define LEGAL_POSITION 0x8
+
+// generated at build time by genOutcomeTable
+extern const uint16_t ternaryTable[FULL_BOARD + 1];
+extern const uint8_t outcomeTable[POSITIONS];
+
+int boardIndex(const struct bitboard *board);
+
+int isPositionLegal(const struct bitboard *board);
+
+void logWrite(int level, int nargs, const char *fmt, ...);
+
+void logErrno(int level, const char *msg);
+
+void logBoard(const struct bitboard *board, char mark);
+
+uint64_t logDropped();
+
+int startLogThread();
+
+void stopLogThread();
+
+int parseGeneralError(uint8_t statusModifier);
+
+int checkWin(const struct bitboard *board, char mark);
+
+int isMoveValid(const struct bitboard *board, int choice);
+
+void placeMark(struct bitboard *board, int choice, char mark);
+
+void initBoard(struct bitboard *board);
+
+void printBoard(const struct bitboard *board, char mark);
+
+struct recv_ring {
+    uint8_t data[RECV_RING_SIZE];
+    uint32_t head;  // total bytes consumed, wraps around
+    uint32_t tail;  // total bytes received, wraps around
+};
+
+struct out_queue {
+    uint8_t data[OUT_QUEUE_SIZE];
+    uint32_t head;  // total bytes written to the socket, wraps around
+    uint32_t tail;  // total bytes queued, wraps around
+};
+
+void initOutQueue(struct out_queue *queue);
+
+int queueBytes(struct out_queue *queue, const uint8_t *bytes, uint32_t len);
+
+int flushOutQueue(int sd, struct out_queue *queue);
+
+void initRecvRing(struct recv_ring *ring);
+
+int fillRecvRing(int sd, struct recv_ring *ring);
+
+int pushRecvRing(struct recv_ring *ring, const uint8_t *bytes, uint32_t len);
+
+int nextFrame(struct recv_ring *ring, uint8_t frame[BUFFER_SIZE]);
+
+// latency histograms: exact below 2^HISTOGRAM_SUB_BITS, then that many
+// buckets per power of two, i.e. about 3% relative error
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+struct histogram {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t max;
+};
+
+void initHistogram(struct histogram *histogram);
+
+void recordValue(struct histogram *histogram, uint64_t value);
+
+void mergeHistogram(struct histogram *into, const struct histogram *from);
+
+uint64_t histogramPercentile(const struct histogram *histogram, double percentile);
+
+// server AI levels
+#define AI_EASY 0
+#define AI_MEDIUM 1
+#define AI_HARD 2
+
+void initAi();
+
+uint8_t aiChooseMove(const struct bitboard *board, int level);
+
+// upper bound of event loop threads
+#define MAX_WORKERS 256
+
+// server I/O engines
+#define ENGINE_EPOLL 0
+#define ENGINE_URING 1
+
+struct server_config {
+    long portNumber;
+    uint32_t maxBoards;
+    int aiLevel;
+    int workers;
+    uint32_t timeoutMs;  // idle time before a game is timed out
+    int logLevel;
+    int engine;
+    long statsPort;  // 0 when metrics are not served
+    const char *snapshotPath;  // NULL when games are not snapshotted
+    struct sockaddr_in standby;  // where to replicate games, port 0 when nowhere
+    long replicaPort;  // port to receive a primary's games on, 0 when not a standby
+    uint32_t waitlist;  // connections held until a board frees, 0 to turn them away
+    int backlog;  // listen() backlog of each worker's socket
+};
+
+struct timer {
+    struct timer *next;  // NULL while the timer is not armed
+    struct timer *prev;
+    uint64_t expires;  // monotonic ms
+};
+
+struct timer_wheel {
+    struct timer slots[WHEEL_LEVELS][WHEEL_SLOTS];  // list heads
+    uint64_t now;  // the last tick served, monotonic ms
+    uint32_t count;  // armed timers
+};
+
+uint64_t monotonicMs();
+
+uint64_t monotonicNs();
+
+void initTimerWheel(struct timer_wheel *wheel, uint64_t now);
+
+void initTimer(struct timer *timer);
+
+void armTimer(struct timer_wheel *wheel, struct timer *timer, uint64_t expires);
+
+void cancelTimer(struct timer_wheel *wheel, struct timer *timer);
+
+int expireTimers(struct timer_wheel *wheel, uint64_t now, void (*onExpire)(struct timer *));
+
+int nextTimeout(const struct timer_wheel *wheel);
+
+// io_uring submission queue depth and provided receive buffers, per event loop
+#define URING_ENTRIES 1024
+#define URING_BUFFERS 512
+#define URING_BUFFER_SIZE 1024
+
+struct uring {
+    int fd;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned sqLocalTail;  // sqes prepared, published to the kernel on submit
+    unsigned sqSubmitted;
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe *cqes;
+    void *ringMap;
+    size_t ringMapSize;
+    size_t sqesSize;
+    struct io_uring_buf_ring *bufRing;  // provided buffers for multishot recv
+    uint8_t *bufs;
+    uint16_t bufTail;
+};
+
+int initUring(struct uring *ring);
+
+void freeUring(struct uring *ring);
+
+struct io_uring_sqe *getSqe(struct uring *ring);
+
+int submitAndWait(struct uring *ring, int waitMs);
+
+struct io_uring_cqe *peekCqe(struct uring *ring);
+
+void seenCqe(struct uring *ring);
+
+uint8_t *uringBuffer(struct uring *ring, uint16_t bid);
+
+void recycleBuffer(struct uring *ring, uint16_t bid);
+
+// the receive ring and output queue of a socket, only a slot that has a
+// socket of its own holds them, see attachBuffers
+struct connection_buffers {
+    struct recv_ring recvRing;
+    struct out_queue outQueue;
+    struct connection_buffers *next;  // spare list link
+};
+
+// spare connection buffers a session table keeps for the next connections
+#define SPARE_BUFFERS 64
+
+struct board_info {
+    int resendCount;
+    int sd;
+    struct timer timer;  // fires when the game has been idle for too long
+    uint32_t gameId;
+    uint32_t nextFree;  // free-list link, only meaningful while the slot is free
+    uint32_t sequenceNum;  // store the expected sequence number sent by the client
+    uint8_t version;  // protocol version of the client, 0 until its first frame
+    struct board_info *channel;  // the connection a VERSION_MUX game is played over, else NULL
+    struct board_info *muxNext;  // the games of a VERSION_MUX connection, listed from its slot
+    struct board_info *muxPrev;
+    struct bitboard board;
+    uint8_t variant;  // VARIANT_CLASSIC plays on board, the others on wide
+    struct wideboard *wide;  // allocated by the first game of a larger variant, NULL until then
+    uint8_t dirty;  // has queued output not yet handed to the socket
+    uint8_t overflow;  // the output queue overflowed, disconnect at the next flush
+    uint8_t recovered;  // restored from a snapshot, not reconnected to yet
+    uint32_t generation;  // bumped on every reuse of the slot, tags io_uring requests
+    uint32_t sending;  // bytes of outQueue owned by an io_uring send in flight
+    uint64_t receivedNs;  // arrival of the move being answered, 0 if none
+    uint32_t secret;  // of the session token, 0 until one is issued
+    struct handoff *handoff;  // the connection is moving to the game its RESUME names, else NULL
+    uint8_t bufferSend[COMPACT_FRAME_SIZE];  // header of the last frame sent, for resends
+    struct connection_buffers *buffers;  // NULL while the slot has no socket of its own
+};
+
+struct session_table {
+    struct board_info *slots;
+    uint32_t capacity;
+    uint32_t firstGameId;
+    uint32_t active;
+    uint32_t used;  // slots below this index have been handed out at least once
+    uint32_t freeHead;
+    struct connection_buffers *spareBuffers;
+    uint32_t spareCount;
+};
+
+int initSessionTable(struct session_table *table, uint32_t capacity, uint32_t firstGameId);
+
+void freeSessionTable(struct session_table *table);
+
+struct board_info *acquireSession(struct session_table *table);
+
+struct board_info *claimSession(struct session_table *table, uint32_t idx);
+
+void releaseSession(struct session_table *table, struct board_info *boardInfoPtr);
+
+int attachBuffers(struct session_table *table, struct board_info *boardInfoPtr);
+
+void releaseBuffers(struct session_table *table, struct board_info *boardInfoPtr);
+
+// state of a snapshot record
+#define RECORD_FREE 0
+#define RECORD_LIVE 1
+
+// one game of a session table snapshot or of a replication stream, 44 bytes
+struct game_record {
+    uint32_t gameId;
+    uint32_t sequenceNum;
+    struct bitboard board;
+    uint8_t state;
+    uint8_t version;
+    uint8_t resendCount;
+    uint8_t reserved;
+    uint8_t token[TOKEN_SIZE];  // the game's session token, all zero while it has none
+    uint8_t lastFrame[COMPACT_FRAME_SIZE];  // header of the last frame sent
+    uint32_t checksum;
+};
+
+struct snapshot {
+    int fd;
+    size_t size;
+    struct snapshot_header *header;  // NULL when not open
+    struct game_record *records;  // one per slot of the session table
+    uint32_t capacity;
+};
+
+int inspectSnapshot(const char *path, uint32_t *capacity, uint32_t *firstGameId);
+
+int checkSnapshots(const char *path, int workers, uint32_t shardCapacity);
+
+int openSnapshot(struct snapshot *snap, const char *path, uint32_t capacity, uint32_t firstGameId);
+
+void closeSnapshot(struct snapshot *snap);
+
+void fillRecord(struct game_record *record, const struct board_info *boardInfoPtr, uint8_t state,
+                const uint8_t token[TOKEN_SIZE]);
+
+int isRecordValid(const struct game_record *record);
+
+int matchRecord(const struct game_record *record, const struct bitboard *board);
+
+const struct game_record *liveRecord(const struct snapshot *snap, uint32_t slot);
+
+void saveRecord(struct snapshot *snap, uint32_t slot, const struct game_record *record);
+
+void clearRecord(struct snapshot *snap, uint32_t slot);
+
+// records per replication datagram, which stays below a 1500 byte MTU
+#define REPLICA_RECORDS 32
+// how often a primary sends all its live games again, and a standby expires the stale ones
+#define REPLICA_SWEEP_MS 1000
+
+// the records a loop has yet to send to the standby
+struct replica_stream {
+    int sd;  // -1 when games are not replicated
+    uint32_t count;
+    struct game_record records[REPLICA_RECORDS];
+};
+
+int openReplicaStream(struct replica_stream *stream, const struct sockaddr_in *standby);
+
+void closeReplicaStream(struct replica_stream *stream);
+
+void replicateRecord(struct replica_stream *stream, const struct game_record *record);
+
+void flushReplicaStream(struct replica_stream *stream);
+
+// a replicated game, kept by a standby loop until its client RESUMEs it
+struct replica {
+    struct game_record record;
+    uint64_t refreshedMs;
+    uint8_t used;
+};
+
+// the replicated games of one standby loop, open addressing on the loop id
+// and slot of their token, a power of two at most 3/4 full
+struct replica_table {
+    struct replica *replicas;  // NULL when the server is not a standby
+    uint32_t bits;
+    uint32_t count;
+    uint32_t ttlMs;  // how long a game is kept without being refreshed
+};
+
+int initReplicaTable(struct replica_table *table, uint32_t capacity, uint32_t ttlMs);
+
+void freeReplicaTable(struct replica_table *table);
+
+uint32_t replicaKey(const uint8_t token[TOKEN_SIZE]);
+
+void applyRecord(struct replica_table *table, const struct game_record *record, uint64_t now);
+
+void expireReplicas(struct replica_table *table, uint64_t now);
+
+int takeReplica(struct replica_table *table, const uint8_t token[TOKEN_SIZE], uint64_t now,
+                struct game_record *record);
+
+int startStandby(long port, void (*deliver)(const struct game_record *records, int count));
+
+void stopStandby();
+
+// per event loop counters, named in statNames of stats.c
+#define STAT_GAMES_STARTED 0
+#define STAT_GAMES_COMPLETED 1
+#define STAT_GAMES_TIMED_OUT 2
+#define STAT_DISCONNECTS 3
+#define STAT_RESENDS 4
+#define STAT_REJECTED 5  // OUT_OF_RESOURCES, the waitlist was full too
+#define STAT_MULTICAST_ANSWERED 6
+#define STAT_SLOW_CONSUMERS 7
+#define STAT_GAMES_RESUMED 8  // RESUMEs, on a standby too, and RECONNECTs of a recovered game
+#define STAT_MALFORMED_VERSION 9  // malformed requests by reason from here on
+#define STAT_MALFORMED_GAME_TYPE 10
+#define STAT_MALFORMED_GAME_ID 11
+#define STAT_MALFORMED_SEQUENCE 12
+#define STAT_MALFORMED_MOVE 13
+#define STAT_MALFORMED_STATUS 14
+#define STAT_MALFORMED_BOARD 15
+#define STAT_MALFORMED_VARIANT 16
+#define STAT_WAITLISTED 17  // connections that waited for a board
+#define STAT_WAIT_ABANDONED 18  // waiting connections that went away before they got one
+#define STAT_COUNT 19
+
+/*
+ * Written only by the loop that owns them, read by the stats thread;
+ * relaxed atomic stores keep the reads untorn without any locking
+ */
+struct loop_stats {
+    const struct session_table *sessions;  // for the active games gauge
+    uint64_t counters[STAT_COUNT];
+    struct histogram moveLatency;  // frame received to reply sent, in microseconds
+};
+
+#define COUNT_STAT(stats, index) \
+    __atomic_store_n(&(stats)->counters[index], (stats)->counters[index] + 1, __ATOMIC_RELAXED)
+
+int startStatsThread(long port, struct loop_stats *const stats[], int count);
+
+void stopStatsThread();
+
+void playServer(
+        const int sd_streams[],
+        int sd_dgram,
+        const struct server_config *config);
+
+// default time the client gives the ip_addresses entries to accept a connection
+#define CONNECT_DEADLINE_MS 5000
+
+void playClient(
+        int connected_sd,
+        int sd_dgram,
+        struct sockaddr_in multicast_address,
+        int connectDeadlineMs);
+
+int isIpValid(const char *ip_str);
+
+int isPortNumValid(const char *portNum);
+
+int isDigitValid(const char *s);
+
+int setNonBlocking(int sd);
+
+int isVersionValid(uint8_t version);
+
+int frameLength(uint8_t version);
+
+void writeFrameIds(uint8_t sb[COMPACT_FRAME_SIZE], uint32_t gameId, uint32_t sequenceNum);
+
+void writeFrameHeader(
+        uint8_t sb[COMPACT_FRAME_SIZE],
+        uint8_t version,
+        uint8_t choice,
+        uint8_t status,
+        uint8_t statusModifier,
+        uint8_t gameType,
+        uint32_t gameId,
+        uint32_t sequenceNum);
+
+void readFrameIds(const uint8_t buffer[COMPACT_FRAME_SIZE], uint32_t *gameId, uint32_t *sequenceNum);
+
+uint32_t frameIdMask(uint8_t version);
+
+int compareSequence(uint8_t version, uint32_t a, uint32_t b);
+
+int sendBuffer(
+        int connected_sd,
+        uint8_t buffer[BUFFER_SIZE]);
+
+void buildMoveFrame(
+        uint8_t sb[COMPACT_FRAME_SIZE],
+        uint8_t version,
+        uint8_t choice,
+        uint32_t gameId,
+        uint32_t sequenceNum,
+        struct bitboard *board,
+        char mark);
+
+int sendMoveWithChoice(
+        int sd,
+        uint8_t version,
+        uint8_t choice,
+        uint32_t gameId,
+        uint32_t sequenceNum,
+        struct bitboard *board,
+        char mark);
+
+void buildWideMoveFrame(
+        uint8_t sb[COMPACT_FRAME_SIZE],
+        uint8_t version,
+        const struct variant *variant,
+        uint8_t choice,
+        uint32_t gameId,
+        uint32_t sequenceNum,
+        struct wideboard *board,
+        char mark);
+
+void respondToInvalidRequest(
+        int sd,
+        uint8_t version,
+        int sendSequenceNum,
+        uint8_t gameId);
+
+void u16_to_u8(uint16_t port_s, uint8_t port_array[2]);
+
+uint16_t u8_to_u16(const uint8_t port_array[2]);
+
+#endif
@@ -0,0 +1,470 @@
+#include <netinet/tcp.h>
+#include <pthread.h>
+
+#include "tictactoe.h"
+
+
+#define USAGE "usage: ./tictactoeLoad [-c connections] [-r ramp_step] [-d seconds] " \
+        "[-w threads] [-m random|<script>] [-v 8|9|10] [-g games] [-b variant] [-s seed] " \
+        "<server_port> <server_ip>\n"
+
+#define DEFAULT_CONNECTIONS 100
+#define DEFAULT_SECONDS 10
+
+// states of a bot
+#define BOT_CONNECTING 0
+#define BOT_WAITING 1  // a frame is out, waiting for the server's answer
+
+
+struct game {
+    struct bitboard board;
+    struct wideboard wide;  // instead of board for every variant but VARIANT_CLASSIC
+    uint32_t gameId;
+    uint32_t sequenceNum;  // of the last frame sent
+    uint64_t sentNs;
+};
+
+/*
+ * One scripted connection. It plays a game at a time and reconnects right
+ * away when it ends, since the server closes a game's connection then;
+ * over VERSION_MUX it keeps gamesPerConnection games going on the same
+ * connection instead. The server answers the frames of a connection in
+ * order, so the game an answer is for is the oldest one waiting.
+ */
+struct bot {
+    int sd;
+    int state;
+    struct game *games;  // gamesPerConnection of them
+    struct game **waiting;  // ring of the games with a frame out, oldest first
+    uint32_t waitHead;
+    uint32_t waitCount;
+    struct recv_ring recvRing;
+};
+
+struct load_thread {
+    pthread_t thread;
+    int connections;
+    uint32_t randomState;
+    struct bot *bots;
+    int epfd;
+    // results
+    long games;
+    long errors;
+    long rejected;
+    long queued;
+    struct histogram latency;  // move round trips in microseconds
+};
+
+static struct sockaddr_in serverAddress;
+static uint8_t protocolVersion = VERSION_COMPACT;
+static uint32_t gamesPerConnection = 1;
+static uint8_t variant = VARIANT_CLASSIC;
+static const char *script = NULL;  // squares in order of preference, NULL for random moves
+static volatile int running;
+
+
+int isGameMoveValid(const struct game *game, int choice) {
+    if (variant == VARIANT_CLASSIC) return isMoveValid(&game->board, choice);
+    return variants[variant].isMoveValid(&game->wide, choice);
+}
+
+
+int checkGameWin(const struct game *game, char mark) {
+    if (variant == VARIANT_CLASSIC) return checkWin(&game->board, mark);
+    return checkWideWin(&game->wide, mark);
+}
+
+
+/*
+ * the bot's move: the first free square of the script, or a random free one
+ */
+uint8_t botMakeChoice(struct load_thread *self, const struct game *game) {
+    if (script != NULL) {
+        for (const char *c = script; *c != '\0'; c++)
+            if (isGameMoveValid(game, *c - '0')) return (uint8_t) (*c - '0');
+    }
+    uint32_t x = self->randomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    self->randomState = x;
+
+    // the free square at or after a random one
+    if (variant != VARIANT_CLASSIC) {
+        const int squares = variants[variant].squares;
+        for (int i = 0; i < squares; i++) {
+            int choice = (int) ((x + (uint32_t) i) % (uint32_t) squares) + 1;
+            if (isGameMoveValid(game, choice)) return (uint8_t) choice;
+        }
+        return 0;
+    }
+    const struct bitboard *board = &game->board;
+    uint16_t empty = FULL_BOARD & ~(board->x | board->o);
+    int skip = (int) (x % (uint32_t) __builtin_popcount(empty));
+    while (skip-- > 0) empty &= empty - 1;
+    return (uint8_t) (__builtin_ctz(empty) + 1);
+}
+
+
+/*
+ * send a frame the server answers and start timing the round trip
+ */
+int botSend(struct bot *bot, struct game *game, uint8_t sb[BUFFER_SIZE]) {
+    uint32_t gameId;
+    readFrameIds(sb, &gameId, &game->sequenceNum);
+    game->sentNs = monotonicNs();
+    bot->waiting[(bot->waitHead + bot->waitCount++) % gamesPerConnection] = game;
+    return (int) send(bot->sd, sb, frameLength(sb[0]), MSG_NOSIGNAL) == frameLength(sb[0]);
+}
+
+
+/*
+ * start a game on the bot's connection
+ */
+int botNewGame(struct bot *bot, struct game *game) {
+    initBoard(&game->board);
+    initWideBoard(&game->wide);
+    uint8_t sb[BUFFER_SIZE] = {protocolVersion, variant, GAME_ON, 0, NEW_GAME};
+    writeFrameIds(sb, 0, 0);
+    return botSend(bot, game, sb);
+}
+
+
+void closeBot(struct load_thread *self, struct bot *bot) {
+    if (bot->sd > 0) close(bot->sd);  // also removes it from epoll
+    bot->sd = -1;
+}
+
+
+/*
+ * open a fresh connection and queue the bot for a new game
+ */
+int startBot(struct load_thread *self, struct bot *bot) {
+    bot->sd = socket(AF_INET, SOCK_STREAM, 0);
+    if (bot->sd < 0) {
+        perror("Opening stream socket error");
+        return 0;
+    }
+    // games of one connection write back to back, Nagle would hold the later ones
+    if (protocolVersion == VERSION_MUX) {
+        int one = 1;
+        setsockopt(bot->sd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    bot->state = BOT_CONNECTING;
+    bot->waitHead = 0;
+    bot->waitCount = 0;
+    initRecvRing(&bot->recvRing);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = bot;
+    if (setNonBlocking(bot->sd) == 0 || epoll_ctl(self->epfd, EPOLL_CTL_ADD, bot->sd, &ev) < 0) {
+        closeBot(self, bot);
+        return 0;
+    }
+    if (connect(bot->sd, (struct sockaddr *) &serverAddress, sizeof(serverAddress)) < 0
+        && errno != EINPROGRESS) {
+        closeBot(self, bot);
+        return 0;
+    }
+    return 1;
+}
+
+
+void restartBot(struct load_thread *self, struct bot *bot) {
+    closeBot(self, bot);
+    if (running && startBot(self, bot) == 0) self->errors++;
+}
+
+
+/*
+ * Function: botReceive
+ * ----------------------------
+ *   Answer one frame from the server the way tictactoeClient does
+ *
+ *   return: 1 to keep the connection, 0 when the game is over or broken
+ */
+int botReceive(struct load_thread *self, struct bot *bot, const uint8_t rb[BUFFER_SIZE]) {
+    const uint8_t status = rb[2];
+    const uint8_t statusModifier = rb[3];
+    const uint8_t gameType = rb[4];
+    const int multiplexed = (protocolVersion == VERSION_MUX);
+
+    // a full server has the connection wait for a board, the answers
+    // to what we sent follow once it has one
+    if (status == GAME_QUEUED) {
+        self->queued++;
+        return 1;
+    }
+    if (bot->waitCount == 0) {  // nothing of ours to answer
+        self->errors++;
+        return 0;
+    }
+    struct game *game = bot->waiting[bot->waitHead];
+    bot->waitHead = (bot->waitHead + 1) % gamesPerConnection;
+    bot->waitCount--;
+    recordValue(&self->latency, (monotonicNs() - game->sentNs) / 1000);
+
+    uint32_t gameId, recvSequenceNum;
+    readFrameIds(rb, &gameId, &recvSequenceNum);
+    const uint32_t sendSequenceNum = (recvSequenceNum + 1) & frameIdMask(protocolVersion);
+
+    // a full server turns us away in the legacy version, or turns
+    // down the NEW_GAME over VERSION_MUX
+    if (status == GAME_ERROR) {
+        if (statusModifier != OUT_OF_RESOURCES) {
+            self->errors++;
+            return 0;
+        }
+        self->rejected++;
+        return multiplexed && botNewGame(bot, game);
+    }
+    if (rb[0] != protocolVersion
+        || recvSequenceNum != ((game->sequenceNum + 1) & frameIdMask(protocolVersion))) {
+        self->errors++;
+        return 0;
+    }
+
+    // the answer to NEW_GAME carries the gameId
+    if (game->sequenceNum == 0) game->gameId = gameId;
+    else if (gameId != game->gameId) {
+        self->errors++;
+        return 0;
+    }
+
+    if (gameType == END_GAME) {  // our last move ended the game
+        self->games++;
+        return multiplexed && botNewGame(bot, game);
+    }
+    if (game->sequenceNum != 0) {
+        if (isGameMoveValid(game, rb[1]) == 0) {
+            self->errors++;
+            return 0;
+        }
+        if (variant == VARIANT_CLASSIC) placeMark(&game->board, rb[1], SERVER_MARK);
+        else variants[variant].placeMark(&game->wide, rb[1], SERVER_MARK);
+    }
+
+    int result = checkGameWin(game, SERVER_MARK);
+    if (status == GAME_COMPLETE) {
+        if (result != statusModifier) {
+            self->errors++;
+            return 0;
+        }
+        uint8_t sb[BUFFER_SIZE] = {
+                protocolVersion, 0, GAME_COMPLETE, (result == WIN) ? LOSE : DRAW, END_GAME};
+        writeFrameIds(sb, game->gameId, sendSequenceNum);
+        send(bot->sd, sb, frameLength(protocolVersion), MSG_NOSIGNAL);
+        self->games++;
+        return multiplexed && botNewGame(bot, game);
+    }
+
+    uint8_t sb[BUFFER_SIZE] = {0};
+    if (variant == VARIANT_CLASSIC)
+        buildMoveFrame(sb, protocolVersion, botMakeChoice(self, game), game->gameId,
+                       sendSequenceNum, &game->board, CLIENT_MARK);
+    else
+        buildWideMoveFrame(sb, protocolVersion, &variants[variant], botMakeChoice(self, game),
+                           game->gameId, sendSequenceNum, &game->wide, CLIENT_MARK);
+    if (botSend(bot, game, sb) == 0) {
+        self->errors++;
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * handle an epoll event of a bot
+ */
+void serveBot(struct load_thread *self, struct bot *bot, uint32_t events) {
+    if (bot->state == BOT_CONNECTING) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(bot->sd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+            self->errors++;
+            restartBot(self, bot);
+            return;
+        }
+        if ((events & EPOLLOUT) == 0) return;
+
+        bot->state = BOT_WAITING;
+        for (uint32_t g = 0; g < gamesPerConnection; g++) {
+            if (botNewGame(bot, &bot->games[g]) == 0) {
+                self->errors++;
+                restartBot(self, bot);
+                return;
+            }
+        }
+        // a server with no board left writes as soon as it accepts, and
+        // that edge may come with the one of the connect
+    }
+
+    if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) == 0) return;
+    for (;;) {
+        int rc = fillRecvRing(bot->sd, &bot->recvRing);
+        if (rc == 0 || (rc < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            // every game ends on a frame of ours or the server's, not on a close
+            self->errors++;
+            restartBot(self, bot);
+            return;
+        }
+        if (rc < 0) return;
+
+        uint8_t rb[BUFFER_SIZE];
+        while (nextFrame(&bot->recvRing, rb)) {
+            if (botReceive(self, bot, rb) == 0) {
+                restartBot(self, bot);
+                return;
+            }
+        }
+    }
+}
+
+
+void *runLoadThread(void *arg) {
+    struct load_thread *self = arg;
+
+    for (int i = 0; i < self->connections; i++) {
+        if (startBot(self, &self->bots[i]) == 0) self->errors++;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (running) {
+        int n = epoll_wait(self->epfd, events, MAX_EVENTS, 100);
+        if (n < 0 && errno != EINTR) {
+            perror("Failed to epoll_wait");
+            break;
+        }
+        for (int e = 0; e < n && running; e++)
+            serveBot(self, events[e].data.ptr, events[e].events);
+    }
+
+    for (int i = 0; i < self->connections; i++) closeBot(self, &self->bots[i]);
+    return NULL;
+}
+
+
+/*
+ * Function: runStep
+ * ----------------------------
+ *   Keep a number of connections playing for some seconds and print one
+ *   line of results
+ *
+ *   return: games per second
+ */
+double runStep(int connections, int threadCount, int seconds, uint32_t seed) {
+    struct load_thread *threads = calloc((size_t) threadCount, sizeof(struct load_thread));
+    struct bot *bots = calloc((size_t) connections, sizeof(struct bot));
+    struct game *gameSlots = calloc((size_t) connections * gamesPerConnection, sizeof(struct game));
+    struct game **waiting = calloc((size_t) connections * gamesPerConnection, sizeof(struct game *));
+    if (threads == NULL || bots == NULL || gameSlots == NULL || waiting == NULL) {
+        perror("Failed to allocate bots");
+        exit(1);
+    }
+    for (int i = 0; i < connections; i++) {
+        bots[i].games = gameSlots + (size_t) i * gamesPerConnection;
+        bots[i].waiting = waiting + (size_t) i * gamesPerConnection;
+    }
+
+    running = 1;
+    uint64_t start = monotonicNs();
+    int assigned = 0;
+    for (int t = 0; t < threadCount; t++) {
+        struct load_thread *self = &threads[t];
+        self->connections = connections / threadCount + (t < connections % threadCount);
+        self->bots = bots + assigned;
+        assigned += self->connections;
+        self->randomState = seed * 2654435761u + (uint32_t) t + 1;
+        initHistogram(&self->latency);
+        self->epfd = epoll_create1(0);
+        if (self->epfd < 0 || pthread_create(&self->thread, NULL, runLoadThread, self) != 0) {
+            perror("Failed to start load thread");
+            exit(1);
+        }
+    }
+
+    sleep((unsigned) seconds);
+    running = 0;
+
+    long games = 0, errors = 0, rejected = 0, queued = 0;
+    struct histogram latency;
+    initHistogram(&latency);
+    for (int t = 0; t < threadCount; t++) {
+        pthread_join(threads[t].thread, NULL);
+        close(threads[t].epfd);
+        games += threads[t].games;
+        errors += threads[t].errors;
+        rejected += threads[t].rejected;
+        queued += threads[t].queued;
+        mergeHistogram(&latency, &threads[t].latency);
+    }
+    double elapsed = (double) (monotonicNs() - start) / 1e9;
+
+    double gamesPerSec = (double) games / elapsed;
+    printf("load variant=%s connections=%d games_per_connection=%u seconds=%.1f games=%ld games_per_sec=%.0f moves=%lu "
+           "p50_us=%lu p99_us=%lu p999_us=%lu max_us=%lu queued=%ld rejected=%ld errors=%ld\n",
+           variants[variant].name, connections, gamesPerConnection, elapsed, games, gamesPerSec, (unsigned long) latency.total,
+           (unsigned long) histogramPercentile(&latency, 50),
+           (unsigned long) histogramPercentile(&latency, 99),
+           (unsigned long) histogramPercentile(&latency, 99.9),
+           (unsigned long) latency.max, queued, rejected, errors);
+    fflush(stdout);
+
+    free(waiting);
+    free(gameSlots);
+    free(bots);
+    free(threads);
+    return gamesPerSec;
+}
+
+
+int main(int argc, char *argv[]) {
+    int connections = DEFAULT_CONNECTIONS;
+    int rampStep = 0;
+    int seconds = DEFAULT_SECONDS;
+    int threadCount = 1;
+    uint32_t seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:r:d:w:m:v:g:b:s:")) != -1) {
+        long value = (optarg != NULL) ? strtol(optarg, NULL, 10) : 0;
+        if (opt == 'c' && value > 0 && value <= 1000000) connections = (int) value;
+        else if (opt == 'r' && value > 0) rampStep = (int) value;
+        else if (opt == 'd' && value > 0) seconds = (int) value;
+        else if (opt == 'w' && value > 0 && value <= MAX_WORKERS) threadCount = (int) value;
+        else if (opt == 'v' && isVersionValid((uint8_t) value)) protocolVersion = (uint8_t) value;
+        else if (opt == 'g' && value > 0 && value <= 65536) gamesPerConnection = (uint32_t) value;
+        else if (opt == 'b' && findVariant(optarg) >= 0) variant = (uint8_t) findVariant(optarg);
+        else if (opt == 's') seed = (uint32_t) value;
+        else if (opt == 'm' && strcmp(optarg, "random") == 0) script = NULL;
+        else if (opt == 'm' && isDigitValid(optarg) && strchr(optarg, '0') == NULL) script = optarg;
+        else {
+            printf(USAGE);
+            exit(1);
+        }
+    }
+    // only VERSION_MUX plays more than one game per connection
+    if (argc - optind != 2 || isPortNumValid(argv[optind]) == 0 || isIpValid(argv[optind + 1]) == 0
+        || (gamesPerConnection > 1 && protocolVersion != VERSION_MUX)) {
+        printf(USAGE);
+        exit(1);
+    }
+
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons(strtol(argv[optind], NULL, 10));
+    serverAddress.sin_addr.s_addr = inet_addr(argv[optind + 1]);
+
+    // bots don't narrate their games
+    logLevel = LOG_ERROR;
+
+    // a ramp adds rampStep connections per step; games/sec levelling off
+    // while p99 climbs marks the saturation point
+    int step = (rampStep > 0) ? rampStep : connections;
+    for (int c = step; c <= connections; c += step) {
+        int threads = (threadCount < c) ? threadCount : c;
+        runStep(c, threads, seconds, seed);
+    }
+    return 0;
+}
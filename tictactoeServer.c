@@ -1,78 +1,238 @@
-#include "tictactoe.h"
-
-
-int main(int argc, char* argv[]) {
-    int sd_stream;
-    long portNumber;
-    struct sockaddr_in server_address;
-
-    // check arguments
-    if (argc != 2) {
-        printf("usage: ./tictactoeServer <server_port>\n");
-        exit(1);
-    }
-
-    if (isPortNumValid(argv[1]) == 1)
-        portNumber = strtol(argv[1], NULL, 10);
-    else {
-        printf("Invalid port number\n");
-        exit(1);
-    }
-
-    // start stream socket
-    sd_stream = socket(AF_INET, SOCK_STREAM, 0);
-    if(sd_stream < 0) {
-        perror("Opening stream socket error");
-        exit(1);
-    }
-
-    server_address.sin_family = AF_INET;
-    server_address.sin_port = htons(portNumber);
-    server_address.sin_addr.s_addr = INADDR_ANY;
-
-    if (bind(sd_stream, (struct sockaddr *) & server_address, sizeof(server_address)) < 0) {
-        perror("Connection failed: ");
-        exit(-1);
-    }
-
-    if (listen(sd_stream, 5) < 0) {
-        perror("Fail to listen: ");
-        close(sd_stream);
-        exit(-1);
-    }
-
-    // start datagram socket for multicast
-    int sd_dgram = socket(AF_INET, SOCK_DGRAM, 0);
-    if(sd_dgram < 0) {
-        perror("Opening datagram socket error");
-        exit(1);
-    }
-
-    struct sockaddr_in multicast_address;
-    struct ip_mreq mreq;
-
-    bzero((char *)&multicast_address, sizeof(multicast_address));
-
-    multicast_address.sin_family = AF_INET;
-    multicast_address.sin_addr.s_addr = htonl(INADDR_ANY);
-    multicast_address.sin_port = htons(MC_PORT);
-
-    if (bind(sd_dgram, (struct sockaddr *) &multicast_address, sizeof(multicast_address)) < 0) {
-        perror("bind");
-        exit(1);
-    }
-
-    mreq.imr_multiaddr.s_addr =	inet_addr(MC_GROUP);
-    mreq.imr_interface.s_addr =	htonl(INADDR_ANY);
-
-    if (setsockopt(sd_dgram, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
-        perror("setsockopt mreq");
-        exit(1);
-    }
-
-    playServer(sd_stream, sd_dgram, portNumber);
-
-    close(sd_stream);
-    close(sd_dgram);
-    return 0;
-}
+#include <sys/sysinfo.h>
+
+#include "tictactoe.h"
+
+
+#define USAGE "usage: ./tictactoeServer [-n max_games] [-d easy|medium|hard] " \
+        "[-w workers] [-t timeout_ms] [-l log_level | -q] [-e epoll|uring] [-s stats_port] " \
+        "[-f snapshot_path] [-r standby_ip:port] [-R replica_port] [-a waitlist] [-b backlog] " \
+        "<server_port>\n"
+
+
+/*
+ * the memory a server reserves per game up front: its slot in the session
+ * table and its entry in the loop's dirty list. The buffers of a socket
+ * only exist while it is connected.
+ */
+uint64_t gameMemory(uint32_t maxBoards) {
+    return (uint64_t) maxBoards * (sizeof(struct board_info) + sizeof(struct board_info *));
+}
+
+
+/*
+ * open a listening socket on portNumber. SO_REUSEPORT lets every
+ * worker bind its own socket and the kernel spreads connections over them.
+ * backlog is how many connections the kernel holds until the worker
+ * accepts them, a burst beyond it is dropped.
+ *
+ * return the socket, exit on failure
+ */
+int openStreamSocket(long portNumber, int backlog) {
+    struct sockaddr_in server_address;
+
+    // start stream socket
+    int sd_stream = socket(AF_INET, SOCK_STREAM, 0);
+    if(sd_stream < 0) {
+        perror("Opening stream socket error");
+        exit(1);
+    }
+
+    int one = 1;
+    if (setsockopt(sd_stream, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0) {
+        perror("setsockopt SO_REUSEPORT");
+        exit(1);
+    }
+
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(portNumber);
+    server_address.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(sd_stream, (struct sockaddr *) & server_address, sizeof(server_address)) < 0) {
+        perror("Connection failed: ");
+        exit(-1);
+    }
+
+    if (listen(sd_stream, backlog) < 0) {
+        perror("Fail to listen: ");
+        close(sd_stream);
+        exit(-1);
+    }
+    return sd_stream;
+}
+
+
+int main(int argc, char* argv[]) {
+    long portNumber;
+    struct server_config config = {
+            0, MAX_BOARD, AI_HARD, 1, TIME_LIMIT_SERVER * 1000, LOG_BOARD, ENGINE_EPOLL, 0, NULL, {0}, 0,
+            WAITLIST_SIZE, LISTEN_BACKLOG};
+
+    // check arguments
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:w:t:l:qe:s:f:r:R:a:b:")) != -1) {
+        if (opt == 'n') {
+            long maxBoards = strtol(optarg, NULL, 10);
+            if (maxBoards < 1 || maxBoards > MAX_BOARD_LIMIT) {
+                printf("Invalid number of games, expected 1 to %d\n", MAX_BOARD_LIMIT);
+                exit(1);
+            }
+            config.maxBoards = (uint32_t) maxBoards;
+        } else if (opt == 'd') {
+            if (strcmp(optarg, "easy") == 0) config.aiLevel = AI_EASY;
+            else if (strcmp(optarg, "medium") == 0) config.aiLevel = AI_MEDIUM;
+            else if (strcmp(optarg, "hard") == 0) config.aiLevel = AI_HARD;
+            else {
+                printf("Invalid difficulty, expected easy, medium or hard\n");
+                exit(1);
+            }
+        } else if (opt == 'w') {
+            long workers = strtol(optarg, NULL, 10);
+            if (workers < 1 || workers > MAX_WORKERS) {
+                printf("Invalid number of workers, expected 1 to %d\n", MAX_WORKERS);
+                exit(1);
+            }
+            config.workers = (int) workers;
+        } else if (opt == 't') {
+            long timeoutMs = strtol(optarg, NULL, 10);
+            if (timeoutMs < 1 || timeoutMs > INT_MAX) {
+                printf("Invalid timeout, expected a positive number of milliseconds\n");
+                exit(1);
+            }
+            config.timeoutMs = (uint32_t) timeoutMs;
+        } else if (opt == 'l') {
+            if (isDigitValid(optarg) == 0 || strtol(optarg, NULL, 10) > LOG_BOARD) {
+                printf("Invalid log level, expected 0 (errors) to %d (boards)\n", LOG_BOARD);
+                exit(1);
+            }
+            config.logLevel = (int) strtol(optarg, NULL, 10);
+        } else if (opt == 'q') {
+            config.logLevel = LOG_WARN;
+        } else if (opt == 'e') {
+            if (strcmp(optarg, "epoll") == 0) config.engine = ENGINE_EPOLL;
+            else if (strcmp(optarg, "uring") == 0) config.engine = ENGINE_URING;
+            else {
+                printf("Invalid engine, expected epoll or uring\n");
+                exit(1);
+            }
+        } else if (opt == 's') {
+            if (isPortNumValid(optarg) == 0) {
+                printf("Invalid stats port number\n");
+                exit(1);
+            }
+            config.statsPort = strtol(optarg, NULL, 10);
+        } else if (opt == 'f') {
+            config.snapshotPath = optarg;
+        } else if (opt == 'r') {
+            char *port = strrchr(optarg, ':');
+            if (port != NULL) *port++ = '\0';
+            if (port == NULL || isPortNumValid(port) == 0
+                || inet_pton(AF_INET, optarg, &config.standby.sin_addr) != 1) {
+                printf("Invalid standby, expected <ip>:<port>\n");
+                exit(1);
+            }
+            config.standby.sin_family = AF_INET;
+            config.standby.sin_port = htons(strtol(port, NULL, 10));
+        } else if (opt == 'R') {
+            if (isPortNumValid(optarg) == 0) {
+                printf("Invalid replica port number\n");
+                exit(1);
+            }
+            config.replicaPort = strtol(optarg, NULL, 10);
+        } else if (opt == 'a') {
+            long waitlist = strtol(optarg, NULL, 10);
+            if (isDigitValid(optarg) == 0 || waitlist > MAX_WAITLIST) {
+                printf("Invalid waitlist, expected 0 (turn connections away) to %d\n", MAX_WAITLIST);
+                exit(1);
+            }
+            config.waitlist = (uint32_t) waitlist;
+        } else if (opt == 'b') {
+            long backlog = strtol(optarg, NULL, 10);
+            if (backlog < 1 || backlog > INT_MAX) {
+                printf("Invalid backlog, expected a positive number of connections\n");
+                exit(1);
+            }
+            config.backlog = (int) backlog;
+        } else {
+            printf(USAGE);
+            exit(1);
+        }
+    }
+
+    if (argc - optind != 1) {
+        printf(USAGE);
+        exit(1);
+    }
+
+    if (isPortNumValid(argv[optind]) == 1)
+        portNumber = strtol(argv[optind], NULL, 10);
+    else {
+        printf("Invalid port number\n");
+        exit(1);
+    }
+    config.portNumber = portNumber;
+
+    if (config.maxBoards < (uint32_t) config.workers) {
+        printf("Need at least one game per worker\n");
+        exit(1);
+    }
+
+    struct sysinfo memory;
+    if (sysinfo(&memory) == 0 && gameMemory(config.maxBoards) > (uint64_t) memory.totalram * memory.mem_unit) {
+        printf("%u games need %lu MB, more than the %lu MB of this host\n", config.maxBoards,
+               (unsigned long) (gameMemory(config.maxBoards) >> 20),
+               (unsigned long) (((uint64_t) memory.totalram * memory.mem_unit) >> 20));
+        exit(1);
+    }
+    // the games of a snapshot written with another -n or -w would be lost
+    if (config.snapshotPath != NULL
+        && checkSnapshots(config.snapshotPath, config.workers,
+                          (config.maxBoards + config.workers - 1) / config.workers) == 0)
+        exit(1);
+
+    int sd_streams[MAX_WORKERS];
+    for (int i = 0; i < config.workers; i++)
+        sd_streams[i] = openStreamSocket(portNumber, config.backlog);
+
+    // start datagram socket for multicast
+    int sd_dgram = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sd_dgram < 0) {
+        perror("Opening datagram socket error");
+        exit(1);
+    }
+
+    // several servers on one host all get the queries
+    int reuse = 1;
+    if (setsockopt(sd_dgram, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
+        perror("setsockopt SO_REUSEADDR");
+        exit(1);
+    }
+
+    struct sockaddr_in multicast_address;
+    struct ip_mreq mreq;
+
+    bzero((char *)&multicast_address, sizeof(multicast_address));
+
+    multicast_address.sin_family = AF_INET;
+    multicast_address.sin_addr.s_addr = htonl(INADDR_ANY);
+    multicast_address.sin_port = htons(MC_PORT);
+
+    if (bind(sd_dgram, (struct sockaddr *) &multicast_address, sizeof(multicast_address)) < 0) {
+        perror("bind");
+        exit(1);
+    }
+
+    mreq.imr_multiaddr.s_addr =	inet_addr(MC_GROUP);
+    mreq.imr_interface.s_addr =	htonl(INADDR_ANY);
+
+    if (setsockopt(sd_dgram, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror("setsockopt mreq");
+        exit(1);
+    }
+
+    playServer(sd_streams, sd_dgram, &config);
+
+    for (int i = 0; i < config.workers; i++)
+        close(sd_streams[i]);
+    close(sd_dgram);
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include "tictactoe.h"
+
+
+/*
+ * Hierarchical timer wheel with 1 ms ticks. Level l has WHEEL_SLOTS slots
+ * of WHEEL_SLOTS^l ticks each; a timer sits in the lowest level whose span
+ * covers its deadline and moves down a level whenever the wheel reaches its
+ * slot. Arming and cancelling are O(1) and expiry only touches the timers
+ * that expire or cascade.
+ */
+
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+
+uint64_t monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+
+uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+
+void initTimerWheel(struct timer_wheel *wheel, uint64_t now) {
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        for (int i = 0; i < WHEEL_SLOTS; i++) {
+            wheel->slots[l][i].next = &wheel->slots[l][i];
+            wheel->slots[l][i].prev = &wheel->slots[l][i];
+        }
+    }
+    wheel->now = now;
+    wheel->count = 0;
+}
+
+
+void initTimer(struct timer *timer) {
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+}
+
+
+/*
+ * link a timer into the slot matching its deadline, relative to wheel->now.
+ * Deadlines before earliest are moved to earliest.
+ */
+void placeTimer(struct timer_wheel *wheel, struct timer *timer, uint64_t earliest) {
+    uint64_t expires = (timer->expires > earliest) ? timer->expires : earliest;
+    uint64_t delta = expires - wheel->now;
+
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << (WHEEL_BITS * (level + 1))))
+        level++;
+    // deadlines beyond the top level wait in its last reachable slot and cascade again
+    if (delta >= (1ULL << (WHEEL_BITS * WHEEL_LEVELS)))
+        expires = wheel->now + (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+
+    struct timer *head = &wheel->slots[level][(expires >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+
+void unlinkTimer(struct timer *timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
+
+
+/*
+ * Function: armTimer
+ * ----------------------------
+ *   (Re-)arm a timer to fire at the monotonic time expires, in ms
+ */
+void armTimer(struct timer_wheel *wheel, struct timer *timer, uint64_t expires) {
+    if (timer->next != NULL) unlinkTimer(timer);
+    else wheel->count++;
+    timer->expires = expires;
+    // the slot of the current tick has already been served
+    placeTimer(wheel, timer, wheel->now + 1);
+}
+
+
+void cancelTimer(struct timer_wheel *wheel, struct timer *timer) {
+    if (timer->next == NULL) return;
+    unlinkTimer(timer);
+    wheel->count--;
+}
+
+
+/*
+ * move every timer of the current slot of a level down, the ones due now
+ * land in the level 0 slot that expireTimers serves next
+ */
+void cascade(struct timer_wheel *wheel, int level) {
+    struct timer *head = &wheel->slots[level][(wheel->now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    while (head->next != head) {
+        struct timer *timer = head->next;
+        unlinkTimer(timer);
+        placeTimer(wheel, timer, wheel->now);
+    }
+}
+
+
+/*
+ * Function: expireTimers
+ * ----------------------------
+ *   Advance the wheel to now and call onExpire for every timer that is due.
+ *   onExpire may re-arm or cancel timers, including the expiring one.
+ *
+ *   return: the number of expired timers
+ */
+int expireTimers(struct timer_wheel *wheel, uint64_t now, void (*onExpire)(struct timer *)) {
+    int expired = 0;
+    if (wheel->count == 0) {
+        if (now > wheel->now) wheel->now = now;
+        return 0;
+    }
+
+    while (wheel->now < now) {
+        wheel->now++;
+        for (int l = 1; l < WHEEL_LEVELS; l++) {
+            if ((wheel->now & ((1ULL << (WHEEL_BITS * l)) - 1)) != 0) break;
+            cascade(wheel, l);
+        }
+
+        struct timer *head = &wheel->slots[0][wheel->now & WHEEL_MASK];
+        while (head->next != head) {
+            struct timer *timer = head->next;
+            unlinkTimer(timer);
+            wheel->count--;
+            expired++;
+            onExpire(timer);
+        }
+        if (wheel->count == 0) {
+            wheel->now = now;
+            break;
+        }
+    }
+    return expired;
+}
+
+
+/*
+ * Function: nextTimeout
+ * ----------------------------
+ *   return: ms until the wheel next has work (an expiry or a cascade),
+ *   or -1 if no timer is armed
+ */
+int nextTimeout(const struct timer_wheel *wheel) {
+    if (wheel->count == 0) return -1;
+
+    uint64_t best = UINT64_MAX;
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        const int shift = WHEEL_BITS * l;
+        const uint64_t current = wheel->now >> shift;
+        for (uint64_t k = 1; k <= WHEEL_SLOTS; k++) {
+            const struct timer *head = &wheel->slots[l][(current + k) & WHEEL_MASK];
+            if (head->next != head) {
+                uint64_t at = (current + k) << shift;
+                if (at < best) best = at;
+                break;
+            }
+        }
+    }
+    if (best == UINT64_MAX) return -1;
+    return (int) (best - wheel->now);
+}
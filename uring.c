@@ -0,0 +1,227 @@
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "tictactoe.h"
+
+
+/*
+ * Minimal io_uring wrapper over the raw system calls: one submission and
+ * completion ring plus a ring of provided buffers (group 0) that multishot
+ * recv picks its buffers from. Only the thread that created a ring may use it.
+ */
+
+
+#define BUFFER_GROUP 0
+
+
+static int uringSetup(unsigned entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize) {
+    return (int) syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+
+static int uringRegister(int fd, unsigned opcode, void *arg, unsigned count) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+
+/*
+ * Function: initUring
+ * ----------------------------
+ *   Create a ring for the calling thread and register its receive buffers
+ *
+ *   return: 1 on success, 0 if the kernel lacks a feature we rely on
+ */
+int initUring(struct uring *ring) {
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    int fd = uringSetup(URING_ENTRIES, &params);
+    if (fd < 0 && errno == EINVAL) {  // before 6.1
+        memset(&params, 0, sizeof(params));
+        fd = uringSetup(URING_ENTRIES, &params);
+    }
+    if (fd < 0) {
+        logErrno(LOG_ERROR, "io_uring_setup");
+        return 0;
+    }
+    ring->fd = fd;
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0
+        || (params.features & IORING_FEAT_EXT_ARG) == 0) {
+        LOG(LOG_ERROR, "io_uring is too old, features: %u.\n", params.features);
+        freeUring(ring);
+        return 0;
+    }
+
+    // submission and completion rings share one mapping
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ringMapSize = (sqSize > cqSize) ? sqSize : cqSize;
+    ring->ringMap = mmap(NULL, ring->ringMapSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->ringMap == MAP_FAILED) {
+        ring->ringMap = NULL;
+        logErrno(LOG_ERROR, "mmap io_uring");
+        freeUring(ring);
+        return 0;
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        logErrno(LOG_ERROR, "mmap io_uring sqes");
+        freeUring(ring);
+        return 0;
+    }
+
+    char *map = ring->ringMap;
+    ring->sqHead = (unsigned *) (map + params.sq_off.head);
+    ring->sqTail = (unsigned *) (map + params.sq_off.tail);
+    ring->sqMask = *(unsigned *) (map + params.sq_off.ring_mask);
+    ring->sqEntries = params.sq_entries;
+    ring->sqLocalTail = *ring->sqTail;
+    ring->sqSubmitted = ring->sqLocalTail;
+    ring->cqHead = (unsigned *) (map + params.cq_off.head);
+    ring->cqTail = (unsigned *) (map + params.cq_off.tail);
+    ring->cqMask = *(unsigned *) (map + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (map + params.cq_off.cqes);
+
+    // sqe i always sits in array slot i
+    unsigned *array = (unsigned *) (map + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) array[i] = i;
+
+    // provided buffers: the ring of descriptors, then the buffers themselves
+    size_t bufRingSize = URING_BUFFERS * sizeof(struct io_uring_buf);
+    ring->bufRing = mmap(NULL, bufRingSize + (size_t) URING_BUFFERS * URING_BUFFER_SIZE,
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->bufRing == MAP_FAILED) {
+        ring->bufRing = NULL;
+        logErrno(LOG_ERROR, "mmap io_uring buffers");
+        freeUring(ring);
+        return 0;
+    }
+    ring->bufs = (uint8_t *) ring->bufRing + bufRingSize;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) (uintptr_t) ring->bufRing;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = BUFFER_GROUP;
+    if (uringRegister(fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        logErrno(LOG_ERROR, "io_uring buffer ring");
+        freeUring(ring);
+        return 0;
+    }
+    for (uint16_t bid = 0; bid < URING_BUFFERS; bid++) recycleBuffer(ring, bid);
+    return 1;
+}
+
+
+void freeUring(struct uring *ring) {
+    if (ring->bufRing != NULL)
+        munmap(ring->bufRing, URING_BUFFERS * (sizeof(struct io_uring_buf) + URING_BUFFER_SIZE));
+    if (ring->sqes != NULL) munmap(ring->sqes, ring->sqesSize);
+    if (ring->ringMap != NULL) munmap(ring->ringMap, ring->ringMapSize);
+    if (ring->fd >= 0) close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+
+/*
+ * Function: getSqe
+ * ----------------------------
+ *   Hand out a zeroed submission entry; if the queue is full the pending
+ *   entries are submitted first
+ *
+ *   return: the entry, or NULL if the kernel does not take any
+ */
+struct io_uring_sqe *getSqe(struct uring *ring) {
+    unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    if (ring->sqLocalTail - head == ring->sqEntries) {
+        submitAndWait(ring, 0);
+        head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+        if (ring->sqLocalTail - head == ring->sqEntries) return NULL;
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sqLocalTail & ring->sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqLocalTail++;
+    return sqe;
+}
+
+
+/*
+ * Function: submitAndWait
+ * ----------------------------
+ *   Submit every prepared entry and wait for at least one completion,
+ *   all in a single io_uring_enter
+ *
+ *   waitMs: how long to wait, 0 only submits
+ *
+ *   return: the number of entries submitted, -1 on error (timeouts and
+ *   signals are not errors)
+ */
+int submitAndWait(struct uring *ring, int waitMs) {
+    __atomic_store_n(ring->sqTail, ring->sqLocalTail, __ATOMIC_RELEASE);
+    unsigned toSubmit = ring->sqLocalTail - ring->sqSubmitted;
+
+    struct __kernel_timespec ts = {waitMs / 1000, (long long) (waitMs % 1000) * 1000000};
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t) (uintptr_t) &ts;
+
+    unsigned minComplete = (waitMs > 0) ? 1 : 0;
+    int rc = uringEnter(ring->fd, toSubmit, minComplete,
+                        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (rc < 0) {
+        if (errno == ETIME || errno == EINTR || errno == EBUSY) return 0;
+        logErrno(LOG_ERROR, "io_uring_enter");
+        return -1;
+    }
+    ring->sqSubmitted += (unsigned) rc;
+    return rc;
+}
+
+
+/*
+ * return the oldest unseen completion, or NULL if there is none
+ */
+struct io_uring_cqe *peekCqe(struct uring *ring) {
+    unsigned head = *ring->cqHead;
+    if (head == __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) return NULL;
+    return &ring->cqes[head & ring->cqMask];
+}
+
+
+/*
+ * give the completion returned by peekCqe back to the kernel
+ */
+void seenCqe(struct uring *ring) {
+    __atomic_store_n(ring->cqHead, *ring->cqHead + 1, __ATOMIC_RELEASE);
+}
+
+
+uint8_t *uringBuffer(struct uring *ring, uint16_t bid) {
+    return ring->bufs + (size_t) bid * URING_BUFFER_SIZE;
+}
+
+
+/*
+ * make a provided buffer available to recv again
+ */
+void recycleBuffer(struct uring *ring, uint16_t bid) {
+    struct io_uring_buf *buf = &ring->bufRing->bufs[ring->bufTail & (URING_BUFFERS - 1)];
+    buf->addr = (uint64_t) (uintptr_t) uringBuffer(ring, bid);
+    buf->len = URING_BUFFER_SIZE;
+    buf->bid = bid;
+    ring->bufTail++;
+    __atomic_store_n(&ring->bufRing->tail, ring->bufTail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,162 @@
+#include "tictactoe.h"
+
+
+/*
+ * Kernels of the larger board variants. Each one is the same always-inline
+ * body instantiated by DEFINE_VARIANT with its size and line length as
+ * constants, so the compiler unrolls and folds every variant separately.
+ * VARIANT_CLASSIC has no entry here, it keeps the bitboard and outcomeTable
+ * path and never goes through a function pointer.
+ */
+
+
+static inline int hasSquare(const uint64_t bits[WIDE_WORDS], int square) {
+    return (int) ((bits[square >> 6] >> (square & 63)) & 1);
+}
+
+
+/*
+ * the marks in a row of bits from (row, column) on, one step (dRow, dColumn)
+ * at a time, without the square itself and stopping at k - 1
+ */
+static inline __attribute__((always_inline))
+int countRun(const uint64_t bits[WIDE_WORDS], int row, int column, int dRow, int dColumn,
+             const int n, const int k) {
+    int run = 0;
+    for (row += dRow, column += dColumn;
+         run < k - 1 && row >= 0 && row < n && column >= 0 && column < n
+         && hasSquare(bits, row * n + column);
+         row += dRow, column += dColumn)
+        run++;
+    return run;
+}
+
+
+/*
+ * Put mark on square choice, the move must be valid, and update the
+ * outcome of the game. Only the row, column and diagonals through the
+ * square can have become a win, and the move count tells a draw, so a
+ * move costs O(k) whatever the size of the board.
+ */
+static inline __attribute__((always_inline))
+void placeWideMarkN(struct wideboard *board, int choice, char mark, const int n, const int k) {
+    static const int dRow[4] = {0, 1, 1, 1};
+    static const int dColumn[4] = {1, 0, 1, -1};
+    uint64_t *bits = (mark == CLIENT_MARK) ? board->x : board->o;
+    const int square = choice - 1;
+    bits[square >> 6] |= (uint64_t) 1 << (square & 63);
+    board->moves++;
+    if (board->outcome != OUTCOME_ON) return;
+
+    const int row = square / n, column = square % n;
+    for (int d = 0; d < 4; d++) {
+        if (1 + countRun(bits, row, column, dRow[d], dColumn[d], n, k)
+            + countRun(bits, row, column, -dRow[d], -dColumn[d], n, k) >= k) {
+            board->outcome = (mark == CLIENT_MARK) ? OUTCOME_X_WINS : OUTCOME_O_WINS;
+            return;
+        }
+    }
+    if (board->moves == n * n) board->outcome = OUTCOME_DRAW;
+}
+
+
+static inline __attribute__((always_inline))
+int isWideMoveValidN(const struct wideboard *board, int choice, const int n) {
+    if (choice < 1 || choice > n * n) return 0;
+    return hasSquare(board->x, choice - 1) == 0 && hasSquare(board->o, choice - 1) == 0;
+}
+
+
+/*
+ * the free square nearest the centre, the first one in reading order on ties
+ */
+static inline __attribute__((always_inline))
+uint8_t chooseWideMoveN(const struct wideboard *board, const int n) {
+    int best = 0, bestDistance = INT_MAX;
+    for (int square = 0; square < n * n; square++) {
+        if (hasSquare(board->x, square) || hasSquare(board->o, square)) continue;
+        // twice the distance, so that even sizes have an integer centre
+        const int dRow = abs(2 * (square / n) - (n - 1));
+        const int dColumn = abs(2 * (square % n) - (n - 1));
+        const int distance = (dRow > dColumn) ? dRow : dColumn;
+        if (distance < bestDistance) {
+            best = square;
+            bestDistance = distance;
+        }
+    }
+    return (uint8_t) (best + 1);
+}
+
+
+#define DEFINE_VARIANT(id, n, k) \
+    static void placeWideMark##id(struct wideboard *board, int choice, char mark) { \
+        placeWideMarkN(board, choice, mark, n, k); \
+    } \
+    static int isWideMoveValid##id(const struct wideboard *board, int choice) { \
+        return isWideMoveValidN(board, choice, n); \
+    } \
+    static uint8_t chooseWideMove##id(const struct wideboard *board) { \
+        return chooseWideMoveN(board, n); \
+    }
+
+DEFINE_VARIANT(1, 4, 4)
+DEFINE_VARIANT(2, 5, 4)
+DEFINE_VARIANT(3, 15, 5)
+
+#define VARIANT_ENTRY(id, n, k, name) \
+    {name, n, k, n * n, placeWideMark##id, isWideMoveValid##id, chooseWideMove##id}
+
+const struct variant variants[VARIANT_COUNT] = {
+        {"3x3", ROWS, ROWS, ROWS * COLUMNS, NULL, NULL, NULL},  // VARIANT_CLASSIC
+        VARIANT_ENTRY(1, 4, 4, "4x4"),
+        VARIANT_ENTRY(2, 5, 4, "5x5k4"),
+        VARIANT_ENTRY(3, 15, 5, "15x15k5")};
+
+
+/*
+ * return the variant called name, -1 if there is none
+ */
+int findVariant(const char *name) {
+    for (int v = 0; v < VARIANT_COUNT; v++)
+        if (strcmp(variants[v].name, name) == 0) return v;
+    return -1;
+}
+
+
+void initWideBoard(struct wideboard *board) {
+    memset(board, 0, sizeof(*board));
+}
+
+
+/*
+ * checkWin of the larger variants, the outcome kept up to date by their placeMark
+ */
+int checkWideWin(const struct wideboard *board, char mark) {
+    if (board->outcome == OUTCOME_X_WINS) return (mark == CLIENT_MARK) ? WIN : LOSE;
+    if (board->outcome == OUTCOME_O_WINS) return (mark == SERVER_MARK) ? WIN : LOSE;
+    if (board->outcome == OUTCOME_DRAW) return DRAW;
+    return GAME_ON;
+}
+
+
+/*
+ * Function: buildWideMoveFrame
+ * ----------------------------
+ *   buildMoveFrame for a game of one of the larger variants
+ */
+void buildWideMoveFrame(
+        uint8_t sb[COMPACT_FRAME_SIZE],
+        uint8_t version,
+        const struct variant *variant,
+        uint8_t choice,
+        uint32_t gameId,
+        uint32_t sequenceNum,
+        struct wideboard *board,
+        char mark) {
+
+    variant->placeMark(board, choice, mark);
+    int result = checkWideWin(board, mark);
+
+    writeFrameHeader(sb, version, choice, (uint8_t) ((result == GAME_ON) ? GAME_ON : GAME_COMPLETE),
+                     (uint8_t) result, MOVE, gameId, sequenceNum);
+}